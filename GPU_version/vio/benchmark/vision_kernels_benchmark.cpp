@@ -0,0 +1,334 @@
+//
+// Microbenchmarks of the CPU vision kernels on synthetic 640x480 and 1280x720 images. BM_FreakExtractor
+// also checks the descriptors of vio::FreakExtractor against cv::xfeatures2d::FREAK and fails on a mismatch.
+// Build with -DVIO_BUILD_BENCHMARKS=ON, run ./vio_benchmark [--benchmark_filter=<regex>]
+//
+
+#include <string.h>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+#include <opencv2/xfeatures2d.hpp>
+#include <vio/global.h>
+#include <vio/vision.h>
+#include <vio/patch_score.h>
+#include <vio/feature_alignment.h>
+#include <vio/matcher.h>
+#include <vio/math_utils.h>
+#include <vio/freak_pattern.h>
+#include <vio/freak_extractor.h>
+
+namespace {
+
+const int kHalfPatch = 4;
+const int kPatch = 2*kHalfPatch;
+
+/// Smooth random texture, the same for every run of a size.
+cv::Mat syntheticImage(int width, int height)
+{
+  cv::RNG rng(0x5eed);
+  cv::Mat noise(height, width, CV_8UC1), img;
+  rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+  cv::GaussianBlur(noise, img, cv::Size(5, 5), 1.5);
+  cv::normalize(img, img, 0, 255, cv::NORM_MINMAX);
+  return img;
+}
+
+/// Pixels on a regular grid with enough border for patches and alignment.
+std::vector<Eigen::Vector2i> samplePixels(const cv::Mat& img, int step = 16, int border = 16)
+{
+  std::vector<Eigen::Vector2i> px;
+  for(int y=border; y<img.rows-border; y+=step)
+    for(int x=border; x<img.cols-border; x+=step)
+      px.push_back(Eigen::Vector2i(x, y));
+  return px;
+}
+
+/// Patch with a one pixel border around (u,v) as used by the matcher.
+void extractPatch(const cv::Mat& img, int u, int v, uint8_t* patch_with_border, uint8_t* patch)
+{
+  for(int y=0; y<kPatch+2; ++y)
+    for(int x=0; x<kPatch+2; ++x)
+      patch_with_border[y*(kPatch+2)+x] = img.at<uint8_t>(v-kHalfPatch-1+y, u-kHalfPatch-1+x);
+  for(int y=0; y<kPatch; ++y)
+    for(int x=0; x<kPatch; ++x)
+      patch[y*kPatch+x] = patch_with_border[(y+1)*(kPatch+2)+x+1];
+}
+
+void BM_halfSample(benchmark::State& state)
+{
+  cv::Mat in = syntheticImage(state.range(0), state.range(1));
+  cv::Mat out(in.rows/2, in.cols/2, CV_8UC1);
+  for(auto _ : state)
+  {
+    vk::halfSample(in, out);
+    benchmark::DoNotOptimize(out.data);
+  }
+  state.SetBytesProcessed(state.iterations()*in.total());
+}
+
+/// Unaligned input with a width which is not a multiple of 16 takes the generic path.
+void BM_halfSampleGeneric(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  cv::Mat in = img(cv::Rect(1, 0, img.cols-2, img.rows));
+  cv::Mat out(in.rows/2, in.cols/2, CV_8UC1);
+  for(auto _ : state)
+  {
+    vk::halfSample(in, out);
+    benchmark::DoNotOptimize(out.data);
+  }
+  state.SetBytesProcessed(state.iterations()*in.total());
+}
+
+void BM_shiTomasiScore(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  std::vector<Eigen::Vector2i> px = samplePixels(img, 8);
+  for(auto _ : state)
+    for(auto&& p:px)
+      benchmark::DoNotOptimize(vk::shiTomasiScore(img, p.x(), p.y()));
+  state.SetItemsProcessed(state.iterations()*px.size());
+}
+
+void BM_ZMSSD(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  std::vector<Eigen::Vector2i> px = samplePixels(img);
+  uint8_t patch_with_border[(kPatch+2)*(kPatch+2)] __attribute__ ((aligned (16)));
+  uint8_t ref_patch[kPatch*kPatch] __attribute__ ((aligned (16)));
+  extractPatch(img, img.cols/2, img.rows/2, patch_with_border, ref_patch);
+  vk::patch_score::ZMSSD<kHalfPatch> score(ref_patch);
+  const int stride = img.step.p[0];
+  for(auto _ : state)
+    for(auto&& p:px)
+      benchmark::DoNotOptimize(score.computeScore(
+          img.data + (p.y()-kHalfPatch)*stride + p.x()-kHalfPatch, stride));
+  state.SetItemsProcessed(state.iterations()*px.size());
+}
+
+/// Reference patches taken from the image, the estimate starts at a sub-pixel offset.
+struct AlignmentInput
+{
+  explicit AlignmentInput(const cv::Mat& img)
+  {
+    px = samplePixels(img, 32);
+    patches_with_border.resize(px.size()*(kPatch+2)*(kPatch+2));
+    patches.resize(px.size()*kPatch*kPatch);
+    for(size_t i=0; i<px.size(); ++i)
+      extractPatch(img, px[i].x(), px[i].y(),
+                   &patches_with_border[i*(kPatch+2)*(kPatch+2)], &patches[i*kPatch*kPatch]);
+  }
+  uint8_t* patchWithBorder(size_t i) { return &patches_with_border[i*(kPatch+2)*(kPatch+2)]; }
+  uint8_t* patch(size_t i) { return &patches[i*kPatch*kPatch]; }
+
+  std::vector<Eigen::Vector2i> px;
+  std::vector<uint8_t, Eigen::aligned_allocator<uint8_t> > patches_with_border;
+  std::vector<uint8_t, Eigen::aligned_allocator<uint8_t> > patches;
+};
+
+const Eigen::Vector2d kOffset(0.7, -0.4);
+
+void BM_align1D(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  AlignmentInput in(img);
+  const Eigen::Vector2f dir(1.0f, 0.0f);
+  for(auto _ : state)
+    for(size_t i=0; i<in.px.size(); ++i)
+    {
+      Eigen::Vector2d px_est = in.px[i].cast<double>() + kOffset;
+      double h_inv;
+      benchmark::DoNotOptimize(vio::feature_alignment::align1D(
+          img, dir, in.patchWithBorder(i), in.patch(i), 10, px_est, h_inv));
+    }
+  state.SetItemsProcessed(state.iterations()*in.px.size());
+}
+
+void BM_align2D(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  AlignmentInput in(img);
+  for(auto _ : state)
+    for(size_t i=0; i<in.px.size(); ++i)
+    {
+      Eigen::Vector2d px_est = in.px[i].cast<double>() + kOffset;
+      benchmark::DoNotOptimize(vio::feature_alignment::align2D(
+          img, in.patchWithBorder(i), in.patch(i), 10, px_est, true));
+    }
+  state.SetItemsProcessed(state.iterations()*in.px.size());
+}
+
+#ifdef __SSE2__
+void BM_align2D_SSE2(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  AlignmentInput in(img);
+  for(auto _ : state)
+    for(size_t i=0; i<in.px.size(); ++i)
+    {
+      Eigen::Vector2d px_est = in.px[i].cast<double>() + kOffset;
+      benchmark::DoNotOptimize(vio::feature_alignment::align2D_SSE2(
+          img, in.patchWithBorder(i), in.patch(i), 10, px_est));
+    }
+  state.SetItemsProcessed(state.iterations()*in.px.size());
+}
+#endif
+
+#ifdef __ARM_NEON__
+void BM_align2D_NEON(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  AlignmentInput in(img);
+  for(auto _ : state)
+    for(size_t i=0; i<in.px.size(); ++i)
+    {
+      Eigen::Vector2d px_est = in.px[i].cast<double>() + kOffset;
+      benchmark::DoNotOptimize(vio::feature_alignment::align2D_NEON(
+          img, in.patchWithBorder(i), in.patch(i), 10, px_est));
+    }
+  state.SetItemsProcessed(state.iterations()*in.px.size());
+}
+#endif
+
+void BM_warpAffine(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  std::vector<Eigen::Vector2i> px = samplePixels(img);
+  Eigen::Matrix2d A_cur_ref;
+  A_cur_ref << 0.98, -0.17,
+               0.17,  0.98;
+  uint8_t patch_with_border[(kPatch+2)*(kPatch+2)] __attribute__ ((aligned (16)));
+  for(auto _ : state)
+    for(auto&& p:px)
+      benchmark::DoNotOptimize(vio::warp::warpAffine(
+          A_cur_ref, img, p.cast<double>(), 0, 0, kHalfPatch+1, patch_with_border));
+  state.SetItemsProcessed(state.iterations()*px.size());
+}
+
+void BM_getMSSIM(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  std::vector<Eigen::Vector2i> px = samplePixels(img, 32);
+  const cv::Size size(kPatch+2, kPatch+2);
+  for(auto _ : state)
+    for(auto&& p:px)
+    {
+      cv::Mat ref = img(cv::Rect(cv::Point(p.x(), p.y()), size));
+      cv::Mat cur = img(cv::Rect(cv::Point(p.x()+1, p.y()), size));
+      benchmark::DoNotOptimize(vio::getMSSIM(cur, ref));
+    }
+  state.SetItemsProcessed(state.iterations()*px.size());
+}
+
+void BM_triangulateFeatureNonLin(benchmark::State& state)
+{
+  // bearing vectors of the image pixels seen from two views 10cm apart
+  const int width = state.range(0), height = state.range(1);
+  const double f = 0.8*width;
+  const Eigen::Matrix3d R = Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitY()).toRotationMatrix();
+  const Eigen::Vector3d t(0.1, 0.0, 0.02);
+  std::vector<Eigen::Vector3d> f1, f2;
+  for(int y=0; y<height; y+=32)
+    for(int x=0; x<width; x+=32)
+    {
+      const Eigen::Vector3d xyz = Eigen::Vector3d((x-width/2)/f, (y-height/2)/f, 1.0)*(2.0+x*1e-3);
+      f1.push_back((R*xyz+t).normalized());
+      f2.push_back(xyz.normalized());
+    }
+  for(auto _ : state)
+    for(size_t i=0; i<f1.size(); ++i)
+      benchmark::DoNotOptimize(vk::triangulateFeatureNonLin(R, t, f1[i], f2[i]));
+  state.SetItemsProcessed(state.iterations()*f1.size());
+}
+
+/// Keypoints as in FastDetector::detect, FAST corners stand in for the GPU detector. Only the
+/// ones which fit the FREAK pattern, so FREAK keeps all of them.
+std::vector<cv::KeyPoint> freakKeypoints(const cv::Mat& img)
+{
+  const vio::FreakPattern& pattern = vio::FreakPattern::instance();
+  std::vector<cv::KeyPoint> corners;
+  cv::FAST(img, corners, 20);
+  cv::KeyPointsFilter::retainBest(corners, 1000);
+  std::vector<cv::KeyPoint> keypoints;
+  for(auto&& c:corners)
+  {
+    cv::KeyPoint kp(c.pt.x, c.pt.y, 7.f, -1, c.response);
+    if(pattern.fits(kp.pt, pattern.scaleIndex(kp.size), img.cols, img.rows))
+      keypoints.push_back(kp);
+  }
+  return keypoints;
+}
+
+void BM_FREAK(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  const std::vector<cv::KeyPoint> keypoints = freakKeypoints(img);
+  for(auto _ : state)
+  {
+    std::vector<cv::KeyPoint> kps = keypoints;
+    cv::Ptr<cv::xfeatures2d::FREAK> extractor = cv::xfeatures2d::FREAK::create(true, true, 22.0f, 4);
+    cv::Mat descriptor;
+    extractor->compute(img, kps, descriptor);
+    benchmark::DoNotOptimize(descriptor.data);
+  }
+  state.SetItemsProcessed(state.iterations()*keypoints.size());
+}
+
+/// FreakExtractor on the keypoints of BM_FREAK, fails unless its descriptors are the ones of
+/// cv::xfeatures2d::FREAK bit for bit.
+void BM_FreakExtractor(benchmark::State& state)
+{
+  cv::Mat img = syntheticImage(state.range(0), state.range(1));
+  const std::vector<cv::KeyPoint> keypoints = freakKeypoints(img);
+  vio::FreakExtractor extractor;
+  std::vector<uint8_t> descriptors(keypoints.size()*vio::FreakPattern::kDescriptorSize);
+
+  std::vector<cv::KeyPoint> kps = keypoints;
+  cv::Mat reference;
+  cv::xfeatures2d::FREAK::create(true, true, 22.0f, 4)->compute(img, kps, reference);
+  extractor.compute(img, keypoints, descriptors.data());
+  if(kps.size() != keypoints.size() || reference.cols != vio::FreakPattern::kDescriptorSize)
+  {
+    state.SkipWithError("cv::xfeatures2d::FREAK dropped keypoints");
+    return;
+  }
+  for(int k=0; k<reference.rows; ++k)
+    if(memcmp(reference.ptr<uint8_t>(k), &descriptors[k*vio::FreakPattern::kDescriptorSize],
+              vio::FreakPattern::kDescriptorSize) != 0)
+    {
+      state.SkipWithError("descriptors differ from cv::xfeatures2d::FREAK");
+      return;
+    }
+
+  for(auto _ : state)
+  {
+    extractor.compute(img, keypoints, descriptors.data());
+    benchmark::DoNotOptimize(descriptors.data());
+  }
+  state.SetItemsProcessed(state.iterations()*keypoints.size());
+}
+
+} // namespace
+
+#define VIO_IMAGE_SIZES ->Args({640, 480})->Args({1280, 720})
+
+BENCHMARK(BM_halfSample) VIO_IMAGE_SIZES;
+BENCHMARK(BM_halfSampleGeneric) VIO_IMAGE_SIZES;
+BENCHMARK(BM_shiTomasiScore) VIO_IMAGE_SIZES;
+BENCHMARK(BM_ZMSSD) VIO_IMAGE_SIZES;
+BENCHMARK(BM_align1D) VIO_IMAGE_SIZES;
+BENCHMARK(BM_align2D) VIO_IMAGE_SIZES;
+#ifdef __SSE2__
+BENCHMARK(BM_align2D_SSE2) VIO_IMAGE_SIZES;
+#endif
+#ifdef __ARM_NEON__
+BENCHMARK(BM_align2D_NEON) VIO_IMAGE_SIZES;
+#endif
+BENCHMARK(BM_warpAffine) VIO_IMAGE_SIZES;
+BENCHMARK(BM_getMSSIM) VIO_IMAGE_SIZES;
+BENCHMARK(BM_triangulateFeatureNonLin) VIO_IMAGE_SIZES;
+BENCHMARK(BM_FREAK) VIO_IMAGE_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FreakExtractor) VIO_IMAGE_SIZES->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -47,6 +47,18 @@ public:
   virtual Vector2d
   world2cam(const Vector2d& uv) const = 0;
 
+  /// Project n camera frame points given in columns to pixels, one virtual call for the batch.
+  virtual void
+  world2cam(size_t n, const double* x, const double* y, const double* z, double* u, double* v) const
+  {
+    for(size_t i=0; i<n; ++i)
+    {
+      const Vector2d px = world2cam(Vector3d(x[i], y[i], z[i]));
+      u[i] = px[0];
+      v[i] = px[1];
+    }
+  }
+
   virtual double
   errorMultiplier2() const = 0;
 
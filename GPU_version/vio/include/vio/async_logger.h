@@ -0,0 +1,116 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_ASYNC_LOGGER_H
+#define VIO_ASYNC_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <boost/thread.hpp>
+
+namespace vio {
+
+/// Debug log which keeps disk I/O off the calling threads. write() copies the format pointer,
+/// a timestamp and the numeric arguments into a fixed-size record of a bounded lock-free queue,
+/// a background thread drains the queue into a binary file. decodeBinaryLog() (vio_log_decode)
+/// turns the file back into text, every line prefixed with [HH:MM:SS.mmm].
+///
+/// The format must be a string literal using printf conversions for numbers only.
+/// When the queue is full the record is dropped and counted, callers never block.
+class AsyncLogger
+{
+public:
+  static const int kMaxArgs = 10;
+  static const size_t kQueueSize = 4096;            //!< power of two.
+
+  struct Record
+  {
+    uint64_t stamp_ns;                              //!< system clock.
+    const char* format;
+    uint16_t types;                                 //!< bit i set: argument i is a double.
+    uint8_t n_args;
+    union { int64_t i; double d; } args[kMaxArgs];
+  };
+
+  explicit AsyncLogger(const std::string& path);
+  ~AsyncLogger();
+
+  bool isOpen() const { return file_ != NULL; }
+
+  template<typename... Args>
+  void write(const char* format, Args... args)
+  {
+    static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+    Record r;
+    r.stamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    r.format = format;
+    r.types = 0;
+    r.n_args = 0;
+    pack(r, args...);
+    if(!push(r))
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Block until everything written so far is on disk.
+  void flush();
+
+  /// Records lost because the queue was full.
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    Record record;
+  };
+
+  static void pack(Record&) {}
+
+  template<typename T, typename... Rest>
+  static void pack(Record& r, T value, Rest... rest)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "only numbers can be logged");
+    if constexpr(std::is_floating_point<T>::value)
+    {
+      r.types |= 1<<r.n_args;
+      r.args[r.n_args].d = static_cast<double>(value);
+    }
+    else if constexpr(std::is_enum<T>::value)
+      r.args[r.n_args].i = static_cast<int64_t>(static_cast<std::underlying_type_t<T> >(value));
+    else
+      r.args[r.n_args].i = static_cast<int64_t>(value);
+    ++r.n_args;
+    pack(r, rest...);
+  }
+
+  bool push(const Record& r);
+  bool pop(Record& r);
+  void drainLoop();
+  size_t drain();
+  void writeRecord(const Record& r);
+
+  FILE* file_;
+  Cell* cells_;
+  std::atomic<size_t> enqueue_pos_;
+  size_t dequeue_pos_;                              //!< only touched by the drain thread.
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> written_;                   //!< records on disk.
+  std::atomic<bool> running_;
+  boost::thread* thread_;
+  std::vector<const char*> formats_;                //!< format id -> format, drain thread only.
+};
+
+/// Write the text of a binary log, returns false if the file is not a log of AsyncLogger.
+bool decodeBinaryLog(FILE* in, FILE* out);
+
+} // namespace vio
+
+#endif //VIO_ASYNC_LOGGER_H
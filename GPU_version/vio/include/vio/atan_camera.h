@@ -16,9 +16,11 @@
 #include <stdlib.h>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <Eigen/Eigen>
 #include <vio/abstract_camera.h>
 #include <vio/math_utils.h>
+#include <vio/fast_atan.h>
 
 namespace vk {
 
@@ -37,18 +39,17 @@ private:
   double tans_inv_;                     //!< distortion model coeff
   bool distortion_;                     //!< use distortion model?
   double* param_;
+  std::vector<float> bearing_lut_;      //!< unit bearing of every pixel, 3 floats per pixel in row-major order.
+  double lut_r2_min_, lut_r2_max_;      //!< squared distorted radii around the step of cam2worldExact, not interpolated.
 
   //! Radial distortion transformation factor: returns ration of distorted / undistorted radius.
+  //! The polynomial atan is the one of the OpenCL kernels, see fast_atan.h for its error.
   inline double rtrans_factor(double r) const
   {
     if(r < 0.001 || s_ == 0.0)
       return 1.0;
-    else{
-        float y=2*r*sin(0.5 * (float)s_);
-        float x=cos(0.5 * (float)s_);
-        return (atan2(y,x) / (r * (float)s_));
-        //return (s_inv_* atan(r * tans_) / r);
-    }
+    else
+      return (s_inv_ * fast_atan((float)(r * tans_)) / r);
   };
 
   //! Inverse radial distortion: returns un-distorted radius from distorted.
@@ -59,6 +60,9 @@ private:
     return (tan(r * s_) * tans_inv_);
   };
 
+  //! Unit bearing of the model with tan, cam2world interpolates its values at the pixels.
+  Vector3d cam2worldExact(double x, double y) const;
+
 public:
 
   ATANCamera(double width, double height, double fx, double fy, double dx, double dy, double s);
@@ -77,6 +81,13 @@ public:
   virtual Vector2d
   world2cam(const Vector2d& uv) const;
 
+  virtual void
+  world2cam(size_t n, const double* x, const double* y, const double* z, double* u, double* v) const;
+
+  /// Largest differences to the exact model over the image at sub-pixel positions: the angle of
+  /// the interpolated bearing of cam2world in rad and the pixel of world2cam of an exact bearing.
+  void approximationError(double& bearing_error, double& px_error) const;
+
   const Vector2d focal_length() const
   {
     return Vector2d(fx_, fy_);
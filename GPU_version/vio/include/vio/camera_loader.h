@@ -31,6 +31,12 @@ bool loadFromRosNs(const std::string& ns, vk::AbstractCamera*& cam)
         getParam<double>(ns+"/cam_cx"),
         getParam<double>(ns+"/cam_cy"),
         getParam<double>(ns+"/cam_d0"));
+#if VIO_DEBUG
+    double bearing_error, px_error;
+    static_cast<vk::ATANCamera*>(cam)->approximationError(bearing_error, px_error);
+    std::cout << "ATAN camera: bearing LUT error " << bearing_error << " rad, fast world2cam error "
+              << px_error << " px\n";
+#endif
   }
   else
   {
@@ -9,95 +9,38 @@
 #include <vector>
 #include <algorithm>
 #include <fstream>
+#include <mutex>
 #include <exception>
+#include <stdexcept>
 #include <CL/opencl.h>
 #include <opencv2/opencv.hpp>
 #include <vio/abstract_camera.h>
 #include <vio/for_it.hpp>
 
-class kernel{
-public:
-    kernel(cl::Program* program,std::string name){
-        cl_int error;
-        _kernel = new cl::Kernel(*program,name.c_str(),&error);
-        assert(error== CL_SUCCESS);
-    };
-    ~kernel(){
-        for(auto&& i:_images)i.first->setDestructorCallback((void (*)(_cl_mem *, void *))notify, NULL);
-        for(auto&& i:_buffers)i.first->setDestructorCallback((void (*)(_cl_mem *, void *))notify, NULL);
-        _buffers.clear();
-        _images.clear();
-    };
-    template<typename T>
-    void load(size_t id/*buffer ID*/,T* buf,cl::CommandQueue* queue,cl::Context* context,size_t buf_size){
-        assert(buf);
-        cl_int error;
-        _buffers.push_back(std::pair<std::shared_ptr<cl::Buffer>,size_t>(std::make_shared<cl::Buffer>(*context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(T) * buf_size,buf,&error),id));
-        assert(error == CL_SUCCESS);
-        cl_int err=_kernel->setArg(id,*_buffers.back().first);
-        assert(err == CL_SUCCESS);
+/// Work-group size of reduce_system (reduce-system.cl).
+#define REDUCE_GROUP_SIZE 64
 
-    };
-    void load(size_t id/*buffer ID*/,cv::Mat& buf,cl::Context* context){
-        assert(!buf.empty());
-        cl_int error;
-        _images.push_back(std::pair<std::shared_ptr<cl::Image2D>,size_t>(std::make_shared<cl::Image2D>(*context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
-                                                                    cl::ImageFormat(CL_R, CL_UNSIGNED_INT8),
-                                                                    buf.size().width,
-                                                                    buf.size().height,
-                                                                    0,
-                                                                    reinterpret_cast<uchar*>(buf.data),&error),id));
-        assert(error == CL_SUCCESS);
-        cl_int err=_kernel->setArg(id,*_images.back().first);
-        assert(err == CL_SUCCESS);
-    };
-    template<typename T>
-    void reload(size_t id,T* buf,cl::CommandQueue* queue,size_t size){
-        assert(buf);
-        cl_int error;
-        for(auto&& i:_buffers)if(i.second==id){
-                cl::Event event;
-                T* Map_buf=(T*)queue->enqueueMapBuffer(*i.first,CL_NON_BLOCKING,CL_MAP_WRITE,0,sizeof(T) * size,NULL,&event,&error);
-                event.wait();
-                memcpy(Map_buf,buf,sizeof(T) * size);
-                assert(queue->enqueueUnmapMemObject(*i.first,Map_buf,NULL,&event)==CL_SUCCESS);
-                event.wait();
-
-            }
-        assert(error == CL_SUCCESS);
-    };
-    void release(size_t id/*buffer ID*/){
-        for(auto it=_buffers.begin();it!=_buffers.end();++it){
-            if((*it).second==id){
-                (*it).first->setDestructorCallback((void (*)(_cl_mem *, void *))notify, NULL);
-                (*it).first.reset();
-                _buffers.erase(it);
-                return;
-            }
-        }
-        for(auto it=_images.begin();it!=_images.end();++it){
-            if((*it).second==id){
-                (*it).first->setDestructorCallback((void (*)(_cl_mem *, void *))notify, NULL);
-                (*it).first.reset();
-                _images.erase(it);
-                return;
-            }
-        }
-    };
-    void release(){
-        _buffers.clear();
-        _images.clear();
-    }
-    cl::Kernel* _kernel = NULL;
-    std::shared_ptr<cl::Buffer> read(size_t id){
-        for(auto&& i:_buffers)if(i.second==id)return i.first;
-    }
-private:
-    static void notify(cl_mem *, void * user_data) {
-    }
-    std::list<std::pair<std::shared_ptr<cl::Buffer>,size_t>> _buffers;
-    std::list<std::pair<std::shared_ptr<cl::Image2D>,size_t>> _images;
+/// Work-group size of compact_corners (fast-gray.cl).
+#define COMPACT_GROUP_SIZE 256
 
+/// Kernel created by opencl::make_kernel.
+struct KernelHandle{
+    int id=-1;
+    bool valid() const {return id>=0;}
+};
+/// Pooled device buffer of n elements of T, returned to the pool by opencl::release.
+template<typename T>
+struct BufferHandle{
+    int slot=-1;
+    size_t size=0;
+    bool valid() const {return slot>=0;}
+};
+/// Pooled 8 bit single channel image.
+struct ImageHandle{
+    int slot=-1;
+    int width=0;
+    int height=0;
+    bool valid() const {return slot>=0;}
 };
 class read_cl{
 public:
@@ -114,63 +57,184 @@ public:
     char *src_str = nullptr;
     size_t size;
 };
+/// OpenCL device, the programs of the kernels and a pool of buffers and images. Released
+/// buffers and images stay allocated on the device and are handed out again for requests of
+/// the same size class, after warm up a frame does not allocate device memory. Handles can be
+/// released from any thread, everything else is called from the thread owning the backend.
+///
+/// The queue executes out of order, the *Async calls return the event of the command and take
+/// the events it has to wait for, the host only blocks where it needs a result.
 class opencl{
 public:
-    opencl(vk::AbstractCamera* cam);
+    /// Throws std::runtime_error if no device of the type is found or the program does not build,
+    /// the message has the build log. The compiled program is cached in cache_dir (empty: no
+    /// cache), keyed by device, driver version, kernel sources and build options.
+    opencl(vk::AbstractCamera* cam,cl_device_type type=CL_DEVICE_TYPE_GPU,const std::string& cache_dir="");
     ~opencl();
-    int32_t make_kernel(std::string name){_kernels.push_back(kernel(program,name));};
+    /// Throws std::runtime_error if the kernel can not be created from the program.
+    KernelHandle make_kernel(const std::string& name){
+        cl_int error;
+        std::shared_ptr<cl::Kernel> kernel=std::make_shared<cl::Kernel>(*program,name.c_str(),&error);
+        if(error!=CL_SUCCESS)
+            throw std::runtime_error("OpenCL kernel "+name+" can not be created, error "+std::to_string(error));
+        _kernels.push_back(kernel);
+        return KernelHandle{(int)_kernels.size()-1};
+    };
     template<typename T>
-    void load(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/, int size,T* buf) {
-        _kernels.at(id1).load(id2,buf,queue,context,size);
-    }
-    void load(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/,cv::Mat& buf) {
-        _kernels.at(id1).load(id2,buf,context);
+    BufferHandle<T> allocate(size_t size){
+        BufferHandle<T> handle;
+        handle.slot=acquireBuffer(sizeof(T)*std::max<size_t>(size,1));
+        handle.size=size;
+        return handle;
     }
+    ImageHandle allocateImage(int width,int height);
     template<typename T>
-    void load(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/,T&& value){
-        _kernels.at(id1)._kernel->setArg(id2,value);
-    };
+    void release(BufferHandle<T>& handle){
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        if(handle.valid())_buffers.at(handle.slot).in_use=false;
+        handle=BufferHandle<T>();
+    }
+    void release(ImageHandle& handle){
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        if(handle.valid())_images.at(handle.slot).in_use=false;
+        handle=ImageHandle();
+    }
+    /// Copy size elements from the host.
     template<typename T>
-    void reload(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/, size_t size,T* buf){
-        _kernels.at(id1).reload(id2,buf,queue,size);
-    };
-    cl_int run(size_t id1/*kernal ID*/,std::size_t  x=1,std::size_t y=1,std::size_t z=1) {
-        cl_int err=0;
+    void write(const BufferHandle<T>& handle,const T* buf,size_t size){
+        assert(buf && handle.valid() && size<=handle.size);
+        cl_int error;
         cl::Event event;
-        assert(queue->flush()==CL_SUCCESS);
-        if(z>1 && y>1){
-            err=queue->enqueueNDRangeKernel(*_kernels.at(id1)._kernel, cl::NullRange/*offset*/, cl::NDRange(x,y,z)/*Global*/, cl::NullRange/*local*/,NULL,&event);
-        }else if(z<2 && y>1){
-            err=queue->enqueueNDRangeKernel(*_kernels.at(id1)._kernel, cl::NullRange/*offset*/, cl::NDRange(x,y)/*Global*/, cl::NullRange/*local*/,NULL,&event);
-        }else{
-            err=queue->enqueueNDRangeKernel(*_kernels.at(id1)._kernel, cl::NullRange/*offset*/, cl::NDRange(x)/*Global*/, cl::NullRange/*local*/,NULL,&event);
-        };
-        assert(err==CL_SUCCESS);
+        T* Map_buf=(T*)queue->enqueueMapBuffer(_buffers.at(handle.slot).buffer,CL_NON_BLOCKING,CL_MAP_WRITE,0,sizeof(T) * size,NULL,&event,&error);
+        assert(error == CL_SUCCESS);
+        event.wait();
+        memcpy(Map_buf,buf,sizeof(T) * size);
+        error=queue->enqueueUnmapMemObject(_buffers.at(handle.slot).buffer,Map_buf,NULL,&event);
+        assert(error == CL_SUCCESS);
         event.wait();
-        assert(queue->finish()==CL_SUCCESS);
-        return 1;
-
     }
+    /// Set every element to value.
     template<typename T>
-    void read(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/,size_t size/*size*/, T* out){
-        assert(out);
+    void fill(const BufferHandle<T>& handle,const T& value){
+        fillAsync(handle,value).wait();
+    }
+    void write(const ImageHandle& handle,const cv::Mat& img);
+    template<typename T>
+    void read(const BufferHandle<T>& handle,size_t size/*size*/, T* out){
+        assert(out && handle.valid() && size<=handle.size);
         cl_int error;
         cl::Event event;
-        T* Map_buf=(T*)queue->enqueueMapBuffer(*_kernels.at(id1).read(id2),CL_NON_BLOCKING,CL_MAP_READ,0,sizeof(T) * size,NULL,&event,&error);
+        T* Map_buf=(T*)queue->enqueueMapBuffer(_buffers.at(handle.slot).buffer,CL_NON_BLOCKING,CL_MAP_READ,0,sizeof(T) * size,NULL,&event,&error);
         assert(error == CL_SUCCESS);
         event.wait();
         memcpy(out,Map_buf,sizeof(T) * size);
-        assert(queue->enqueueUnmapMemObject(*_kernels.at(id1).read(id2),Map_buf,NULL,&event)==CL_SUCCESS);
+        error=queue->enqueueUnmapMemObject(_buffers.at(handle.slot).buffer,Map_buf,NULL,&event);
+        assert(error == CL_SUCCESS);
         event.wait();
     }
-    void clear_buf(){
-        for(auto k:_kernels)k.release();
-    };
-    void release(size_t id1/*kernal ID*/,size_t id2/*buffer ID*/){
-        _kernels.at(id1).release(id2);
+    template<typename T>
+    void setArg(const KernelHandle& k,cl_uint arg,const BufferHandle<T>& handle){
+        assert(handle.valid());
+        cl_int error=_kernels.at(k.id)->setArg(arg,_buffers.at(handle.slot).buffer);
+        assert(error == CL_SUCCESS);
+    }
+    void setArg(const KernelHandle& k,cl_uint arg,const ImageHandle& handle){
+        assert(handle.valid());
+        cl_int error=_kernels.at(k.id)->setArg(arg,_images.at(handle.slot).image);
+        assert(error == CL_SUCCESS);
+    }
+    /// Scalar argument.
+    template<typename T>
+    void setArg(const KernelHandle& k,cl_uint arg,const T& value){
+        cl_int error=_kernels.at(k.id)->setArg(arg,value);
+        assert(error == CL_SUCCESS);
     }
+    /// Enqueue the kernel after the events of wait, returns without blocking. The arguments are
+    /// captured at this point, they can be changed for the next launch right away.
+    cl::Event enqueue(const KernelHandle& k,std::size_t x=1,std::size_t y=1,std::size_t z=1,const std::vector<cl::Event>& wait={}){
+        cl::NDRange global= z>1 && y>1 ? cl::NDRange(x,y,z) : (y>1 ? cl::NDRange(x,y) : cl::NDRange(x));
+        return enqueue(k,global,cl::NullRange,wait);
+    }
+    /// enqueue with an explicit work-group size.
+    cl::Event enqueue(const KernelHandle& k,const cl::NDRange& global,const cl::NDRange& local,const std::vector<cl::Event>& wait={}){
+        cl::Event event;
+        cl_int err=queue->enqueueNDRangeKernel(*_kernels.at(k.id), cl::NullRange/*offset*/, global, local,waitList(wait),&event);
+        assert(err==CL_SUCCESS);
+        queue->flush();
+        return event;
+    }
+    /// Non-blocking upload, buf must stay valid until the event completed.
+    template<typename T>
+    cl::Event writeAsync(const BufferHandle<T>& handle,const T* buf,size_t size,const std::vector<cl::Event>& wait={}){
+        assert(buf && handle.valid() && size<=handle.size);
+        cl::Event event;
+        cl_int error=queue->enqueueWriteBuffer(_buffers.at(handle.slot).buffer,CL_NON_BLOCKING,0,sizeof(T)*size,buf,waitList(wait),&event);
+        assert(error == CL_SUCCESS);
+        return event;
+    }
+    /// Non-blocking upload of the image, img must stay valid until the event completed.
+    cl::Event writeAsync(const ImageHandle& handle,const cv::Mat& img,const std::vector<cl::Event>& wait={});
+    /// Non-blocking download into img (allocated, CV_8UC1 of the image size).
+    cl::Event readAsync(const ImageHandle& handle,cv::Mat& img,const std::vector<cl::Event>& wait={});
+    template<typename T>
+    cl::Event fillAsync(const BufferHandle<T>& handle,const T& value,const std::vector<cl::Event>& wait={}){
+        assert(handle.valid());
+        cl::Event event;
+        cl_int error=queue->enqueueFillBuffer(_buffers.at(handle.slot).buffer,value,0,sizeof(T)*handle.size,waitList(wait),&event);
+        assert(error == CL_SUCCESS);
+        return event;
+    }
+    /// Non-blocking device copy of size elements from src at src_offset to dst at dst_offset.
+    template<typename T>
+    cl::Event copyAsync(const BufferHandle<T>& src,size_t src_offset,const BufferHandle<T>& dst,size_t dst_offset,size_t size,const std::vector<cl::Event>& wait={}){
+        assert(src.valid() && dst.valid() && src_offset+size<=src.size && dst_offset+size<=dst.size);
+        cl::Event event;
+        cl_int error=queue->enqueueCopyBuffer(_buffers.at(src.slot).buffer,_buffers.at(dst.slot).buffer,
+                                              sizeof(T)*src_offset,sizeof(T)*dst_offset,sizeof(T)*size,waitList(wait),&event);
+        assert(error == CL_SUCCESS);
+        return event;
+    }
+    /// Non-blocking download, out is valid once the event completed.
+    template<typename T>
+    cl::Event readAsync(const BufferHandle<T>& handle,size_t size,T* out,const std::vector<cl::Event>& wait={}){
+        assert(out && handle.valid() && size<=handle.size);
+        cl::Event event;
+        cl_int error=queue->enqueueReadBuffer(_buffers.at(handle.slot).buffer,CL_NON_BLOCKING,0,sizeof(T)*size,out,waitList(wait),&event);
+        assert(error == CL_SUCCESS);
+        queue->flush();
+        return event;
+    }
+    static void wait(const std::vector<cl::Event>& events){
+        if(events.empty())return;
+        cl_int error=cl::Event::waitForEvents(events);
+        assert(error == CL_SUCCESS);
+    }
+    /// Blocking launch.
+    cl_int run(const KernelHandle& k,std::size_t  x=1,std::size_t y=1,std::size_t z=1) {
+        enqueue(k,x,y,z).wait();
+        return 1;
+    }
+    /// Number of device allocations made by the pool, constant in steady state.
+    size_t allocations() const {return _buffers.size()+_images.size();}
 private:
-    std::vector<kernel> _kernels;
+    struct PooledBuffer{
+        cl::Buffer buffer;
+        size_t bytes;           //!< size class, a power of two.
+        bool in_use;
+    };
+    struct PooledImage{
+        cl::Image2D image;
+        int width,height;
+        bool in_use;
+    };
+    int acquireBuffer(size_t bytes);
+    static const std::vector<cl::Event>* waitList(const std::vector<cl::Event>& wait){
+        return wait.empty() ? NULL : &wait;
+    }
+    std::vector<std::shared_ptr<cl::Kernel>> _kernels;
+    std::vector<PooledBuffer> _buffers;
+    std::vector<PooledImage> _images;
+    std::mutex _pool_mutex;     //!< guards the in_use flags and the growth of the pools.
     cl::Context* context = nullptr;
     cl::Device* device = nullptr;
     cl::Program* program = nullptr;
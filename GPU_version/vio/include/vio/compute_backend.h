@@ -0,0 +1,235 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_COMPUTE_BACKEND_H
+#define VIO_COMPUTE_BACKEND_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <Eigen/Core>
+#include <opencv2/core.hpp>
+#include <vio/abstract_camera.h>
+#include <vio/freak_extractor.h>
+#include <vio/image_pyramid.h>
+
+class opencl;
+
+namespace vio {
+
+/// Reference side of an alignment problem, made by the backend which aligns against it: the
+/// points, their observations and the patches of the observations on every pyramid level. None of
+/// it depends on the pose being optimized, a keyframe keeps its reference for all the frames
+/// aligned against it.
+class AlignmentReference
+{
+public:
+  virtual ~AlignmentReference() {}
+
+  /// Number of features.
+  virtual size_t size() const = 0;
+
+  /// Replace the points and the pose after they moved, xyz_ref in the order of the creation. The
+  /// patches only depend on the observations and are kept.
+  virtual void setPoints(const std::vector<Eigen::Vector3f>& xyz_ref, const Eigen::Vector3f& ref_pose) = 0;
+};
+
+/// Device which runs the FAST detection (fast-gray.cl), the FREAK descriptors (freak.cl) and the
+/// residuals of the sparse image alignment (compute-residual.cl). All implementations return the
+/// same corners and the same sums of the per-feature terms, the caller does the solve.
+class ComputeBackend
+{
+public:
+  enum Type {OPENCL_GPU, OPENCL_CPU, NATIVE};
+
+  struct FastResult
+  {
+    int count;                                  //!< corners selected, larger than corners.size() if truncated.
+    std::vector<cv::Point2i> corners;           //!< pixels of the level.
+    std::vector<float> scores;                  //!< Shi-Tomasi score of each corner.
+  };
+
+  /// FAST threshold and corner selection of the detection. A cell is cell_size pixels of level 0
+  /// on every level and keeps its cell_corners best corners after a 3x3 non-maximum suppression.
+  struct FastOptions
+  {
+    int threshold;                              //!< minimum intensity difference to the circle.
+    int cell_size;
+    int cell_corners;                           //!< at most kMaxCellCorners.
+  };
+
+  static const int kMaxCellCorners = 16;        //!< MAX_CELL_CORNERS of the OpenCL build.
+
+  virtual ~ComputeBackend() {}
+
+  /// "gpu": OpenCL GPU device, "cpu": OpenCL CPU device (e.g. POCL), "native": C++ on the host.
+  /// An OpenCL backend without a matching device falls back to the native one. The OpenCL
+  /// programs are cached in cache_dir.
+  static ComputeBackend* create(vk::AbstractCamera* cam, const std::string& name, const std::string& cache_dir = "");
+
+  virtual Type type() const = 0;
+  virtual std::string name() const = 0;
+
+  /// Image pyramid of a frame, kept on the device for detection and alignment until released.
+  virtual std::shared_ptr<ImagePyramid> createPyramid(const cv::Mat& img_level_0, int n_levels) = 0;
+
+  /// Start the FAST detection of pyramid level level in img and return without waiting for it.
+  /// The corners are scored, suppressed and selected per cell on the device. The max_corners best
+  /// by score are stored (equal scores in cell order), in the order of the cells in raster order.
+  /// img must stay alive until the result is taken, get() has to be called on every future
+  /// (OpenCL returns its buffers to the pool there).
+  virtual std::future<FastResult> detectFastAsync(const cv::Mat& img, int level, const FastOptions& options, int max_corners) = 0;
+
+  /// detectFastAsync on a level of a pyramid, resident levels are not uploaded again. pyr must
+  /// stay alive until the result is taken.
+  virtual std::future<FastResult> detectFastAsync(const ImagePyramid& pyr, int level, const FastOptions& options, int max_corners) = 0;
+
+  /// Blocking detectFastAsync, returns the number of corners selected.
+  int detectFast(const cv::Mat& img, int level, const FastOptions& options, int max_corners, std::vector<cv::Point2i>& corners)
+  {
+    FastResult result = detectFastAsync(img, level, options, max_corners).get();
+    corners.swap(result.corners);
+    return result.count;
+  }
+
+  /// Start the FREAK descriptors of keypoints (pixels of level 0 of pyr) with the tables of
+  /// FreakPattern::instance(), the descriptors of cv::xfeatures2d::FREAK::create(true, true, 22.0f, 4).
+  /// Every keypoint has to fit the pattern at its size (FreakPattern::fits). The
+  /// FreakPattern::kDescriptorSize bytes of each keypoint are written to descriptors, which is valid
+  /// once the future is taken. pyr, keypoints and descriptors are held by reference, the caller
+  /// keeps them alive and unchanged until get() returns, also when the future is dropped untaken.
+  virtual std::future<void> describeAsync(const ImagePyramid& pyr, const std::vector<cv::KeyPoint>& keypoints,
+                                          uint8_t* descriptors) = 0;
+
+  /// Reference of alignment problems, ref_pose is {x, z, pitch}, xyz_ref are the points in the
+  /// reference camera frame and px_ref their observations in ref_pyr. The patches of all levels are
+  /// computed here, ref_pyr must outlive the reference.
+  virtual std::shared_ptr<AlignmentReference> createAlignmentReference(
+      const std::vector<Eigen::Vector3f>& xyz_ref,
+      const std::vector<Eigen::Vector2f>& px_ref,
+      const Eigen::Vector3f& ref_pose,
+      const ImagePyramid& ref_pyr) = 0;
+
+  /// Start an alignment problem against references made by this backend, cur_pose is {x, z, pitch}.
+  /// The features of all references are stacked into one problem, each residual launch covers them
+  /// all and the sums are over all of them.
+  virtual void setAlignmentProblem(const std::vector<std::shared_ptr<const AlignmentReference>>& refs,
+                                   const Eigen::Vector3f& cur_pose) = 0;
+
+  /// Pyramid level of the following computeResiduals calls, cur_pyr must stay alive.
+  virtual void setAlignmentLevel(const ImagePyramid& cur_pyr, int level) = 0;
+
+  /// Residuals of the current pose, sums over the features of the mean absolute patch error
+  /// and of chi2. The per-feature terms are reduced where they are computed.
+  virtual void computeResiduals(float scale, float& error, float& chi2) = 0;
+
+  /// Normal equations H x = b of the last computeResiduals. NaN terms of the features after the
+  /// first are skipped and b is the Jacobian term of the first feature minus those of the others,
+  /// the sums the host computed before the reduction moved to the backends.
+  virtual void linearSystem(Eigen::Matrix3f& H, Eigen::Vector3f& b) = 0;
+
+  virtual Eigen::Vector3f alignmentPose() = 0;
+  virtual void setAlignmentPose(const Eigen::Vector3f& pose) = 0;
+
+  /// Free the buffers of the alignment problem.
+  virtual void releaseAlignment() = 0;
+};
+
+/// fast_score, select_corners, integral_rows, integral_cols, freak_describe, compute_residual, reduce_system
+/// and half_sample kernels on an OpenCL device.
+class OpenCLBackend : public ComputeBackend
+{
+public:
+  /// Throws std::runtime_error if there is no device of the type, or the kernels do not build.
+  OpenCLBackend(vk::AbstractCamera* cam, Type type, const std::string& cache_dir = "");
+  virtual ~OpenCLBackend();
+
+  virtual Type type() const { return type_; }
+  virtual std::string name() const { return type_ == OPENCL_GPU ? "gpu" : "cpu"; }
+  virtual std::shared_ptr<ImagePyramid> createPyramid(const cv::Mat& img_level_0, int n_levels);
+  virtual std::future<FastResult> detectFastAsync(const cv::Mat& img, int level, const FastOptions& options, int max_corners);
+  virtual std::future<FastResult> detectFastAsync(const ImagePyramid& pyr, int level, const FastOptions& options, int max_corners);
+  virtual std::future<void> describeAsync(const ImagePyramid& pyr, const std::vector<cv::KeyPoint>& keypoints,
+                                          uint8_t* descriptors);
+  virtual std::shared_ptr<AlignmentReference> createAlignmentReference(
+      const std::vector<Eigen::Vector3f>& xyz_ref,
+      const std::vector<Eigen::Vector2f>& px_ref,
+      const Eigen::Vector3f& ref_pose,
+      const ImagePyramid& ref_pyr);
+  virtual void setAlignmentProblem(const std::vector<std::shared_ptr<const AlignmentReference>>& refs,
+                                   const Eigen::Vector3f& cur_pose);
+  virtual void setAlignmentLevel(const ImagePyramid& cur_pyr, int level);
+  virtual void computeResiduals(float scale, float& error, float& chi2);
+  virtual void linearSystem(Eigen::Matrix3f& H, Eigen::Vector3f& b);
+  virtual Eigen::Vector3f alignmentPose();
+  virtual void setAlignmentPose(const Eigen::Vector3f& pose);
+  virtual void releaseAlignment();
+
+private:
+  struct Reference;
+  struct Buffers;
+
+  Type type_;
+  std::shared_ptr<opencl> cl_;                    //!< shared with the pyramids, which can outlive the backend.
+  std::unique_ptr<Buffers> buf_;                  //!< kernels, pooled device memory and host staging.
+};
+
+/// C++ port of the kernels, parallelized with cv::parallel_for_.
+class NativeBackend : public ComputeBackend
+{
+public:
+  explicit NativeBackend(vk::AbstractCamera* cam);
+  virtual ~NativeBackend() {}
+
+  virtual Type type() const { return NATIVE; }
+  virtual std::string name() const { return "native"; }
+  virtual std::shared_ptr<ImagePyramid> createPyramid(const cv::Mat& img_level_0, int n_levels);
+  virtual std::future<FastResult> detectFastAsync(const cv::Mat& img, int level, const FastOptions& options, int max_corners);
+  virtual std::future<FastResult> detectFastAsync(const ImagePyramid& pyr, int level, const FastOptions& options, int max_corners);
+  virtual std::future<void> describeAsync(const ImagePyramid& pyr, const std::vector<cv::KeyPoint>& keypoints,
+                                          uint8_t* descriptors);
+  virtual std::shared_ptr<AlignmentReference> createAlignmentReference(
+      const std::vector<Eigen::Vector3f>& xyz_ref,
+      const std::vector<Eigen::Vector2f>& px_ref,
+      const Eigen::Vector3f& ref_pose,
+      const ImagePyramid& ref_pyr);
+  virtual void setAlignmentProblem(const std::vector<std::shared_ptr<const AlignmentReference>>& refs,
+                                   const Eigen::Vector3f& cur_pose);
+  virtual void setAlignmentLevel(const ImagePyramid& cur_pyr, int level);
+  virtual void computeResiduals(float scale, float& error, float& chi2);
+  virtual void linearSystem(Eigen::Matrix3f& H, Eigen::Vector3f& b);
+  virtual Eigen::Vector3f alignmentPose() { return cur_pose_; }
+  virtual void setAlignmentPose(const Eigen::Vector3f& pose) { cur_pose_ = pose; }
+  virtual void releaseAlignment();
+
+  static const int kPatchSize = 8;              //!< PATCH_SIZE of the OpenCL build.
+  static const int kPatchHalfsize = 4;
+
+private:
+  struct Reference;
+
+  FastResult detectFast(const cv::Mat& img, int level, const FastOptions& options, int max_corners) const;
+  void residual(size_t f);
+
+  FreakExtractor freak_;
+  double fx_, fy_, cx_, cy_, s_;
+  std::vector<std::shared_ptr<const Reference>> refs_;
+  std::vector<Eigen::Vector3f> xyz_ref_;        //!< points of all references.
+  std::vector<int> ref_index_;                  //!< reference of each point.
+  std::vector<Eigen::Vector3f> ref_poses_;
+  Eigen::Vector3f cur_pose_;
+  cv::Mat cur_img_;
+  int level_;
+  float scale_;
+  std::vector<Eigen::Vector3f> ref_patch_;      //!< intensity, dx and dy of the reference patches of the level.
+  std::vector<char> ref_visible_;
+  std::vector<float> errors_, chi2_, H_, J_;
+  Eigen::Matrix3f H_sum_;
+  Eigen::Vector3f b_sum_;
+};
+
+} // namespace vio
+
+#endif //VIO_COMPUTE_BACKEND_H
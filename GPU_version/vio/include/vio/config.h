@@ -34,6 +34,32 @@ public:
   static Config& getInstance();
 
 
+  /// Device of the FAST detection and the image alignment: "gpu", "cpu" (OpenCL CPU device) or "native".
+  static string& computeBackend() { return getInstance().compute_backend; }
+
+  /// Folder of the compiled OpenCL programs, empty: compile the kernels on every start.
+  static string& kernelCacheDir() { return getInstance().kernel_cache_dir; }
+
+  /// FAST threshold of the first frame, the detection adapts it toward fastTargetCorners().
+  static int& fastThreshold() { return getInstance().fast_threshold; }
+
+  /// Corners the detection aims to select on level 0, a quarter of that on each coarser level.
+  static size_t& fastTargetCorners() { return getInstance().fast_target_corners; }
+
+  /// Match window of a map point: matchWindowSigma() standard deviations of its projection
+  /// under the pose covariance, plus matchWindowMin() [px], at most matchWindowMax() [px].
+  static double& matchWindowSigma() { return getInstance().match_window_sigma; }
+
+  static double& matchWindowMin() { return getInstance().match_window_min; }
+
+  static double& matchWindowMax() { return getInstance().match_window_max; }
+
+  /// Side of a cell of the keyframe index on the ground plane [m].
+  static double& kfGridCellSize() { return getInstance().kf_grid_cell_size; }
+
+  /// Keyframes further from the frame [m] are not tested for an overlapping field of view.
+  static double& closeKfsRadius() { return getInstance().close_kfs_radius; }
+
   /// Number of pyramid levels used for features.
   static size_t& nPyrLevels() { return getInstance().n_pyr_levels; }
 
@@ -54,6 +80,10 @@ public:
   /// Minimum level of the Lucas Kanade tracker.
   static size_t& kltMinLevel() { return getInstance().klt_min_level; }
 
+  /// Align the frame against all overlapping keyframes in one problem after the matching, instead
+  /// of one alignment per keyframe while matching.
+  static bool& jointImgAlign() { return getInstance().joint_img_align; }
+
 
   /// Reprojection threshold after pose optimization.
   static double& poseOptimThresh() { return getInstance().poseoptim_thresh; }
@@ -100,6 +130,15 @@ private:
   void operator=(Config const&);
   string trace_name;
   string trace_dir;
+  string compute_backend;
+  string kernel_cache_dir;
+  int fast_threshold;
+  size_t fast_target_corners;
+  double match_window_sigma;
+  double match_window_min;
+  double match_window_max;
+  double kf_grid_cell_size;
+  double close_kfs_radius;
   size_t n_pyr_levels;
   bool use_imu;
   size_t core_n_kfs;
@@ -110,6 +149,7 @@ private:
   size_t init_min_inliers;
   size_t klt_max_level;
   size_t klt_min_level;
+  bool joint_img_align;
   double reproj_thresh;
   double poseoptim_thresh;
   size_t poseoptim_num_iter;
@@ -0,0 +1,38 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_FAST_ATAN_H
+#define VIO_FAST_ATAN_H
+
+// Shared by the CPU and the OpenCL kernels, cl_class adds this file to the program sources
+// ahead of the kernels. Keep it to the common subset of C++ and OpenCL C.
+
+#ifndef __OPENCL_VERSION__
+#include <math.h>
+namespace vk {
+#endif
+
+/// atan(x) by a degree 11 odd polynomial on [-1,1] and atan(x) = pi/2 - atan(1/x) outside.
+/// Evaluated in float the absolute error is below 2e-6 rad for all x.
+#ifdef __OPENCL_VERSION__
+float fast_atan(float x)
+#else
+inline float fast_atan(float x)
+#endif
+{
+    const float a = fabs(x);
+    const float t = a > 1.0f ? 1.0f / a : a;
+    const float t2 = t * t;
+    float p = t * (0.99997726f + t2 * (-0.33262347f + t2 * (0.19354346f +
+                   t2 * (-0.11643287f + t2 * (0.05265332f + t2 * -0.01172120f)))));
+    if(a > 1.0f)
+        p = 1.57079632679f - p;
+    return x < 0.0f ? -p : p;
+}
+
+#ifndef __OPENCL_VERSION__
+} // namespace vk
+#endif
+
+#endif //VIO_FAST_ATAN_H
@@ -32,45 +32,45 @@ struct Feature
   };
 
   FeatureType type;     //!< Type can be corner or edgelet.
-  std::shared_ptr<Frame> frame;         //!< Pointer to frame in which the feature was detected.
+  Frame* frame;         //!< Frame in which the feature was detected, which owns the feature.
   Vector2d px;          //!< Coordinates in pixels on pyramid level 0.
   Vector3d f;           //!< Unit-bearing vector of the feature.
   int level;            //!< Image pyramid level where feature was extracted.
-  std::shared_ptr<Point> point;         //!< Pointer to 3D point which corresponds to the feature.
+  PointHandle point;    //!< 3D point which corresponds to the feature, NULL once the map destroyed it.
   Vector2d grad;        //!< Dominant gradient direction for edglets, normalized.
   float score=0.0;
   uint8_t descriptor[64]={0}; //!< descriptor of the feature in the frame in which the feature was detected.
 
-  Feature(std::shared_ptr<Frame> _frame, const Vector2d& _px, int _level) :
+  Feature(const std::shared_ptr<Frame>& _frame, const Vector2d& _px, int _level) :
     type(CORNER),
-    frame(_frame),
+    frame(_frame.get()),
     px(_px),
     f(frame->cam_->cam2world(px)),
     level(_level),
     grad(1.0,0.0)
   {}
 
-  Feature(std::shared_ptr<Frame> _frame, const Vector2d& _px, const Vector3d& _f, int _level) :
+  Feature(const std::shared_ptr<Frame>& _frame, const Vector2d& _px, const Vector3d& _f, int _level) :
     type(CORNER),
-    frame(_frame),
+    frame(_frame.get()),
     px(_px),
     f(_f),
     level(_level),
     grad(1.0,0.0)
   {}
 
-  Feature(std::shared_ptr<Frame> _frame, std::shared_ptr<Point> _point, const Vector2d& _px, const Vector3d& _f, int _level) :
+  Feature(const std::shared_ptr<Frame>& _frame, PointHandle _point, const Vector2d& _px, const Vector3d& _f, int _level) :
     type(CORNER),
-    frame(_frame),
+    frame(_frame.get()),
     px(_px),
     f(_f),
     level(_level),
     point(_point),
     grad(1.0,0.0)
   {}
-  Feature(std::shared_ptr<Frame> _frame, std::shared_ptr<Point> _point, const Vector2d& _px, const Vector3d& _f, const float _score ,int _level,uint8_t* _descriptor) :
+  Feature(const std::shared_ptr<Frame>& _frame, PointHandle _point, const Vector2d& _px, const Vector3d& _f, const float _score ,int _level,const uint8_t* _descriptor) :
     type(CORNER),
-    frame(_frame),
+    frame(_frame.get()),
     px(_px),
     f(_f),
     level(_level),
@@ -80,9 +80,9 @@ struct Feature
   {
       memcpy(descriptor,_descriptor, sizeof(uint8_t)*64);
   }
-  Feature(std::shared_ptr<Frame> _frame, std::shared_ptr<Point> _point, const Vector2d& _px, const float _score ,int _level,uint8_t* _descriptor) :
+  Feature(const std::shared_ptr<Frame>& _frame, PointHandle _point, const Vector2d& _px, const float _score ,int _level,const uint8_t* _descriptor) :
             type(CORNER),
-            frame(_frame),
+            frame(_frame.get()),
             px(_px),
             f(frame->cam_->cam2world(px)),
             level(_level),
@@ -92,9 +92,9 @@ struct Feature
   {
         memcpy(descriptor,_descriptor, sizeof(uint8_t)*64);
   }
-  Feature(std::shared_ptr<Frame> _frame, const Vector2d& _px, const float _score ,int _level,uint8_t* _descriptor) :
+  Feature(const std::shared_ptr<Frame>& _frame, const Vector2d& _px, const float _score ,int _level,const uint8_t* _descriptor) :
     type(CORNER),
-    frame(_frame),
+    frame(_frame.get()),
     px(_px),
     f(frame->cam_->cam2world(px)),
     level(_level),
@@ -19,8 +19,7 @@
 
 #include <vio/global.h>
 #include <vio/frame.h>
-#include <vio/cl_class.h>
-#include <opencv2/xfeatures2d.hpp>
+#include <vio/compute_backend.h>
 #include <opencv2/features2d.hpp>
 #include <opencv2/core.hpp>
 
@@ -58,7 +57,7 @@ public:
 
   virtual void detect(
           std::shared_ptr<Frame> frame,
-      const ImgPyr& img_pyr,
+      const ImagePyramid& img_pyr,
       const double detection_threshold,
       Features& fts) = 0;
 
@@ -86,25 +85,57 @@ protected:
 };
 typedef boost::shared_ptr<AbstractDetector> DetectorPtr;
 
+/// FAST threshold of every pyramid level, steered from frame to frame toward a target number of
+/// selected corners so that the detection cost does not follow the texture of the scene.
+class FastThreshold
+{
+public:
+  /// target_corners is the target of level 0, the coarser levels aim at a quarter of the level below.
+  FastThreshold(int n_levels, int initial_threshold, int target_corners);
+
+  int threshold(int level) const { return static_cast<int>(threshold_.at(level) + 0.5); }
+
+  /// Feed back the number of corners the last detection selected with threshold(level).
+  void update(int level, int count);
+
+  static const int kMinThreshold = 8;
+  static const int kMaxThreshold = 120;
+
+private:
+  vector<double> threshold_;
+  vector<double> target_;
+};
+
 /// FAST detector by Majid Geravand.
 class FastDetector : public AbstractDetector
 {
 public:
+  /// Without a controller the threshold is Config::fastThreshold() on every level.
   FastDetector(
       const int img_width,
       const int img_height,
       const int cell_size,
-      opencl* gpu_fast_,
-      const int n_pyr_levels);
+      ComputeBackend* backend,
+      const int n_pyr_levels,
+      FastThreshold* threshold = NULL);
 
   virtual ~FastDetector() {}
 
   virtual void detect(
       std::shared_ptr<Frame> frame,
-      const ImgPyr& img_pyr,
+      const ImagePyramid& img_pyr,
       const double detection_threshold,
       list<shared_ptr<Feature>>& fts);
-  opencl* gpu_fast_;
+
+  /// Detect into the rows of table, cleared first. The backend writes the descriptors into the
+  /// descriptor block of the table, no feature objects are made.
+  void detect(
+      std::shared_ptr<Frame> frame,
+      const ImagePyramid& img_pyr,
+      const double detection_threshold,
+      FeatureTable& table);
+  ComputeBackend* backend_;
+  FastThreshold* threshold_;      //!< threshold controller which outlives the detector, can be NULL.
 };
 
 } // namespace feature_detection
@@ -0,0 +1,77 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_FEATURE_TABLE_H
+#define VIO_FEATURE_TABLE_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+namespace vio {
+
+struct Feature;
+
+/// Features of a frame in columns, one row per feature: pixel and bearing, pyramid level, score,
+/// id of the 3D point and the descriptors back to back in one 64 byte aligned block. Rows are
+/// only appended, a row index stays valid until clear(). The matching scans these arrays and the
+/// backends write the descriptors straight into the block.
+class FeatureTable
+{
+public:
+  static const int kDescriptorSize = 64;        //!< bytes of a descriptor.
+
+  /// Row of the block, the alignment keeps every descriptor on its own cache line.
+  struct alignas(64) Descriptor
+  {
+    uint8_t data[kDescriptorSize];
+  };
+
+  void clear();
+  void reserve(size_t n);
+
+  /// Append a row without a feature object, descriptor NULL leaves it zero. Returns the index.
+  int add(const Eigen::Vector2d& px, const Eigen::Vector3d& f, int level, float score,
+          const uint8_t* descriptor = NULL);
+
+  /// Append the row of ftr, which the table keeps for feature().
+  int add(const std::shared_ptr<Feature>& ftr);
+
+  /// Refresh the point ids from the features of the rows, their points change after the build.
+  void updatePoints();
+
+  inline size_t size() const { return px_.size(); }
+  inline bool empty() const { return px_.empty(); }
+
+  inline const Eigen::Vector2d& px(size_t i) const { return px_[i]; }
+  inline const Eigen::Vector3d& f(size_t i) const { return f_[i]; }
+  inline int level(size_t i) const { return level_[i]; }
+  inline float score(size_t i) const { return score_[i]; }
+  inline int pointId(size_t i) const { return point_id_[i]; }     //!< -1 without a point.
+  inline const uint8_t* descriptor(size_t i) const { return descriptors_[i].data; }
+  inline const std::shared_ptr<Feature>& feature(size_t i) const { return features_[i]; }  //!< NULL for rows added without one.
+
+  /// Columns, size() entries each.
+  inline const std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& px() const { return px_; }
+  inline const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& f() const { return f_; }
+
+  /// size()*kDescriptorSize bytes.
+  inline const uint8_t* descriptors() const { return descriptors_.empty() ? NULL : descriptors_[0].data; }
+  inline uint8_t* descriptors() { return descriptors_.empty() ? NULL : descriptors_[0].data; }
+
+private:
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > px_;    //!< pixel on level 0.
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > f_;     //!< unit bearing vector.
+  std::vector<int> level_;
+  std::vector<float> score_;
+  std::vector<int> point_id_;
+  std::vector<Descriptor> descriptors_;
+  std::vector<std::shared_ptr<Feature> > features_;
+};
+
+} // namespace vio
+
+#endif //VIO_FEATURE_TABLE_H
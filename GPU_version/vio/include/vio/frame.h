@@ -17,11 +17,15 @@
 #ifndef VIO_FRAME_H_
 #define VIO_FRAME_H_
 
+#include <atomic>
 #include <sophus/se3.h>
 #include <vio/math_utils.h>
 #include <vio/abstract_camera.h>
 #include <boost/noncopyable.hpp>
 #include <vio/global.h>
+#include <vio/image_pyramid.h>
+#include <vio/feature_table.h>
+#include <vio/point_batch.h>
 #include <g2o/types/sba/types_six_dof_expmap.h>
 
 
@@ -31,9 +35,10 @@ namespace vio {
     class Point;
     class Map;
     struct Feature;
+    class ComputeBackend;
+    class AlignmentReference;
 
     typedef list<std::shared_ptr<Feature>> Features;
-    typedef vector<cv::Mat> ImgPyr;
 
 
 /// A frame saves the image, the associated features and the estimated pose.
@@ -48,32 +53,56 @@ namespace vio {
         vk::AbstractCamera*           cam_;                   //!< Camera model.
         SE2_5                         T_f_w_;                 //!< Transform (f)rame from (w)orld.
         Matrix<double, 3, 3>          Cov_;                   //!< Covariance.
-        ImgPyr                        img_pyr_;               //!< Image Pyramid.
-        Features                      fts_;                   //!< List of features in the image.
+        ComputeBackend*               backend_;               //!< Backend which made the pyramid, NULL for a host pyramid.
+        std::shared_ptr<ImagePyramid> img_pyr_;               //!< Image Pyramid, kept on the device of the compute backend.
+        Features                      fts_;                   //!< List of features in the image, changed through addFeature and eraseFeature.
+        FeatureTable                  ftr_table_;             //!< Columns of fts_ for the matching, see featureTable().
+        bool                          ftr_table_dirty_=true;  //!< fts_ changed since ftr_table_ was built.
         vector<std::shared_ptr<Feature>>  key_pts_;               //!< Five features and associated 3D points which are used to detect if two frames have overlapping field of view.
         bool                          is_keyframe_;           //!< Was this frames selected as keyframe?
         std::shared_ptr<g2o::VertexSE3Expmap>         v_kf_=NULL;                  //!< Temporary pointer to the g2o node object of the keyframe.
         int                           last_published_ts_;     //!< Timestamp of last publishing.
 
-        Frame(vk::AbstractCamera* cam, const cv::Mat& img, double timestamp);
+        /// Without a backend the pyramid is built on the host.
+        Frame(vk::AbstractCamera* cam, const cv::Mat& img, double timestamp, ComputeBackend* backend = NULL);
         ~Frame();
 
         /// Initialize new frame and create image pyramid.
-        void initFrame(const cv::Mat& img);
+        void initFrame(const cv::Mat& img, ComputeBackend* backend);
 
-        /// Select this frame as keyframe.
+        /// Select this frame as keyframe, the alignment reference is made here.
         void setKeyframe();
 
+        /// Points and reference patches for the sparse image alignment against this frame. A keyframe
+        /// keeps it until invalidateAlignmentReference(), other frames make a new one on every call.
+        std::shared_ptr<AlignmentReference> alignmentReference();
+
+        /// Drop the cached alignment reference, after features of the frame gained or lost a point.
+        void invalidateAlignmentReference();
+
+        /// The pose or points of the frame moved: the cached reference uploads them again on its
+        /// next use and keeps its patches.
+        inline void alignmentPointsMoved() { align_points_moved_ = true; }
+
         /// Add a feature to the image
         void addFeature(std::shared_ptr<Feature> ftr);
 
+        /// Erase a feature of the image, returns the next one.
+        Features::iterator eraseFeature(Features::iterator it);
+
+        /// Features of the frame in columns, row i stays the same feature for the life of the
+        /// frame. Built on the first call after the tracking of the frame, which is the only
+        /// time features are erased, and made again after addFeature or eraseFeature; the point
+        /// ids are refreshed on every call.
+        const FeatureTable& featureTable();
+
         /// The KeyPoints are those five features which are closest to the 4 image corners
         /// and to the center and which have a 3D point assigned. These points are used
         /// to quickly check whether two frames have overlapping field of view.
         void setKeyPoints();
 
         /// Check if we can select five better key-points.
-        void checkKeyPoints(std::shared_ptr<Feature> ftr);
+        void checkKeyPoints(const std::shared_ptr<Feature>& ftr);
 
         /// If a point is deleted, we must remove the corresponding key-point.
         void removeKeyPoint(std::shared_ptr<Feature> ftr);
@@ -84,15 +113,16 @@ namespace vio {
         /// Check if a point in (w)orld coordinate frame is visible in the image.
         bool isVisible(const Vector3d& xyz_w) const;
 
-        /// Full resolution image stored in the frame.
-        inline const cv::Mat& img() const { return img_pyr_[0]; }
+        /// Image of the pyramid level stored in the frame, full resolution by default. Levels
+        /// made on the device are downloaded on the first call.
+        inline const cv::Mat& img(int level = 0) const { return img_pyr_->level(level); }
 
         /// Was this frame selected as keyframe?
         inline bool isKeyframe() const { return is_keyframe_; }
 
         /// Transforms point coordinates in world-frame (w) to camera pixel coordinates (c).
         inline Vector2d w2c(const Vector3d& xyz_w) const {
-            return cam_->world2cam( T_f_w_.se3().inverse()*xyz_w);
+            return cam_->world2cam( T_f_w_.inverse()*xyz_w);
         }
         /// Transforms point coordinates in world-frame (w) to camera pixel coordinates (c).
         inline Vector2d w2px(const Vector3d& xyz_w) const { return cam_->world2cam( w2f(xyz_w) ); }
@@ -105,21 +135,28 @@ namespace vio {
 
         /// Transforms point coordinates in world-frame (w) to camera-frams (f).
         inline Vector3d w2f(const Vector3d& xyz_w) const {
-            return Vector3d(T_f_w_.se3().inverse()*xyz_w);
+            return Vector3d(T_f_w_.inverse()*xyz_w);
         }
 
 
         /// Projects Point from unit sphere (f) in camera pixels (c).
         inline Vector2d f2c(const Vector3d& f) const { return cam_->world2cam( f ); }
 
+        /// Transforms the world points of batch to the camera frame (x_f, y_f, z_f), one pose
+        /// fetch for the batch.
+        void w2f(PointBatch& batch) const;
+
+        /// w2f and the camera pixels (u, v) of the batch in one camera call. visible is 1 for the
+        /// points in front of the camera with a pixel in the image, as isVisible().
+        void w2c(PointBatch& batch) const;
+
         /// Return the pose of the frame in the (w)orld coordinate frame.
         inline Vector2d pos() const {
             assert(!T_f_w_.empty());
-            SE2 tem=T_f_w_.se2();
-            return tem.translation();
+            return Vector2d(T_f_w_.x(), T_f_w_.z());
         }
 
-        inline SE3 se3() const{
+        inline const SE3& se3() const{
             return T_f_w_.se3();
         }
 
@@ -155,8 +192,8 @@ namespace vio {
             double x_n = pos.x();
             double y_n = pos.y();
             double z_n = pos.z();
-            double x_c = T_f_w_.se2().translation().x();
-            double z_c = T_f_w_.se2().translation().y();
+            double x_c = T_f_w_.x();
+            double z_c = T_f_w_.z();
             double theta = T_f_w_.pitch();
 
             double alpha = (fx*(theta/r))-(fx*((x_n*x_n)/(r*r))*theta)+((1+3*s*theta*theta)/((r*r)+1))*((fx*x_n*x_n)/(r*r));
@@ -185,11 +222,19 @@ namespace vio {
 //            J(1,1) = 0;
 //            J(1,2) = ((sin(theta)/z_n)*gamma)-((cos(theta)/z_n)*lamda)-(((x_n/(z_n*z_n))*gamma + (y_n/(z_n*z_n))*lamda)*n2);
         }
-        /// Creates an image pyramid of half-sampled images.
-        void createImgPyramid(const cv::Mat& img_level_0, int n_levels, ImgPyr& pyr);
-
         /// Get the average depth of the features in the image.
         bool getSceneDepth(vio::Map& map,double& depth_mean, double& depth_min);
+
+    private:
+        /// Alignment reference of the current pose and points, fts gets the features of its points.
+        std::shared_ptr<AlignmentReference> createAlignmentReference(vector<std::shared_ptr<Feature>>& fts) const;
+
+        /// Points of fts in the frame, false if one of them has no valid point any more.
+        bool alignmentPoints(const vector<std::shared_ptr<Feature>>& fts, std::vector<Eigen::Vector3f>& xyz) const;
+
+        std::shared_ptr<AlignmentReference> align_ref_;       //!< Cached reference of a keyframe, after img_pyr_ which it reads.
+        vector<std::shared_ptr<Feature>> align_fts_;          //!< Features of align_ref_ in its order.
+        std::atomic<bool> align_points_moved_{false};         //!< align_ref_ has to upload the points and the pose again.
     };
 
 
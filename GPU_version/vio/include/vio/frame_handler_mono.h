@@ -23,7 +23,7 @@
 #include <vio/reprojector.h>
 #include <vio/initialization.h>
 #include <vio/ukf.h>
-#include <vio/cl_class.h>
+#include <vio/compute_backend.h>
 #include <vio/global_optimizer.h>
 
 namespace vio {
@@ -39,6 +39,9 @@ public:
   /// Provide an image.
   void addImage(const cv::Mat& img, double timestamp,const ros::Time& time);
 
+  /// Offline entry point, the timestamp [s] is used as the frame stamp (dataset replay).
+  void addImage(const cv::Mat& img, double timestamp);
+
 
   /// Access the depth filter.
   BA_Glob* depthFilter() const{ return ba_glob_; }
@@ -46,9 +49,11 @@ public:
 
   void UpdateIMU(double* value,const ros::Time& time);
   void UpdateCmd(double* value,const ros::Time& time);
+  void UpdateIMU(double* value,double timestamp);
+  void UpdateCmd(double* value,double timestamp);
   UKF ukfPtr_;
 #if VIO_DEBUG
-        FILE* log_=nullptr;
+        AsyncLogger* log_=nullptr;
 #endif
 protected:
   vk::AbstractCamera* cam_;                     //!< Camera model, can be ATAN, Pinhole or Ocam (see vikit).
@@ -58,7 +63,7 @@ protected:
   vector< pair<FramePtr,size_t> > overlap_kfs_; //!< All keyframes with overlapping field of view. the paired number specifies how many common mappoints are observed TODO: why vector!?
   initialization::KltHomographyInit* klt_homography_init_; //!< Used to estimate pose of the first two keyframes by estimating a homography.
   BA_Glob* ba_glob_;                   //!< Depth estimation algorithm runs in a parallel thread and is used to initialize new 3D points.
-  opencl* gpu_fast_;
+  ComputeBackend* backend_;                     //!< Runs the FAST detection and the image alignment residuals.
   ros::Time time_;
 
 
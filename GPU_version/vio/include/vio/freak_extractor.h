@@ -0,0 +1,57 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_FREAK_EXTRACTOR_H
+#define VIO_FREAK_EXTRACTOR_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <vio/freak_pattern.h>
+
+namespace vio {
+
+/// FREAK extractor of the host, made once with the tables of a FreakPattern. The integral image
+/// buffer is kept between frames and the pair comparisons are packed 16 or 32 at a time with
+/// AVX2, SSE2 or NEON. The descriptors are bit identical to cv::xfeatures2d::FREAK with the same
+/// pattern. The compute with the buffer of the extractor runs one call at a time, the one with an
+/// integral buffer of the caller may overlap with others.
+class FreakExtractor
+{
+public:
+  explicit FreakExtractor(const FreakPattern& pattern = FreakPattern::instance());
+
+  /// FreakPattern::kDescriptorSize bytes per keypoint in descriptors. Every keypoint has to fit
+  /// the pattern at its size (FreakPattern::fits), FREAK drops the others.
+  void compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, uint8_t* descriptors);
+
+  /// Same as compute with integral as the buffer of the integral image instead of the one of the
+  /// extractor.
+  void compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, uint8_t* descriptors,
+               cv::Mat& integral) const;
+
+private:
+  /// FREAK::meanIntensity, box filter of the point from the integral image.
+  uint8_t meanIntensity(const cv::Mat& img, const cv::Mat& integral, float kp_x, float kp_y, int scale,
+                        int orientation, int point) const;
+
+  /// Orientation of the pattern from the point means of the unrotated pattern.
+  int orientation(const uint8_t* values) const;
+
+  /// Pack the comparisons of the description pairs, values has kValuesSize bytes.
+  void describe(const uint8_t* values, uint8_t* descriptor) const;
+
+  static const int kValuesSize = 48;              //!< point means padded to three 16 byte vectors.
+
+  const FreakPattern& pattern_;
+  cv::Mat integral_;                              //!< CV_32S, reallocated when the image size changes.
+  /// Points of the description pairs in the order of the descriptor bytes: the 16 bytes of
+  /// pair_i_[16*r] .. pair_i_[16*r+15] give bit r%8 of descriptor bytes 16*(r/8) .. 16*(r/8)+15.
+  uint8_t pair_i_[FreakPattern::kNbPairs];
+  uint8_t pair_j_[FreakPattern::kNbPairs];
+};
+
+} // namespace vio
+
+#endif //VIO_FREAK_EXTRACTOR_H
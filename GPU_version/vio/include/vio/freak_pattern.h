@@ -0,0 +1,84 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_FREAK_PATTERN_H
+#define VIO_FREAK_PATTERN_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace vio {
+
+/// Sampling pattern and pairs of cv::xfeatures2d::FREAK with the default selected pairs, built
+/// the way FREAK builds them so that a descriptor computed from these tables is the one of OpenCV.
+/// The extractors of the compute backends share the tables of instance().
+class FreakPattern
+{
+public:
+  static const int kNbScales = 64;
+  static const int kNbOrientation = 256;
+  static const int kNbPoints = 43;
+  static const int kNbPairs = 512;
+  static const int kNbOrienPairs = 45;
+  static const int kSmallestKpSize = 7;
+  static const int kDescriptorSize = kNbPairs/8;  //!< bytes of a descriptor.
+
+  struct OrientationPair
+  {
+    int i, j;
+    int weight_dx, weight_dy;                     //!< dx/(dx*dx+dy*dy) of the pair, 12 bit fixed point.
+  };
+
+  struct DescriptionPair
+  {
+    uint8_t i, j;                                 //!< bit set if the mean of point i >= the mean of point j.
+  };
+
+  /// Pattern of FREAK::create(true, true, 22.0f, 4), the extractor of FastDetector.
+  static const FreakPattern& instance();
+
+  FreakPattern(float pattern_scale, int n_octaves);
+
+  /// Pattern scale of a keypoint of size size.
+  int scaleIndex(float size) const;
+
+  /// False if the pattern at the scale leaves the image, FREAK drops those keypoints.
+  bool fits(const cv::Point2f& px, int scale, int cols, int rows) const
+  {
+    const float border = static_cast<float>(sizes_[scale]);
+    return px.x > border && px.y > border && px.x < cols-border && px.y < rows-border;
+  }
+
+  /// Offset of a point from the keypoint, [scale][orientation][point].
+  const std::vector<cv::Point2f>& points() const { return points_; }
+  const cv::Point2f& point(int scale, int orientation, int i) const
+  {
+    return points_[(scale*kNbOrientation+orientation)*kNbPoints+i];
+  }
+
+  /// Radius of the box filter of a point, the same for all orientations, [scale][point].
+  const std::vector<float>& sigmas() const { return sigmas_; }
+  float sigma(int scale, int i) const { return sigmas_[scale*kNbPoints+i]; }
+
+  const OrientationPair* orientationPairs() const { return orientation_pairs_; }
+  const DescriptionPair* descriptionPairs() const { return description_pairs_; }
+
+  /// Byte and bit of the comparison of description pair k in the descriptor. The 128 bit blocks
+  /// of the SSE2 path of OpenCV are stored in 16 comparison rows of 8 bits each.
+  static int descriptorByte(int k) { return (k>>7)*16+15-(k&15); }
+  static int descriptorBit(int k) { return (k>>4)&7; }
+
+private:
+  std::vector<cv::Point2f> points_;
+  std::vector<float> sigmas_;
+  int sizes_[kNbScales];                          //!< border of the pattern at each scale.
+  float size_cst_;
+  OrientationPair orientation_pairs_[kNbOrienPairs];
+  DescriptionPair description_pairs_[kNbPairs];
+};
+
+} // namespace vio
+
+#endif //VIO_FREAK_PATTERN_H
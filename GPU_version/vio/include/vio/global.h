@@ -38,7 +38,26 @@ EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Eigen::Vector2d)
 #include <ros/console.h>
 #include <boost/thread.hpp>
 #include <boost/function.hpp>
-
+#include <vio/async_logger.h>
+#include <vio/slab.h>
+
+#ifdef VIO_TRACE
+#include <vio/performance_monitor.h>
+#define VIO_CONCAT_(a, b) a##b
+#define VIO_CONCAT(a, b) VIO_CONCAT_(a, b)
+/// Time the rest of the enclosing scope as one span of the stage.
+#define VIO_SPAN(name) \
+    static const int VIO_CONCAT(vio_span_id_, __LINE__) = vk::PerformanceMonitor::stageId(name); \
+    vk::ScopedSpan VIO_CONCAT(vio_span_, __LINE__)(vio::g_permon, VIO_CONCAT(vio_span_id_, __LINE__))
+/// Add a duration [s] measured outside of a span. As in VIO_SPAN the stage id of a call site is
+/// looked up once, name has to be the same on every call.
+#define VIO_LOG(name, value) do{ \
+    static const int vio_log_id = vk::PerformanceMonitor::stageId(name); \
+    if(vio::g_permon) vio::g_permon->log(vio_log_id,(value)); }while(0)
+#else
+#define VIO_SPAN(name)
+#define VIO_LOG(name, value)
+#endif
 
 namespace vio
 {
@@ -49,6 +68,10 @@ namespace vio
     const double EPS = 0.0000000001;
     const double PI = 3.14159265;
 
+#ifdef VIO_TRACE
+    extern vk::PerformanceMonitor* g_permon;
+#endif
+
     static std::string time_in_HH_MM_SS_MMM()
     {
         using namespace std::chrono;
@@ -73,74 +96,84 @@ namespace vio
 
         return oss.str();
     };
-    class SE2_5: public SE2{
+    /// Planar pose of the camera: x, z and the pitch (rotation around y), the roll is the fixed
+    /// mounting angle kRoll. A value without heap memory; the SE3, its inverse and the rotation
+    /// matrix are made when the pose is written, reads do not touch the trigonometry. It has no
+    /// lock, a write races with any read in another thread; the keyframe poses are written by
+    /// the tracking thread only, see BA_Glob::applyResults().
+    class SE2_5{
     public:
-        SE2_5(SE2&& se2){
-            T2_=new SE2(se2);
-            assert(T2_!= nullptr);
-        }
-        SE2_5(SE2& se2){
-            T2_=new SE2(se2);
-            assert(T2_!= nullptr);
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        static constexpr double kRoll = 0.122173;     //!< camera roll [rad].
+
+        /// Empty pose, see empty().
+        SE2_5(){
+            set(0.0, 0.0, 0.0);
+            empty_ = true;
         }
-        SE2_5(SE3&& se3){
-            Quaterniond q=se3.unit_quaternion().normalized();
-            auto euler = q.toRotationMatrix().eulerAngles(0, 1, 2);//roll,pitch,yaw
-            T2_ = new SE2(SO2(euler(1)),Vector2d(se3.translation().x(),se3.translation().z()));
-            assert(T2_!= nullptr);
+        SE2_5(const SE2& se2){
+            set(se2.translation().x(), se2.translation().y(),
+                atan2(se2.so2().unit_complex().imag(), se2.so2().unit_complex().real()));
         }
-        SE2_5(SE3& se3){
-            Quaterniond q=se3.unit_quaternion().normalized();
+        /// Planar part of a full pose, the pitch of R = Rx(roll)*Ry(pitch) is atan2(R02, R00).
+        SE2_5(const SE3& se3){
             //Camera frame z front, x right, y down -> right hands
-            auto euler = q.toRotationMatrix().eulerAngles(0, 1, 2);//roll,pitch,yaw
-            T2_=new SE2(SO2(euler(1)),Vector2d(se3.translation().x(),se3.translation().z()));
-            assert(T2_!= nullptr);
-        }
-        SE2_5(double y,double z,double pitch){
-            T2_=new SE2(SO2(pitch),Vector2d(y,z));
-            assert(T2_!= nullptr);
-        };
-        SE2 se2() const{
-            assert(T2_!= nullptr);
-            return *T2_;
+            const Matrix3d R = se3.rotation_matrix();
+            set(se3.translation().x(), se3.translation().z(), atan2(R(0,2), R(0,0)));
         }
-/*        SE2 inverse() const{
-            assert(T2_!= nullptr);
-            double pitch=atan2(T2_->so2().unit_complex().imag(),T2_->so2().unit_complex().real());
-            SE2 tem=SE2(pitch+M_PI,-1.0*T2_->translation());
-            return tem;
-        }*/
-/*        SE2_5 inverse_h() const{
-            assert(T2_!= nullptr);
-            return SE2_5(T2_->inverse());
-        }*/
-        // Rotation around y
-        double pitch()const{
-            assert(T2_!= nullptr);
-            double pitch=atan2(T2_->so2().unit_complex().imag(),T2_->so2().unit_complex().real());
-            return pitch;
+        SE2_5(double x,double z,double pitch){
+            set(x, z, pitch);
         }
-        SE3 se3() const{
-            assert(T2_!= nullptr);
-            //Todo add 15 roll orientation
+
+        /// Write the pose, the pitch is wrapped to (-pi, pi].
+        void set(double x,double z,double pitch){
+            x_ = x;
+            z_ = z;
+            const double sp = sin(pitch);
+            const double cp = cos(pitch);
+            pitch_ = atan2(sp, cp);
+            empty_ = false;
             //Camera frame z front, x right, y down -> right hands
-            Quaterniond q;
-            q = AngleAxisd(0.122173, Vector3d::UnitX()) // roll
-                * AngleAxisd(pitch(), Vector3d::UnitY())// pitch
-                * AngleAxisd(0.0, Vector3d::UnitZ()); //yaw
-            SE3 tem=SE3(q.toRotationMatrix(),Vector3d(T2_->translation()(0), 0.0,T2_->translation()(1)));
-            return tem;
+            static const double sr = sin(kRoll);
+            static const double cr = cos(kRoll);
+            R_ << cp,     0.0,  sp,
+                  sr*sp,  cr,  -sr*cp,
+                 -cr*sp,  sr,   cr*cp;
+            T_ = SE3(R_, Vector3d(x_, 0.0, z_));
+            T_inv_ = T_.inverse();
         }
-        bool empty() const{
-            return T2_ == nullptr ? true : false;
+
+        double x() const{ return x_; }
+        double z() const{ return z_; }
+        // Rotation around y
+        double pitch() const{ return pitch_; }
+
+        SE2 se2() const{
+            return SE2(SO2(pitch_), Vector2d(x_, z_));
         }
+        const SE3& se3() const{ return T_; }
+        /// se3().inverse(), world to camera.
+        const SE3& inverse() const{ return T_inv_; }
+        /// se3().rotation_matrix().
+        const Matrix3d& rotationMatrix() const{ return R_; }
+
+        bool empty() const{ return empty_; }
 
     private:
-        SE2* T2_= nullptr;
+        double x_;
+        double z_;
+        double pitch_;
+        bool empty_;
+        Matrix3d R_;
+        SE3 T_;
+        SE3 T_inv_;
     };
 
     class Frame;
     typedef std::shared_ptr<Frame> FramePtr;
+    class Point;
+    typedef SlabHandle<Point> PointHandle;    //!< points are owned by the Map, see Map::newPoint().
 } // namespace vio
 
 #endif // VIO_GLOBAL_H_
@@ -60,13 +60,17 @@ public:
   /// Stop the parallel thread that is running.
   void stopThread();
 
+  /// Write the keyframe poses and point positions of the last optimization. Called by the
+  /// tracking thread, which is then the only thread writing them; if the optimizer is running
+  /// they are left for the next frame.
+  void applyResults();
+
   void new_key_frame(){
       boost::unique_lock< boost::mutex > lk( mtx_);
       new_keyframe_=true;
       cond_.notify_one();
 #if VIO_DEBUG
-      fprintf(log_,"[%s] New key frame \n",
-              vio::time_in_HH_MM_SS_MMM().c_str());
+      log_->write("New key frame \n");
 #endif
   }
  boost::mutex ba_mux_;
@@ -79,9 +83,11 @@ protected:
   size_t v_id_ = 0;
   std::unique_ptr<g2o::SparseOptimizer> optimizer_=NULL;
   std::shared_ptr<g2o::CameraParameters> cam_params_=NULL;
+  std::vector<std::pair<FramePtr,SE2_5>, aligned_allocator<std::pair<FramePtr,SE2_5> > > kf_results_; //!< optimized keyframe poses, see applyResults().
+  std::vector<std::pair<PointHandle,Vector3d> > pt_results_;   //!< optimized point positions.
 
 #if VIO_DEBUG
-  FILE* log_=nullptr;
+  AsyncLogger* log_=nullptr;
 #endif
 
 /// Create a g2o vertice from a keyframe object.
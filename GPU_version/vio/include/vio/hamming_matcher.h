@@ -0,0 +1,64 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_HAMMING_MATCHER_H
+#define VIO_HAMMING_MATCHER_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace vio {
+
+/// Brute force matcher of 512 bit descriptors (FREAK) stored back to back, one call matches a
+/// whole block of query descriptors against a block of train descriptors. The distances are
+/// popcounts with AVX-512 VPOPCNTDQ, AVX2 (nibble lookup with vpshufb), NEON (vcnt) or the
+/// builtin, and equal to those of cv::BFMatcher with the same norm.
+class HammingMatcher
+{
+public:
+  enum Norm {
+    NORM_HAMMING,     //!< differing bits, cv::NORM_HAMMING.
+    NORM_HAMMING2     //!< differing bit pairs, cv::NORM_HAMMING2.
+  };
+
+  struct Options {
+    Norm norm;
+    int k;            //!< 1: best match, 2: best match if it passes the ratio test against the second.
+    float ratio;      //!< k == 2: the best is kept if distance < ratio * second distance.
+    Options()
+    : norm(NORM_HAMMING2),
+      k(1),
+      ratio(0.8f)
+    {}
+  };
+
+  static const int kDescriptorSize = 64;        //!< bytes of a descriptor.
+
+  explicit HammingMatcher(const Options& options = Options());
+
+  /// Best match of every query among the train descriptors. masks is NULL or has one entry per
+  /// query: NULL (all train descriptors) or n_train bytes, 0 excludes the train descriptor. The
+  /// matches are in query order, a query without candidates or failing the ratio test has none.
+  /// Ties go to the first train descriptor like in BFMatcher::knnMatch.
+  void match(const uint8_t* query, int n_query, const uint8_t* train, int n_train,
+             std::vector<cv::DMatch>& matches, const uint8_t* const* masks = NULL) const;
+
+  /// Best match of every query among its candidates, the train indices candidates[offsets[q]] ..
+  /// candidates[offsets[q+1]-1] in increasing order. Same matches as a mask selecting them.
+  void match(const uint8_t* query, int n_query, const uint8_t* train, const int* offsets,
+             const int* candidates, std::vector<cv::DMatch>& matches) const;
+
+  /// Distance of two descriptors.
+  static int distance(const uint8_t* a, const uint8_t* b, Norm norm);
+
+  const Options& options() const { return options_; }
+
+private:
+  Options options_;
+};
+
+} // namespace vio
+
+#endif //VIO_HAMMING_MATCHER_H
@@ -0,0 +1,62 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_IMAGE_PYRAMID_H
+#define VIO_IMAGE_PYRAMID_H
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace vio {
+
+typedef std::vector<cv::Mat> ImgPyr;
+
+/// Pyramid of half-sampled images of a frame. Level 0 is the image of the frame, the other levels
+/// are made on first use: on the host with vk::halfSample, or by a compute backend which keeps
+/// them on its device and only downloads the levels CPU code asks for. Thread safe.
+class ImagePyramid
+{
+public:
+  ImagePyramid(const cv::Mat& img_level_0, int n_levels);
+  virtual ~ImagePyramid() {}
+
+  int size() const { return (int)host_.size(); }
+  int cols(int level) const { return host_[0].cols>>level; }
+  int rows(int level) const { return host_[0].rows>>level; }
+
+  /// Host copy of the level, made on the first call.
+  const cv::Mat& level(int level) const
+  {
+    assert(level >= 0 && level < size());
+    if(ready_[level].load(std::memory_order_acquire))
+      return host_[level];
+    std::lock_guard<std::mutex> lock(mutex_);
+    materialize(level);
+    return host_[level];
+  }
+
+  /// Host copies of all levels.
+  const ImgPyr& host() const;
+
+protected:
+  /// Fill img (allocated, rows(level) x cols(level), CV_8U) with the level. Called with the lock
+  /// held, the default half-samples the host copy of level-1.
+  virtual void download(int level, cv::Mat& img) const;
+
+  /// Make the host copy of the level if it does not exist yet, the lock must be held.
+  void materialize(int level) const;
+
+private:
+  mutable ImgPyr host_;
+  mutable std::unique_ptr<std::atomic<bool>[]> ready_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace vio
+
+#endif //VIO_IMAGE_PYRAMID_H
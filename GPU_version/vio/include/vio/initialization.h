@@ -18,7 +18,7 @@
 #define VIO_INITIALIZATION_H
 
 #include <vio/global.h>
-#include <vio/cl_class.h>
+#include <vio/compute_backend.h>
 #include <vio/ukf.h>
 #include <vio/homography.h>
 #include <vio/for_it.hpp>
@@ -27,6 +27,7 @@
 namespace vio {
 
 class FrameHandlerMono;
+class Map;
 
 /// Bootstrapping the map from the first two views.
 namespace initialization {
@@ -40,10 +41,11 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   FramePtr frame_ref_;
-  KltHomographyInit(opencl* gpu_fast_,UKF* ukf,FILE* log=nullptr):gpu_fast_(gpu_fast_),T_cur_from_ref_(0.0,0.0,0.0),ukf_(ukf),log_(log) {};
+  KltHomographyInit(ComputeBackend* backend,UKF* ukf,AsyncLogger* log=nullptr):backend_(backend),T_cur_from_ref_(0.0,0.0,0.0),ukf_(ukf),log_(log) {};
   ~KltHomographyInit() {};
   InitResult addFirstFrame(FramePtr frame_ref);
-  InitResult addSecondFrame(FramePtr frame_ref);
+  /// Triangulates the inliers into new points of map.
+  InitResult addSecondFrame(FramePtr frame_cur, Map& map);
   void reset();
 
 protected:
@@ -55,8 +57,8 @@ protected:
   vector<int> inliers_;             //!< inliers after the geometric check (e.g., Homography).
   vector<Vector3d> xyz_in_cur_;     //!< 3D points computed during the geometric check.
   SE2_5 T_cur_from_ref_;              //!< computed transformation between the first two frames.
-  opencl* gpu_fast_;
-  FILE* log_=nullptr;
+  ComputeBackend* backend_;
+  AsyncLogger* log_=nullptr;
   UKF* ukf_= nullptr;
 
   void computeHomography(
@@ -92,8 +94,7 @@ protected:
                            xyz_in_hom, inlier_hom, outliers_hom);
 /*        std::cerr<<xyz_in_hom.size()<<'\n';*/
 /*#if VIO_DEBUG
-      for(int i=0;i<f_cur.size();++i)fprintf(log_,"[%s] curhomog: x=%f, y=%f, z=%f ref: x=%f y=%f z=%f, inlier: %f, %f, %f\n",
-                                             vio::time_in_HH_MM_SS_MMM().c_str(),
+      for(int i=0;i<f_cur.size();++i)log_->write("curhomog: x=%f, y=%f, z=%f ref: x=%f y=%f z=%f, inlier: %f, %f, %f\n",
                                              f_cur.at(i).x(),f_cur.at(i).y(),f_cur.at(i).z(),
                                              f_ref.at(i).x(),f_ref.at(i).y(),f_ref.at(i).z(),
                                              xyz_in_hom.at(i).x(),xyz_in_hom.at(i).y(),xyz_in_hom.at(i).z());
@@ -106,8 +107,7 @@ protected:
 
 /*      std::cerr<<xyz_in_ekf.size()<<'\n';*/
 /*#if VIO_DEBUG
-      for(int i=0;i<f_cur.size();++i)fprintf(log_,"[%s] cur ukf: x=%f, y=%f, z=%f ref: x=%f y=%f z=%f inlier: %f, %f, %f\n",
-                                             vio::time_in_HH_MM_SS_MMM().c_str(),
+      for(int i=0;i<f_cur.size();++i)log_->write("cur ukf: x=%f, y=%f, z=%f ref: x=%f y=%f z=%f inlier: %f, %f, %f\n",
                                              f_cur.at(i).x(),f_cur.at(i).y(),f_cur.at(i).z(),
                                              f_ref.at(i).x(),f_ref.at(i).y(),f_ref.at(i).z(),
                                              xyz_in_ekf.at(i).x(),xyz_in_ekf.at(i).y(),xyz_in_ekf.at(i).z());
@@ -143,7 +143,7 @@ void detectFeatures(
     FramePtr frame,
     vector<cv::Point2f>& px_vec,
     list<std::shared_ptr<Feature>>& new_features,
-    opencl* gpu_fast);
+    ComputeBackend* backend);
 void trackKlt(
             FramePtr frame_ref,
             FramePtr frame_cur,
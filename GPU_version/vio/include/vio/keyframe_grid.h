@@ -0,0 +1,54 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_KEYFRAME_GRID_H
+#define VIO_KEYFRAME_GRID_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <vio/global.h>
+
+namespace vio {
+
+/// Keyframes bucketed by their position on the ground plane (x, z) in the square cells of a hash
+/// grid. It is kept up to date on insert, erase and after the optimizer moved the keyframes, a
+/// query visits the cells around its position instead of the whole map.
+class KeyframeGrid
+{
+public:
+  explicit KeyframeGrid(double cell_size);
+
+  void clear();
+  void insert(const FramePtr& kf);
+  void erase(const Frame* kf);
+
+  /// Move kf to the cell of its current pose.
+  void update(const FramePtr& kf);
+
+  /// Keyframes within radius of pos whose heading differs from pitch by at most max_angle.
+  void query(const Vector2d& pos, double pitch, double radius, double max_angle,
+             std::vector<FramePtr>& kfs) const;
+
+  /// Keyframe furthest from pos, NULL if there is none. The cells are bounded first, only the
+  /// keyframes of the cells which can hold the furthest are compared.
+  FramePtr furthest(const Vector2d& pos) const;
+
+  inline size_t size() const { return cell_of_.size(); }
+
+private:
+  typedef std::unordered_map<int64_t, std::vector<FramePtr> > Cells;
+
+  int64_t key(const Vector2d& pos) const;
+  int64_t key(int ix, int iz) const { return ((int64_t) ix << 32) | (uint32_t) iz; }
+  void cell(int64_t key, int& ix, int& iz) const { ix = (int)(key >> 32); iz = (int)(int32_t)(uint32_t) key; }
+
+  double cell_size_;                                    //!< side of a cell [m].
+  Cells cells_;                                         //!< keyframes of the occupied cells.
+  std::unordered_map<const Frame*, int64_t> cell_of_;   //!< cell of every keyframe.
+};
+
+} // namespace vio
+
+#endif //VIO_KEYFRAME_GRID_H
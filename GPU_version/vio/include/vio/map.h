@@ -24,6 +24,7 @@
 #include <vio/point.h>
 #include <vio/frame.h>
 #include <vio/feature.h>
+#include <vio/keyframe_grid.h>
 
 namespace vio {
 
@@ -32,7 +33,7 @@ class Map
 {
 public:
   list< FramePtr > keyframes_;          //!< List of keyframes in the map.
-  list< std::shared_ptr<Point> > trash_points_;         //!< A deleted point is moved to the trash bin. Now and then this is cleaned. One reason is that the visualizer must remove the points also.
+  list< PointHandle > trash_points_;    //!< A deleted point is moved to the trash bin. Now and then this is cleaned. One reason is that the visualizer must remove the points also.
 
   Map();
   ~Map();
@@ -40,43 +41,35 @@ public:
   /// Reset the map. Delete all keyframes and reset the frame and point counters.
   void reset();
 
+  /// Create a point owned by the map. It lives until it was deleted and the trash was emptied, or
+  /// the map is reset; the handles to it read as NULL afterwards.
+  template<class... Args>
+  PointHandle newPoint(Args&&... args) { return points_.create(std::forward<Args>(args)...); }
+
   /// Delete a point in the map and remove all references in keyframes to it.
-  void safeDeletePoint(std::shared_ptr<Point> pt);
+  void safeDeletePoint(PointHandle pt);
 
   /// Moves the point to the trash queue which is cleaned now and then.
-  void deletePoint(std::shared_ptr<Point> pt);
+  void deletePoint(PointHandle pt);
 
   /// Moves the frame to the trash queue which is cleaned now and then.
   bool safeDeleteFrame(FramePtr frame);
 
   /// Remove the references between a point and a frame.
-  void removePtFrameRef(FramePtr frame, std::shared_ptr<Feature> ftr);
+  void removePtFrameRef(const FramePtr& frame, const std::shared_ptr<Feature>& ftr);
 
   /// Add a new keyframe to the map.
   void addKeyframe(FramePtr new_keyframe);
 
-  /// Given a frame, return all keyframes which have an overlapping field of view.
-  void getCloseKeyframes(const FramePtr& frame, list< pair<FramePtr,double> >& close_kfs){
-      for(auto kf : keyframes_)
-      {
-          // check if kf has overlaping field of view with frame, use therefore KeyPoints
-          for(auto keypoint : kf->key_pts_)
-          {
-              if(keypoint == nullptr)
-                  continue;
-              if(keypoint->point==NULL)continue;
-              if(frame->isVisible(keypoint->point->pos_))
-              {
-                  close_kfs.push_back(
-                          std::make_pair(
-                                  kf, (frame->T_f_w_.se2().translation()-kf->T_f_w_.se2().translation()).norm()));
-                  break; // this keyframe has an overlapping field of view -> add to close_kfs
-              }
-          }
-      }
-  }
-
-  /// Return the keyframe which is furthest apart from pos.
+  /// Move a keyframe in the spatial index after its pose was optimized.
+  void updateKeyframe(const FramePtr& kf);
+
+  /// Given a frame, return all keyframes which have an overlapping field of view. Only the keyframes
+  /// within Config::closeKfsRadius() whose heading is within the field of view of the frame's are
+  /// tested with their key points.
+  void getCloseKeyframes(const FramePtr& frame, list< pair<FramePtr,double> >& close_kfs);
+
+  /// Return the keyframe which is furthest apart from pos, NULL without keyframes.
   FramePtr getFurthestKeyframe(const Vector2d& pos);
 
   /// Empty trash bin of deleted keyframes and map points. We don't delete the
@@ -86,18 +79,29 @@ public:
 
   bool checkKeyFrames();
 
+  /// Check the references between the keyframes, their features and the points: a feature
+  /// belongs to the frame which lists it, a point of a feature is alive and has the feature
+  /// among its observations, every observation is a feature of a live frame with that point,
+  /// the key points are features of the frame with a point, trashed points have no
+  /// observations and every point of the map is referenced by a keyframe or the trash. Every
+  /// problem is printed with id, returns their number. For debug builds.
+  size_t validate(int id) const;
+
 
   /// Return the number of keyframes in the map
   inline size_t size() const { return keyframes_.size(); }
-};
 
-/// A collection of debug functions to check the data consistency.
-namespace map_debug {
+  /// Return the number of live points and of the point slots, the latter stays flat once the
+  /// deleted points are recycled as fast as new ones are made.
+  inline size_t nPoints() const { return points_.size(); }
+  inline size_t pointCapacity() const { return points_.capacity(); }
 
-void frameValidation(FramePtr frame, int id);
-void pointValidation(std::shared_ptr<Point> point, int id);
+private:
+  Slab<Point> points_;                  //!< storage of all points, the map owns them.
+  KeyframeGrid kf_grid_;                //!< keyframes by their position on the ground plane.
+  boost::mutex kf_grid_mut_;            //!< the global optimizer moves the keyframes in its thread.
+};
 
-} // namespace map_debug
 } // namespace vio
 
 #endif // VIO_MAP_H_
@@ -60,6 +60,9 @@ bool warpAffine(
 
 } // namespace warp
 
+/// Mean structural similarity of two patches, used to accept direct matches.
+cv::Scalar getMSSIM(const cv::Mat& i1, const cv::Mat& i2);
+
 /// Patch-matcher for reprojection-matching and epipolar search in triangulation.
 class Matcher
 {
@@ -121,7 +124,7 @@ public:
       const double d_estimate,
       const double d_min,
       const double d_max,
-      double& depth,FILE* log);
+      double& depth,AsyncLogger* log);
 
   void createPatchFromPatchWithBorder();
   uint i=0;
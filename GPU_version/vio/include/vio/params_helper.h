@@ -14,6 +14,11 @@
  */
 
 #include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 #include <ros/ros.h>
 #if VIO_DEBUG
 #include <chrono>
@@ -25,9 +30,86 @@
 
 namespace vk {
 
+    /// Parameters loaded from yaml files when running without a ROS master (e.g. dataset replay).
+    /// Keys are stored with their full namespace, "vio/cam_width".
+    inline
+    std::map<std::string, std::string>& offlineParams()
+    {
+        static std::map<std::string, std::string> params;
+        return params;
+    }
+
+    /// Load the nested "key: value" maps of a rosparam yaml file, later files override earlier ones.
+    inline
+    bool loadParamFile(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if(!file.is_open())
+            return false;
+        std::vector<std::pair<size_t, std::string> > ns; // (indentation, key) of the open maps
+        std::string line;
+        while(std::getline(file, line))
+        {
+            const size_t comment = line.find('#');
+            if(comment != std::string::npos)
+                line.erase(comment);
+            const size_t indent = line.find_first_not_of(" \t");
+            const size_t colon = line.find(':');
+            if(indent == std::string::npos || colon == std::string::npos)
+                continue;
+            std::string key = line.substr(indent, colon-indent);
+            std::string value = line.substr(colon+1);
+            key.erase(key.find_last_not_of(" \t")+1);
+            value.erase(0, std::min(value.size(), value.find_first_not_of(" \t\"'")));
+            value.erase(value.find_last_not_of(" \t\r\"'")+1);
+            while(!ns.empty() && ns.back().first >= indent)
+                ns.pop_back();
+            std::string full_name;
+            for(auto&& it:ns)
+                full_name += it.second+"/";
+            full_name += key;
+            if(value.empty())
+                ns.push_back(std::make_pair(indent, key));
+            else
+                offlineParams()[full_name] = value;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool getOfflineParam(const std::string& name, T& v)
+    {
+        auto it = offlineParams().find(name);
+        if(it == offlineParams().end())
+            return false;
+        std::istringstream ss(it->second);
+        ss >> std::boolalpha >> v;
+        return !ss.fail();
+    }
+
+    inline
+    bool getOfflineParam(const std::string& name, std::string& v)
+    {
+        auto it = offlineParams().find(name);
+        if(it == offlineParams().end())
+            return false;
+        v = it->second;
+        return true;
+    }
+
+    template<typename T>
+    bool getParamValue(const std::string& name, T& v)
+    {
+        if(!offlineParams().empty())
+            return getOfflineParam(name, v);
+        return ros::param::get(name, v);
+    }
+
     inline
     bool hasParam(const std::string& name)
     {
+        if(!offlineParams().empty())
+            return offlineParams().count(name) > 0;
         return ros::param::has(name);
     }
 
@@ -35,7 +117,7 @@ namespace vk {
     T getParam(const std::string& name, const T& defaultValue)
     {
         T v;
-        if(ros::param::get(name, v))
+        if(getParamValue(name, v))
         {
             ROS_INFO_STREAM("Found parameter: " << name << ", value: " << v);
             return v;
@@ -49,7 +131,7 @@ namespace vk {
     T getParam(const std::string& name)
     {
         T v;
-        if(ros::param::get(name, v))
+        if(getParamValue(name, v))
         {
             ROS_INFO_STREAM("Found parameter: " << name << ", value: " << v);
             return v;
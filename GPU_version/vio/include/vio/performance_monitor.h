@@ -0,0 +1,214 @@
+/*
+ * performance_monitor.h
+ *
+ *  Scoped spans of the pipeline stages. Every thread records into its own
+ *  log-linear histograms and ring buffer, so the hot path takes no lock and
+ *  snapshots can be read at runtime without stalling the tracking thread.
+ */
+
+#ifndef VIKIT_PERFORMANCE_MONITOR_H_
+#define VIKIT_PERFORMANCE_MONITOR_H_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <boost/thread.hpp>
+
+namespace vk
+{
+
+/// Latency histogram in [ns], 16 linear sub-buckets per power of two which bounds the
+/// relative error of a percentile to 1/16. Values above 2^36 ns (~68 s) are clamped.
+/// Written by a single thread, read by any thread.
+class LatencyHistogram
+{
+public:
+  static const int kSubBits = 4;
+  static const int kSub = 1<<kSubBits;
+  static const int kBuckets = 33*kSub;
+
+  LatencyHistogram() { reset(); }
+
+  static inline int bucket(uint64_t ns)
+  {
+    if(ns < 2*kSub)
+      return static_cast<int>(ns);
+    const int e = 63-__builtin_clzll(ns)-kSubBits;
+    const int idx = e*kSub + static_cast<int>(ns>>e);
+    return idx < kBuckets ? idx : kBuckets-1;
+  }
+
+  /// Center of the value range of a bucket [ns].
+  static inline double bucketValue(int idx)
+  {
+    if(idx < 2*kSub)
+      return idx;
+    const int e = idx/kSub-1;
+    const uint64_t m = idx%kSub+kSub;
+    return ((m<<e) + ((m+1)<<e)) * 0.5;
+  }
+
+  /// Only called by the owning thread, plain load/store instead of read-modify-write.
+  inline void record(uint64_t ns)
+  {
+    std::atomic<uint64_t>& c = counts_[bucket(ns)];
+    c.store(c.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed)+ns, std::memory_order_relaxed);
+    if(ns > max_.load(std::memory_order_relaxed))
+      max_.store(ns, std::memory_order_relaxed);
+    count_.store(count_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+  }
+
+  /// Add the content to the merged histogram of a stage.
+  void addTo(std::vector<uint64_t>& counts, uint64_t& n, uint64_t& sum, uint64_t& max) const;
+
+  /// Samples recorded while the reset is running might survive it.
+  void reset();
+
+private:
+  std::atomic<uint64_t> counts_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+struct SpanRecord
+{
+  int stage;
+  uint64_t start_ns;        //!< steady clock.
+  uint64_t duration_ns;
+};
+
+/// Last kSize spans of a thread, single producer.
+class SpanRing
+{
+public:
+  static const size_t kSize = 1024;
+
+  SpanRing() : head_(0) {}
+
+  inline void push(int stage, uint64_t start_ns, uint64_t duration_ns)
+  {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const size_t i = head & (kSize-1);
+    stage_[i].store(stage, std::memory_order_relaxed);
+    start_[i].store(start_ns, std::memory_order_relaxed);
+    duration_[i].store(duration_ns, std::memory_order_relaxed);
+    head_.store(head+1, std::memory_order_release);
+  }
+
+  /// Append the spans which were not overwritten while reading.
+  void read(std::vector<SpanRecord>& spans) const;
+
+private:
+  std::atomic<uint64_t> head_;
+  std::atomic<int> stage_[kSize];
+  std::atomic<uint64_t> start_[kSize];
+  std::atomic<uint64_t> duration_[kSize];
+};
+
+class PerformanceMonitor
+{
+public:
+  static const int kMaxStages = 32;
+
+  struct StageStats
+  {
+    std::string name;
+    uint64_t count;
+    double mean;            //!< [s]
+    double p50;             //!< [s]
+    double p95;             //!< [s]
+    double p99;             //!< [s]
+    double max;             //!< [s]
+  };
+
+  PerformanceMonitor();
+  ~PerformanceMonitor();
+
+  /// Process wide id of a stage name, stable for the lifetime of the process. -1 if there are
+  /// more than kMaxStages names. Takes a lock, cache the result (VIO_SPAN does).
+  static int stageId(const std::string& name);
+
+  static inline uint64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /// Register a stage for the reports, spans of other stages are recorded but not reported.
+  void addTimer(const std::string& name);
+
+  /// Hot path, lock free once the calling thread recorded its first span.
+  void record(int stage, uint64_t start_ns, uint64_t duration_ns);
+
+  /// Add a sample [s] that was measured outside of a span.
+  void log(int stage, double value);
+
+  /// Same as log(stageId(name), value), takes the lock of stageId on every call (VIO_LOG does not).
+  void log(const std::string& name, double value) { log(stageId(name), value); }
+
+  /// Merged statistics of all threads for the registered stages.
+  std::vector<StageStats> snapshot() const;
+
+  /// Most recent spans of all threads.
+  std::vector<SpanRecord> recentSpans() const;
+
+  /// Number of samples recorded for a stage.
+  size_t count(const std::string& name) const;
+
+  /// p in [0,1], returns the latency [s] of the stage at this percentile.
+  double percentile(const std::string& name, double p) const;
+
+  /// Print count, mean, p50, p95, p99 and max [ms] of every registered stage.
+  void writeSummary(FILE* out) const;
+
+  /// Drop all samples, registered stages are kept.
+  void reset();
+
+private:
+  struct ThreadData
+  {
+    LatencyHistogram hist[kMaxStages];
+    SpanRing ring;
+  };
+
+  ThreadData* threadData();
+  void merge(int stage, std::vector<uint64_t>& counts, uint64_t& n, uint64_t& sum, uint64_t& max) const;
+
+  const uint64_t instance_;                 //!< distinguishes monitors in the thread local cache.
+  std::vector<std::string> order_;          //!< stages in the order they were registered.
+  std::vector<ThreadData*> threads_;
+  mutable boost::mutex mut_;                //!< guards order_ and threads_, the hot path only takes it for the first span of a thread.
+};
+
+/// Records the lifetime of the scope as one span of a stage.
+class ScopedSpan
+{
+public:
+  ScopedSpan(PerformanceMonitor* monitor, int stage) :
+    monitor_(stage < 0 ? NULL : monitor),
+    stage_(stage),
+    start_(monitor_ ? PerformanceMonitor::now() : 0)
+  {}
+
+  ~ScopedSpan()
+  {
+    if(monitor_)
+      monitor_->record(stage_, start_, PerformanceMonitor::now()-start_);
+  }
+
+private:
+  ScopedSpan(const ScopedSpan&);
+  ScopedSpan& operator=(const ScopedSpan&);
+  PerformanceMonitor* monitor_;
+  int stage_;
+  uint64_t start_;
+};
+
+} // namespace vk
+
+#endif // VIKIT_PERFORMANCE_MONITOR_H_
@@ -60,14 +60,17 @@ public:
   ~Point();
 
   /// Add a reference to a frame.
-  void addFrameRef(std::shared_ptr<Feature> ftr);
+  void addFrameRef(const std::shared_ptr<Feature>& ftr);
 
-  /// Remove reference to a frame.
-  bool deleteFrameRef(FramePtr frame);
+  /// Remove the references to a frame, false if the point had none.
+  bool deleteFrameRef(const Frame* frame);
 
 
   /// Check whether mappoint has reference to a frame.
-  std::shared_ptr<Feature> findFrameRef(FramePtr frame);
+  std::shared_ptr<Feature> findFrameRef(const Frame* frame);
+
+  /// Tell the keyframes observing the point that it moved, their alignment references upload it again.
+  void alignmentPointsMoved() const;
 
   /// Get Frame with similar viewpoint.
   bool getCloseViewObs(const Vector2d& pos, std::shared_ptr<Feature>& obs, int id=0) const;
@@ -84,7 +87,7 @@ public:
             const Matrix3d& R_f_w,
             Matrix23d& point_jac,
             double * cam_params,
-            SE2_5 fram_t_f_w)
+            const SE2_5& fram_t_f_w)
     {
         double fx = cam_params[0];
         double fy = cam_params[1];
@@ -93,8 +96,8 @@ public:
         double x_n = p_in_f.x();
         double y_n = p_in_f.y();
         double z_n = p_in_f.z();
-        double x_c =  fram_t_f_w.se2().translation()(0);
-        double z_c = fram_t_f_w.se2().translation()(1);
+        double x_c = fram_t_f_w.x();
+        double z_c = fram_t_f_w.z();
         double theta = fram_t_f_w.pitch();
 
         double alpha = (fx*(theta/r))-(fx*((x_n*x_n)/(r*r))*theta)+((1+3*s*theta*theta)/((r*r)+1))*((fx*x_n*x_n)/(r*r));
@@ -0,0 +1,41 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_POINT_BATCH_H
+#define VIO_POINT_BATCH_H
+
+#include <stdint.h>
+#include <vector>
+#include <Eigen/Core>
+
+namespace vio {
+
+/// World points of a batch projection and the results of Frame::w2f and Frame::w2c, one array
+/// per coordinate so that a pass over the batch runs 2 or 4 points per SIMD instruction.
+struct PointBatch
+{
+  std::vector<double> x_w, y_w, z_w;    //!< world coordinates, the input.
+  std::vector<double> x_f, y_f, z_f;    //!< frame coordinates, Frame::w2f.
+  std::vector<double> u, v;             //!< pixels, Frame::w2c.
+  std::vector<uint8_t> visible;         //!< 1 if in front of the camera and in the image, Frame::w2c.
+
+  inline size_t size() const { return x_w.size(); }
+
+  void clear();
+  void reserve(size_t n);
+  void push_back(const Eigen::Vector3d& xyz_w);
+
+  inline Eigen::Vector3d xyz_f(size_t i) const { return Eigen::Vector3d(x_f[i], y_f[i], z_f[i]); }
+  inline Eigen::Vector2d px(size_t i) const { return Eigen::Vector2d(u[i], v[i]); }
+};
+
+/// out = R*in + t for n points in columns, with AVX, SSE2 or NEON.
+void transformPoints(
+    const Eigen::Matrix3d& R, const Eigen::Vector3d& t, size_t n,
+    const double* x, const double* y, const double* z,
+    double* x_out, double* y_out, double* z_out);
+
+} // namespace vio
+
+#endif //VIO_POINT_BATCH_H
@@ -43,7 +43,7 @@ void optimizeGaussNewton(
     double& error_final,
     size_t& num_obs,
     vio::Map& map,
-    FILE* log);
+    AsyncLogger* log);
 
 } // namespace pose_optimizer
 } // namespace vio
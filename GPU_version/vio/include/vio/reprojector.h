@@ -20,7 +20,9 @@
 #include <vio/global.h>
 #include <vio/matcher.h>
 #include <CL/cl.h>
-#include <vio/cl_class.h>
+#include <vio/compute_backend.h>
+#include <vio/feature_detection.h>
+#include <vio/hamming_matcher.h>
 #include <vio/initialization.h>
 #include <vio/vision.h>
 #include <vio/map.h>
@@ -57,46 +59,54 @@ public:
 
   Reprojector(vk::AbstractCamera* cam, Map& map);
 
-  ~Reprojector();
-
   /// Project points from the map into the image. First finds keyframes with
   /// overlapping field of view and projects only those map-points.
   void reprojectMap(
       FramePtr frame,
       FramePtr last_frame,
       std::vector< std::pair<FramePtr,std::size_t> >& overlap_kfs,
-      opencl* gpu_fast_,
-      FILE* log_);
+      ComputeBackend* backend,
+      AsyncLogger* log_);
 
 
 private:
 
-  /// A candidate is a point that projects into the image plane and for which we
-  /// will search a maching feature in the image.
-  struct Candidate {
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-    Vector2d px;     //!< projected 2D pixel location.
-    Candidate(Vector2d& px) : px(px) {}
-  };
-  typedef std::list<Candidate > Cell;
-  typedef std::vector<Cell*> CandidateGrid;
-
-  /// The grid stores a set of candidate matches. For every grid cell we try to find one match.
+  /// Flat grid of cell_size pixels over the image. The keypoints of the frame are bucketed by
+  /// cell with a counting sort, the keypoints of cell c are index[start[c]] .. index[start[c+1]-1]
+  /// in increasing order, and occupied counts the features added to each cell.
   struct Grid
   {
-    CandidateGrid cells;
-    vector<int> cell_order;
     int cell_size;
     int grid_n_cols;
     int grid_n_rows;
+    vector<int> start;          //!< grid_n_cols*grid_n_rows+1 offsets into index.
+    vector<int> index;
+    vector<int> occupied;
+
+    int cell(const Vector2d& px) const
+    {
+      return static_cast<int>(px.y()/cell_size)*grid_n_cols + static_cast<int>(px.x()/cell_size);
+    }
+
+    /// Bucket the keypoints, which are inside the image, and clear the occupancy.
+    void build(const FeatureTable& keypoints);
+
+    /// Append the keypoints within radius (max norm) of px to candidates in increasing order.
+    void query(const FeatureTable& keypoints, const Vector2d& px, double radius, vector<int>& candidates) const;
   };
 
   Grid grid_;
   Matcher matcher_;
+  HammingMatcher hamming_matcher_;                    //!< descriptor matches of the reference features.
   Map& map_;
+  feature_detection::FastThreshold fast_threshold_;   //!< FAST threshold of the tracked frames.
 
   void initializeGrid(vk::AbstractCamera* cam);
   void resetGrid();
+
+  /// Search radius in pixels of a map point at depth depth in frame, from the pose covariance
+  /// of the prior: the heading moves the point by f*sigma, the translation by f/depth*sigma.
+  double matchWindow(const Frame& frame, double depth) const;
 };
 
 } // namespace vio
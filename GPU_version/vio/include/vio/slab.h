@@ -0,0 +1,175 @@
+//
+// Created by root on 10/17/26.
+//
+
+#ifndef VIO_SLAB_H
+#define VIO_SLAB_H
+
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace vio {
+
+template<class T> class Slab;
+
+/// Index of an object in a Slab plus the generation of its slot. Copying it is a plain copy, it
+/// does not keep the object alive: once the object is destroyed the handle reads as NULL, also
+/// after the slot was reused for another object.
+template<class T>
+class SlabHandle
+{
+public:
+  SlabHandle() : slab_(NULL), index_(0), generation_(0) {}
+  SlabHandle(std::nullptr_t) : slab_(NULL), index_(0), generation_(0) {}
+
+  /// The object, NULL if the handle is empty or the object was destroyed.
+  inline T* get() const { return slab_ == NULL ? NULL : slab_->get(index_, generation_); }
+  inline T* operator->() const { T* t = get(); assert(t != NULL); return t; }
+  inline T& operator*() const { return *operator->(); }
+  inline explicit operator bool() const { return get() != NULL; }
+  inline void reset() { slab_ = NULL; index_ = 0; generation_ = 0; }
+
+  inline uint32_t index() const { return index_; }
+  inline uint32_t generation() const { return generation_; }
+
+  friend bool operator==(const SlabHandle& a, std::nullptr_t) { return a.get() == NULL; }
+  friend bool operator!=(const SlabHandle& a, std::nullptr_t) { return a.get() != NULL; }
+  friend bool operator==(const SlabHandle& a, const SlabHandle& b)
+  { return a.slab_ == b.slab_ && a.index_ == b.index_ && a.generation_ == b.generation_; }
+  friend bool operator!=(const SlabHandle& a, const SlabHandle& b) { return !(a == b); }
+  friend bool operator<(const SlabHandle& a, const SlabHandle& b)
+  { return a.index_ != b.index_ ? a.index_ < b.index_ : a.generation_ < b.generation_; }
+
+private:
+  friend class Slab<T>;
+  SlabHandle(const Slab<T>* slab, uint32_t index, uint32_t generation) :
+    slab_(slab), index_(index), generation_(generation) {}
+
+  const Slab<T>* slab_;
+  uint32_t index_;
+  uint32_t generation_;
+};
+
+/// Objects of type T in chunks of fixed size which are never moved or freed before the slab, so
+/// the address of an object is stable for its life. A destroyed object leaves its slot on a free
+/// list for the next create and bumps the generation of the slot, which turns the handles to it
+/// into NULL. Create and destroy are for one thread; get() may run in another one as long as it
+/// does not race with the destruction of the object it resolves.
+template<class T>
+class Slab
+{
+public:
+  typedef SlabHandle<T> Handle;
+
+  static const uint32_t kChunkSize = 1024;     //!< objects per chunk.
+  static const uint32_t kMaxChunks = 4096;     //!< the chunk table is never reallocated.
+
+  Slab() : n_slots_(0), n_alive_(0) { chunks_.reserve(kMaxChunks); }
+  ~Slab() { clear(); }
+  Slab(const Slab&) = delete;
+  Slab& operator=(const Slab&) = delete;
+
+  /// Construct an object in a free slot, a recycled one if there is any.
+  template<class... Args>
+  Handle create(Args&&... args)
+  {
+    uint32_t index;
+    if(!free_.empty())
+    {
+      index = free_.back();
+      free_.pop_back();
+    }
+    else
+    {
+      index = n_slots_.load(std::memory_order_relaxed);
+      if(index == chunks_.size() * kChunkSize)
+      {
+        if(chunks_.size() == kMaxChunks)
+          throw std::runtime_error("Slab: out of slots");
+        chunks_.emplace_back(new Slot[kChunkSize]);
+      }
+    }
+    Slot& s = slot(index);
+    new (s.storage) T(std::forward<Args>(args)...);
+    s.alive = true;
+    ++n_alive_;
+    // publish the slot and its chunk to get() in other threads
+    if(index == n_slots_.load(std::memory_order_relaxed))
+      n_slots_.store(index + 1, std::memory_order_release);
+    return Handle(this, index, s.generation);
+  }
+
+  /// Destroy the object of h, nothing if it is already gone.
+  void destroy(const Handle& h)
+  {
+    if(h.slab_ != this || get(h.index_, h.generation_) == NULL)
+      return;
+    Slot& s = slot(h.index_);
+    object(s)->~T();
+    s.alive = false;
+    ++s.generation;
+    --n_alive_;
+    free_.push_back(h.index_);
+  }
+
+  /// Destroy all objects, every handle reads as NULL afterwards.
+  void clear()
+  {
+    const uint32_t n = n_slots_.load(std::memory_order_relaxed);
+    for(uint32_t i=0; i<n; ++i)
+      if(slot(i).alive)
+        destroy(Handle(this, i, slot(i).generation));
+  }
+
+  /// The object in slot index if it is still of the given generation, else NULL.
+  inline T* get(uint32_t index, uint32_t generation) const
+  {
+    if(index >= n_slots_.load(std::memory_order_acquire))
+      return NULL;
+    const Slot& s = slot(index);
+    return s.alive && s.generation == generation ? object(s) : NULL;
+  }
+
+  /// Call f with the handle of every live object.
+  template<class F>
+  void forEach(F f) const
+  {
+    const uint32_t n = n_slots_.load(std::memory_order_relaxed);
+    for(uint32_t i=0; i<n; ++i)
+      if(slot(i).alive)
+        f(Handle(this, i, slot(i).generation));
+  }
+
+  inline size_t size() const { return n_alive_; }              //!< live objects.
+  inline size_t capacity() const { return n_slots_.load(std::memory_order_relaxed); }          //!< slots ever handed out.
+  inline size_t nFree() const { return free_.size(); }         //!< slots waiting for reuse.
+
+private:
+  struct Slot
+  {
+    alignas(T) unsigned char storage[sizeof(T)];
+    uint32_t generation = 0;
+    bool alive = false;
+  };
+
+  inline Slot& slot(uint32_t i) { return chunks_[i / kChunkSize][i % kChunkSize]; }
+  inline const Slot& slot(uint32_t i) const { return chunks_[i / kChunkSize][i % kChunkSize]; }
+  static inline T* object(const Slot& s)
+  { return std::launder(reinterpret_cast<T*>(const_cast<unsigned char*>(s.storage))); }
+
+  std::vector<std::unique_ptr<Slot[]> > chunks_;
+  std::vector<uint32_t> free_;        //!< destroyed slots, the last one is reused first.
+  std::atomic<uint32_t> n_slots_;    //!< slots handed out, read by get() in other threads.
+  size_t n_alive_;
+};
+
+} // namespace vio
+
+#endif //VIO_SLAB_H
@@ -19,7 +19,7 @@
 
 #include <vio/nlls_solver.h>
 #include <vio/global.h>
-#include <vio/cl_class.h>
+#include <vio/compute_backend.h>
 #include <vio/frame.h>
 #include <vio/feature.h>
 #include <vio/config.h>
@@ -48,12 +48,19 @@ public:
       int n_iter,
       Method method,
       bool verbose,
-      opencl* residual);
+      ComputeBackend* residual);
 
   size_t run(
       FramePtr ref_frame,
       FramePtr cur_frame,
-      FILE* log);
+      AsyncLogger* log);
+
+  /// Align cur_frame against all ref_frames at once, their features are stacked into one problem
+  /// and every iteration is one residual launch over all of them.
+  size_t run(
+      const std::vector<FramePtr>& ref_frames,
+      FramePtr cur_frame,
+      AsyncLogger* log);
 
    // FILE* data= nullptr;
 
@@ -62,7 +69,7 @@ protected:
   int max_level_;                 //!< coarsest pyramid level for the alignment.
   int min_level_;                 //!< finest pyramid level for the alignment.
   size_t feature_counter_=0;
-  opencl* residual_= nullptr;
+  ComputeBackend* residual_= nullptr;
   std::vector<bool> errors;
 
   // cache:
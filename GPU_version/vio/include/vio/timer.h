@@ -4,6 +4,7 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <chrono>
 
 namespace vk
 {
@@ -11,7 +12,7 @@ namespace vk
 class Timer
 {
 private:
-  timeval start_time_;
+  std::chrono::steady_clock::time_point start_time_;  //!< monotonic, not affected by clock adjustments.
   double time_;
   double accumulated_;
 public:
@@ -30,21 +31,17 @@ public:
   inline void start()
   {
     accumulated_ = 0.0;
-    gettimeofday(&start_time_, NULL);
+    start_time_ = std::chrono::steady_clock::now();
   }
 
   inline void resume()
   {
-    gettimeofday(&start_time_, NULL);
+    start_time_ = std::chrono::steady_clock::now();
   }
 
   inline double stop()
   {
-    timeval end_time;
-    gettimeofday(&end_time, NULL);
-    long seconds  = end_time.tv_sec  - start_time_.tv_sec;
-    long useconds = end_time.tv_usec - start_time_.tv_usec;
-    time_ = ((seconds) + useconds*0.000001) + accumulated_;
+    time_ = std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time_).count() + accumulated_;
     accumulated_ = time_;
     return time_;
   }
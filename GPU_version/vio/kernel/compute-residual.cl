@@ -4,6 +4,7 @@
 // Enable OpenCL 32-bit integer atomic functions.
 #pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable
 
+// fast_atan is in include/vio/fast_atan.h, the same as vk::ATANCamera::world2cam
 float2 world2cam(float3 feature)
 {
     float r = sqrt(pow(feature.x/feature.z, 2) + pow(feature.y/feature.z, 2));
@@ -11,9 +12,7 @@ float2 world2cam(float3 feature)
     if((float)S == 0 || r < 0.001){
         factor = 1.0;
     }else{
-        float y=2*r*sin(0.5 * (float)S);
-        float x=cos(0.5 * (float)S);
-        factor = (atan2(y,x) / (r * (float)S));
+        factor = fast_atan(r * 2.0f * tan(0.5f * (float)S)) / (r * (float)S);
     }
     return (float2)((float)C_X + (float)F_X * factor * feature.x/feature.z, (float)C_Y + (float)F_Y * factor * feature.y/feature.z);
 }
@@ -82,119 +81,156 @@ void jacobian_xyz2uv_(float3 xyz_in_f, float3 cur_p, float* J)
     J[5] = ((1/z_n)*gamma*n1)-(((x_n/(z_n*z_n))*gamma + (y_n/(z_n*z_n))*lamda)*n2);
 }
 
-void compute_hessain(float3 j, __global float* H, float w)
-{
-    H[0] += j.x * j.x * w;
-    H[1] += j.x * j.y * w;
-    H[2] += j.x * j.z * w;
-    H[3] += j.y * j.x * w;
-    H[4] += j.y * j.y * w;
-    H[5] += j.y * j.z * w;
-    H[6] += j.z * j.x * w;
-    H[7] += j.z * j.y * w;
-    H[8] += j.z * j.z * w;
-}
+#define PATCH_AREA (PATCH_SIZE*PATCH_SIZE)
+#define TILE_SIZE (PATCH_SIZE+1)
+// Per-feature terms of compute_residual: [0..8] Hessian, [9..11] Jacobian, [12] error, [13] chi.
+#define RESIDUAL_TERMS 14
 
-__kernel void compute_residual(
-        __read_only  image2d_t   image_cur, // current frame
+// Interpolated intensity and gradient of the reference patches of one pyramid level, they do
+// not change during the Gauss-Newton iterations. One work item per patch pixel; the patch of a
+// visible feature lies inside the image, the former linear addressing reads the same pixels.
+__kernel void reference_patch(
         __read_only  image2d_t   image_ref, // reference frame
-        __global     float3      * cur_pose,//[reference frame pose{x,z,pitch}]
-        __global     float3      * ref_pose,//[current frame pose{x,z,pitch}]
-        __global     float3      * ref_feature, // feature on the reference frame, when we applied the distance calculation: xyz_ref((*it)->f*((*it)->point->pos_ - Eigen::Vector3d(ref_pos[0],0.0,ref_pos[1])).norm());
         __global     float2      * featue_px,
                      int           level,
-        __global     float       * errors,
-        __global     float       * Hessian,
-        __global     float3      * Jacobian,
-        __global     float       * chi,
-                     float         scale_
+        __global     float4      * ref_patch, // PATCH_AREA per feature: value, dx, dy, 0
+        __global     int         * ref_visible
 )
 {
 float scale = pow(2.0, -level);
-// Prepare a suitable OpenCL image sampler.
 sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
-// Use global work feature.
-int f = get_global_id(0);
+int const g = get_global_id(0);
+int const f = g / PATCH_AREA;
+int const l = g % PATCH_AREA;
 // check if reference with patch size is within image
 float2 uv_ref = featue_px[f] * scale;
 float2 uv_ref_i = floor(uv_ref);
-if(uv_ref_i.x - (PATCH_HALFSIZE + 1) < 0 || uv_ref_i.y - (PATCH_HALFSIZE + 1) < 0 || uv_ref_i.x + (PATCH_HALFSIZE + 1) >= get_image_dim(image_ref).x || uv_ref_i.y + (PATCH_HALFSIZE + 1) >= get_image_dim(image_ref).y)return;
-// evaluate projection jacobian
-float frame_jac[6]={0.0}; // 2X3
-//jacobian_xyz2uv(sqrt(pow(ref_feature[f] - (float3)(ref_pose[0].x, 0.0, ref_pose[0].y), 2.0)), &frame_jac);
-jacobian_xyz2uv_(ref_feature[f], cur_pose[0], &frame_jac);
-
+int const visible = !(uv_ref_i.x - (PATCH_HALFSIZE + 1) < 0 || uv_ref_i.y - (PATCH_HALFSIZE + 1) < 0 || uv_ref_i.x + (PATCH_HALFSIZE + 1) >= get_image_dim(image_ref).x || uv_ref_i.y + (PATCH_HALFSIZE + 1) >= get_image_dim(image_ref).y);
+if(l == 0)ref_visible[f] = visible;
+if(!visible)return;
 // compute bilateral interpolation weights for reference image
 float2 subpix=  uv_ref - uv_ref_i;
 float w_ref_tl = (1.0 - subpix.x) * (1.0 - subpix.y);
 float w_ref_tr = subpix.x * (1.0 - subpix.y);
 float w_ref_bl = (1.0 - subpix.x) * subpix.y;
 float w_ref_br = subpix.x * subpix.y;
+int2 const px = (int2)(uv_ref_i.x - PATCH_HALFSIZE + l % PATCH_SIZE, uv_ref_i.y - PATCH_HALFSIZE + l / PATCH_SIZE);
+#define REF(dx, dy) (float)read_imageui(image_ref, sampler, px + (int2)(dx, dy)).x
+float value = w_ref_tl * REF(0, 0) + w_ref_tr * REF(1, 0) + w_ref_bl * REF(0, 1) + w_ref_br * REF(1, 1);
+float dx = 0.5f * ((w_ref_tl * REF(1, 0) + w_ref_tr * REF(2, 0) + w_ref_bl * REF(1, 1) + w_ref_br * REF(2, 1))
+                  -(w_ref_tl * REF(-1, 0) + w_ref_tr * REF(0, 0) + w_ref_bl * REF(-1, 1) + w_ref_br * REF(0, 1)));
+float dy = 0.5f * ((w_ref_tl * REF(0, 1) + w_ref_tr * REF(1, 1) + w_ref_bl * REF(0, 2) + w_ref_br * REF(1, 2))
+                  -(w_ref_tl * REF(0, -1) + w_ref_tr * REF(1, -1) + w_ref_bl * REF(0, 0) + w_ref_br * REF(1, 0)));
+#undef REF
+ref_patch[g] = (float4)(value, dx, dy, 0.0f);
+}
+
+// Residuals of one feature per work-group, one work item per patch pixel. The current patch and
+// its interpolation border are read once into local memory, the reference side comes from
+// reference_patch and the terms of the pixels are added in a tree in local memory. The features of
+// several reference frames can be stacked into one launch, ref_index selects their pose.
+__kernel __attribute__((reqd_work_group_size(PATCH_AREA, 1, 1)))
+void compute_residual(
+        __read_only  image2d_t   image_cur, // current frame
+        __global     float3      * cur_pose,//[current frame pose{x,z,pitch}]
+        __global     float3      * ref_pose,//[reference frame poses{x,z,pitch}]
+        __global     int         * ref_index,// reference frame of each feature
+        __global     float3      * ref_feature, // feature on the reference frame, when we applied the distance calculation: xyz_ref((*it)->f*((*it)->point->pos_ - Eigen::Vector3d(ref_pos[0],0.0,ref_pos[1])).norm());
+                     int           level,
+        __global     float4      * ref_patch,
+        __global     int         * ref_visible,
+        __global     float       * errors,
+        __global     float       * Hessian,
+        __global     float3      * Jacobian,
+        __global     float       * chi,
+                     float         scale_
+)
+{
+__local float tile[TILE_SIZE][TILE_SIZE];
+__local float terms[RESIDUAL_TERMS][PATCH_AREA];
+__local float frame_jac[6]; // 2X3
+__local float2 uv_cur;
+float scale = pow(2.0, -level);
+// Prepare a suitable OpenCL image sampler.
+sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
+int const f = get_group_id(0);
+int const l = get_local_id(0);
+// the outputs are written once per launch, nothing has to be cleared before
+if(!ref_visible[f]){
+    if(l == 0){
+        for(int i = 0; i < 9; ++i)Hessian[f*9+i]=0.0;
+        Jacobian[f]=(float3)(0.0, 0.0, 0.0);
+        errors[f]=0.0;
+        chi[f]=0.0;
+    }
+    return;
+}
+// the projection is the same for the whole patch
+if(l == 0){
+    float jac[6];
+    jacobian_xyz2uv_(ref_feature[f], cur_pose[0], jac);
+    for(int i = 0; i < 6; ++i)frame_jac[i] = jac[i];
+    uv_cur = world2cam(xyz_cur(cur_pose[0], ref_pose[ref_index[f]] ,ref_feature[f])) * scale;
+}
+barrier(CLK_LOCAL_MEM_FENCE);
 
 // compute bilateral interpolation weights for the current image
-float2 uv_cur_pyr = world2cam(xyz_cur(cur_pose[0], ref_pose[0] ,ref_feature[f])) * scale;
+float2 uv_cur_pyr = uv_cur;
 float2 uv_cur_i = floor(uv_cur_pyr);
 float2 subpix_uv_cur = uv_cur_pyr - uv_cur_i;
 float w_cur_tl = (1.0 - subpix_uv_cur.x) * (1.0 - subpix_uv_cur.y);
 float w_cur_tr = subpix_uv_cur.x * (1.0 - subpix_uv_cur.y);
 float w_cur_bl = (1.0 - subpix_uv_cur.x) * subpix_uv_cur.y;
 float w_cur_br = subpix_uv_cur.x * subpix_uv_cur.y;
-float e = 0.0;
-float chi_=0.0;
-for(int y = 0; y < PATCH_SIZE; ++y)
-{
-int ref_element_addr = (int)(uv_ref_i.y + y - PATCH_HALFSIZE) * get_image_dim(image_ref).x + (uv_ref_i.x - PATCH_HALFSIZE);
-int cur_element_addr = (int)(uv_cur_i.y + y - PATCH_HALFSIZE) * get_image_dim(image_cur).x + (uv_cur_i.x - PATCH_HALFSIZE);
 
-for(int x = 0; x < PATCH_SIZE; ++x, ++ref_element_addr, ++cur_element_addr)
-{
-// precompute interpolated reference patch color
-int2 px_reftl = (int2)( ref_element_addr                                    % get_image_dim(image_ref).x,  ref_element_addr                                    / get_image_dim(image_ref).x);
-int2 px_reftr = (int2)((ref_element_addr + 1)                               % get_image_dim(image_ref).x, (ref_element_addr + 1)                               / get_image_dim(image_ref).x);
-int2 px_refbl = (int2)((ref_element_addr + get_image_dim(image_ref).x)     % get_image_dim(image_ref).x, (ref_element_addr + get_image_dim(image_ref).x)     / get_image_dim(image_ref).x);
-int2 px_refbr = (int2)((ref_element_addr + get_image_dim(image_ref).x + 1) % get_image_dim(image_ref).x, (ref_element_addr + get_image_dim(image_ref).x + 1) / get_image_dim(image_ref).x);
-float value = w_ref_tl * read_imageui(image_ref, sampler, px_reftl).x + w_ref_tr * read_imageui(image_ref, sampler, px_reftr).x +
-              w_ref_bl * read_imageui(image_ref, sampler, px_refbl).x + w_ref_br * read_imageui(image_ref, sampler, px_refbr).x;
-
-float dx = 0.5f * ((w_ref_tl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + 1)                                     % get_image_dim(image_ref).x, ((ref_element_addr + 1)                                     / get_image_dim(image_ref).x))).x +
-                    w_ref_tr * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + 2)                                     % get_image_dim(image_ref).x, ((ref_element_addr + 2)                                     / get_image_dim(image_ref).x))).x +
-                    w_ref_bl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) + 1)     % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) + 1)     / get_image_dim(image_ref).x))).x +
-                    w_ref_br * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) + 2)     % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) + 2)     / get_image_dim(image_ref).x))).x)
-                   -(w_ref_tl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr - 1)                                     % get_image_dim(image_ref).x, ((ref_element_addr - 1)                                     / get_image_dim(image_ref).x))).x +
-                     w_ref_tr * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + 0)                                     % get_image_dim(image_ref).x, ((ref_element_addr + 0)                                     / get_image_dim(image_ref).x))).x +
-                     w_ref_bl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) - 1)     % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) - 1)     / get_image_dim(image_ref).x))).x +
-                     w_ref_br * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x))         % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x))         / get_image_dim(image_ref).x))).x));
-
-float dy = 0.5f * ((w_ref_tl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x))         % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x))         / get_image_dim(image_ref).x))).x +
-                    w_ref_tr * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) + 1)     % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) + 1)     / get_image_dim(image_ref).x))).x +
-                    w_ref_bl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) * 2)     % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) * 2)     / get_image_dim(image_ref).x))).x +
-                    w_ref_br * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (get_image_dim(image_ref).x) * 2 + 1) % get_image_dim(image_ref).x, ((ref_element_addr + (get_image_dim(image_ref).x) * 2 + 1) / get_image_dim(image_ref).x))).x)
-                   -(w_ref_tl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (-get_image_dim(image_ref).x))        % get_image_dim(image_ref).x, ((ref_element_addr + (-get_image_dim(image_ref).x))        / get_image_dim(image_ref).x))).x +
-                     w_ref_tr * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + (1 - get_image_dim(image_ref).x))     % get_image_dim(image_ref).x, ((ref_element_addr + (1 - get_image_dim(image_ref).x))     / get_image_dim(image_ref).x))).x +
-                     w_ref_bl * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + 0)                                     % get_image_dim(image_ref).x, ((ref_element_addr + 0)                                     / get_image_dim(image_ref).x))).x +
-                     w_ref_br * read_imageui(image_ref, sampler, (int2) ((ref_element_addr + 1)                                     % get_image_dim(image_ref).x, ((ref_element_addr + 1)                                     / get_image_dim(image_ref).x))).x));
-
-// compute residual
-int2 px_curtl = (int2)( cur_element_addr                                      % get_image_dim(image_cur).x,  cur_element_addr                                      / get_image_dim(image_cur).x);
-int2 px_curtr = (int2)((cur_element_addr + 1)                                 % get_image_dim(image_cur).x, (cur_element_addr + 1)                                 / get_image_dim(image_cur).x);
-int2 px_curbl = (int2)((cur_element_addr + (get_image_dim(image_cur).x))     % get_image_dim(image_cur).x, (cur_element_addr + (get_image_dim(image_cur).x))     / get_image_dim(image_cur).x);
-int2 px_curbr = (int2)((cur_element_addr + (get_image_dim(image_cur).x) + 1) % get_image_dim(image_cur).x, (cur_element_addr + (get_image_dim(image_cur).x) + 1) / get_image_dim(image_cur).x);
-
-float res = value - w_cur_tl * read_imageui(image_cur, sampler, px_curtl).x + w_cur_tr * read_imageui(image_cur, sampler, px_curtr).x +
-            w_cur_bl * read_imageui(image_cur, sampler, px_curbl).x + w_cur_br * read_imageui(image_cur, sampler, px_curbr).x;
-// used to compute scale for robust cost
-e += fabs(res);
+// load the patch and its border, linear addresses wrap at the end of a row like before
+int const width = get_image_dim(image_cur).x;
+for(int t = l; t < TILE_SIZE * TILE_SIZE; t += PATCH_AREA){
+    int const ty = t / TILE_SIZE;
+    int const tx = t % TILE_SIZE;
+    int const addr = (int)((int)(uv_cur_i.y + ty - PATCH_HALFSIZE) * width + (uv_cur_i.x - PATCH_HALFSIZE)) + tx;
+    tile[ty][tx] = read_imageui(image_cur, sampler, (int2)(addr % width, addr / width)).x;
+}
+barrier(CLK_LOCAL_MEM_FENCE);
+
+int const x = l % PATCH_SIZE;
+int const y = l / PATCH_SIZE;
+float4 const ref = ref_patch[f * PATCH_AREA + l];
+// compute residual, only the top left sample is subtracted as in the former kernel
+float res = ref.x - w_cur_tl * tile[y][x] + w_cur_tr * tile[y][x + 1] +
+            w_cur_bl * tile[y + 1][x] + w_cur_br * tile[y + 1][x + 1];
 // robustification
 float weight = res/scale_; //1.48f * vk::getMedian(errors)
-chi_ += pow(res,2) * weight;
-float3 j_row0 = (float3)((dx * frame_jac[0]), (dx * frame_jac[1]), (dx * frame_jac[2]));
-float3 j_row1 = (float3)((dy * frame_jac[3]), (dy * frame_jac[4]), (dy * frame_jac[5]));
+float3 j_row0 = (float3)((ref.y * frame_jac[0]), (ref.y * frame_jac[1]), (ref.y * frame_jac[2]));
+float3 j_row1 = (float3)((ref.z * frame_jac[3]), (ref.z * frame_jac[4]), (ref.z * frame_jac[5]));
 float3 J = (j_row0 + j_row1) * ((float)F_X / scale);
-compute_hessain(J, &Hessian[f*9], weight);
-Jacobian[f] -= J * res * weight;
-
+terms[0][l] = J.x * J.x * weight;
+terms[1][l] = J.x * J.y * weight;
+terms[2][l] = J.x * J.z * weight;
+terms[3][l] = J.y * J.x * weight;
+terms[4][l] = J.y * J.y * weight;
+terms[5][l] = J.y * J.z * weight;
+terms[6][l] = J.z * J.x * weight;
+terms[7][l] = J.z * J.y * weight;
+terms[8][l] = J.z * J.z * weight;
+float3 const jres = -J * res * weight;
+terms[9][l] = jres.x;
+terms[10][l] = jres.y;
+terms[11][l] = jres.z;
+// used to compute scale for robust cost
+terms[12][l] = fabs(res);
+terms[13][l] = pow(res,2) * weight;
+barrier(CLK_LOCAL_MEM_FENCE);
+for(int stride = PATCH_AREA/2; stride > 0; stride >>= 1){
+    if(l < stride)
+        for(int k = 0; k < RESIDUAL_TERMS; ++k)
+            terms[k][l] += terms[k][l + stride];
+    barrier(CLK_LOCAL_MEM_FENCE);
 }
+if(l == 0){
+    for(int i = 0; i < 9; ++i)Hessian[f*9+i]=terms[i][0];
+    Jacobian[f]=(float3)(terms[9][0], terms[10][0], terms[11][0]);
+    errors[f] = terms[12][0] / pow(PATCH_SIZE,2.0);
+    chi[f]=terms[13][0];
 }
-errors[f] = e / pow(PATCH_SIZE,2.0);
-chi[f]=chi_;
 }
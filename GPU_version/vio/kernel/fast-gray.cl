@@ -4,10 +4,95 @@
 // Enable OpenCL 32-bit integer atomic functions.
 #pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable
 
-__kernel void fast_gray(
+// FAST test of the candidate pixel: two adjacent compass pixels differ by more than threshold and
+// the candidate is at least as bright as the circle.
+bool fast_corner(image2d_t image, sampler_t sampler, int2 const xy, int const threshold)
+{
+    // Read the candidate pixel.
+    int  const p00 = read_imageui(image, sampler, xy).x;
+
+    // Read other pixels in a circle around the candidate pixel.
+    int  const p01 = read_imageui(image, sampler, xy + (int2)( 0,  3)).x;
+    int  const p05 = read_imageui(image, sampler, xy + (int2)( 3,  0)).x;
+    int  const p09 = read_imageui(image, sampler, xy + (int2)( 0, -3)).x;
+    int  const p13 = read_imageui(image, sampler, xy + (int2)(-3,  0)).x;
+
+    // Check the absolute difference of each circle pixel.
+    int  const d01 = (abs(p01 - p00) > threshold);
+    int  const d05 = (abs(p05 - p00) > threshold);
+    int  const d09 = (abs(p09 - p00) > threshold);
+    int  const d13 = (abs(p13 - p00) > threshold);
+
+    // Check if any two adjacent circle pixels have a high absolute difference.
+    if (!((d01 && d05) ||(d05 && d09) ||(d09 && d13) ||(d13 && d01)))
+        return false;
+
+    // Read other pixels in a circle around the candidate pixel.
+    int  const p02 = read_imageui(image, sampler, xy + (int2)( 1,  3)).x;
+    int  const p03 = read_imageui(image, sampler, xy + (int2)( 2,  2)).x;
+    int  const p04 = read_imageui(image, sampler, xy + (int2)( 3,  1)).x;
+    int  const p06 = read_imageui(image, sampler, xy + (int2)( 3, -1)).x;
+    int  const p07 = read_imageui(image, sampler, xy + (int2)( 2, -2)).x;
+    int  const p08 = read_imageui(image, sampler, xy + (int2)( 1, -3)).x;
+    int  const p10 = read_imageui(image, sampler, xy + (int2)(-1, -3)).x;
+    int  const p11 = read_imageui(image, sampler, xy + (int2)(-2, -2)).x;
+    int  const p12 = read_imageui(image, sampler, xy + (int2)(-3, -1)).x;
+    int  const p14 = read_imageui(image, sampler, xy + (int2)(-3,  1)).x;
+    int  const p15 = read_imageui(image, sampler, xy + (int2)(-2,  2)).x;
+    // Select the maximum score.
+    int     sco = p00;
+            sco = max(sco, p01);
+            sco = max(sco, p02);
+            sco = max(sco, p03);
+            sco = max(sco, p04);
+            sco = max(sco, p05);
+            sco = max(sco, p06);
+            sco = max(sco, p07);
+            sco = max(sco, p08);
+            sco = max(sco, p09);
+            sco = max(sco, p10);
+            sco = max(sco, p11);
+            sco = max(sco, p12);
+            sco = max(sco, p13);
+            sco = max(sco, p14);
+            sco = max(sco, p15);
+
+    // Keep this corner if it is as good as the maximum.
+    return p00 >= sco;
+}
+
+// Smaller eigenvalue of the structure tensor of the 8x8 box at xy, vk::shiTomasiScore.
+float shi_tomasi(image2d_t image, sampler_t sampler, int2 const xy)
+{
+    int const w = get_image_width(image);
+    int const h = get_image_height(image);
+    if(xy.x - 4 < 1 || xy.x + 4 >= w - 1 || xy.y - 4 < 1 || xy.y + 4 >= h - 1)
+        return 0.0f; // patch is too close to the boundary
+    float dXX = 0.0f;
+    float dYY = 0.0f;
+    float dXY = 0.0f;
+    for(int y = -4; y < 4; ++y){
+        for(int x = -4; x < 4; ++x){
+            int2 const p = xy + (int2)(x, y);
+            float const dx = (int)read_imageui(image, sampler, p + (int2)(1, 0)).x - (int)read_imageui(image, sampler, p - (int2)(1, 0)).x;
+            float const dy = (int)read_imageui(image, sampler, p + (int2)(0, 1)).x - (int)read_imageui(image, sampler, p - (int2)(0, 1)).x;
+            dXX += dx * dx;
+            dYY += dy * dy;
+            dXY += dx * dy;
+        }
+    }
+    dXX = dXX / 128.0f;
+    dYY = dYY / 128.0f;
+    dXY = dXY / 128.0f;
+    return 0.5f * (dXX + dYY - sqrt((dXX + dYY) * (dXX + dYY) - 4.0f * (dXX * dYY - dXY * dXY)));
+}
+
+// Shi-Tomasi score of every FAST corner, 0 for the other pixels. One work item per pixel, every
+// score is written.
+__kernel void fast_score(
     __read_only  image2d_t   image,
-    __global     int2      * corners,
-    __global     int       * icorner
+                 int         threshold,
+    __global     float     * scores
 ) {
     // Prepare a suitable OpenCL image sampler.
     sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
@@ -15,67 +100,182 @@ __kernel void fast_gray(
     // Use global work item as 2D image coordinates.
     int  const x   = get_global_id(0);
     int  const y   = get_global_id(1);
-    if(x>5 && x<get_image_width(image)-5 && y<get_image_height(image)-5 && y>5){
-        int2 const xy  = (int2)(x, y);
-        // Read the candidate pixel.
-        int  const p00 = read_imageui(image, sampler, xy).x;
-
-        // Read other pixels in a circle around the candidate pixel.
-        int  const p01 = read_imageui(image, sampler, xy + (int2)( 0,  3)).x;
-        int  const p05 = read_imageui(image, sampler, xy + (int2)( 3,  0)).x;
-        int  const p09 = read_imageui(image, sampler, xy + (int2)( 0, -3)).x;
-        int  const p13 = read_imageui(image, sampler, xy + (int2)(-3,  0)).x;
-
-        // Check the absolute difference of each circle pixel.
-        int  const d01 = (abs(p01 - p00) > FAST_THRESH);
-        int  const d05 = (abs(p05 - p00) > FAST_THRESH);
-        int  const d09 = (abs(p09 - p00) > FAST_THRESH);
-        int  const d13 = (abs(p13 - p00) > FAST_THRESH);
-
-        // Check if any two adjacent circle pixels have a high absolute difference.
-
-        if ((d01 && d05) ||(d05 && d09) ||(d09 && d13) ||(d13 && d01)) {
-                // Read other pixels in a circle around the candidate pixel.
-            int  const p02 = read_imageui(image, sampler, xy + (int2)( 1,  3)).x;
-            int  const p03 = read_imageui(image, sampler, xy + (int2)( 2,  2)).x;
-            int  const p04 = read_imageui(image, sampler, xy + (int2)( 3,  1)).x;
-            int  const p06 = read_imageui(image, sampler, xy + (int2)( 3, -1)).x;
-            int  const p07 = read_imageui(image, sampler, xy + (int2)( 2, -2)).x;
-            int  const p08 = read_imageui(image, sampler, xy + (int2)( 1, -3)).x;
-            int  const p10 = read_imageui(image, sampler, xy + (int2)(-1, -3)).x;
-            int  const p11 = read_imageui(image, sampler, xy + (int2)(-2, -2)).x;
-            int  const p12 = read_imageui(image, sampler, xy + (int2)(-3, -1)).x;
-            int  const p14 = read_imageui(image, sampler, xy + (int2)(-3,  1)).x;
-            int  const p15 = read_imageui(image, sampler, xy + (int2)(-2,  2)).x;
-            int  const p16 = read_imageui(image, sampler, xy + (int2)(-1,  3)).x;
-            // Select the maximum score.
-            int     sco = p00;
-                    sco = max(sco, p01);
-                    sco = max(sco, p02);
-                    sco = max(sco, p03);
-                    sco = max(sco, p04);
-                    sco = max(sco, p05);
-                    sco = max(sco, p06);
-                    sco = max(sco, p07);
-                    sco = max(sco, p08);
-                    sco = max(sco, p09);
-                    sco = max(sco, p10);
-                    sco = max(sco, p11);
-                    sco = max(sco, p12);
-                    sco = max(sco, p13);
-                    sco = max(sco, p14);
-                    sco = max(sco, p15);
+    int  const w   = get_image_width(image);
+    if(x >= w || y >= get_image_height(image))
+        return;
+    int2 const xy  = (int2)(x, y);
+    float score = 0.0f;
+    if(x>5 && x<w-5 && y<get_image_height(image)-5 && y>5 && fast_corner(image, sampler, xy, threshold))
+        score = shi_tomasi(image, sampler, xy);
+    scores[y * w + x] = score;
+}
 
-            // Keep this score if it is as good as the maximum.
-            if (p00 >= sco) {
-                // Atomically append to corner buffer.
-                int const icorn = atom_inc(icorner);
-                if (icorn < 262144)
-                    corners[icorn] = xy;
+// 3x3 non-maximum suppression of the scores and the cell_corners best corners of each grid cell.
+// One work item per cell, cells are cell_size pixels of level 0, a pixel of the level belongs to
+// the cell of (x << level, y << level). Ties go to the first pixel in raster order. Every cell has
+// cell_corners slots in cell_xy and cell_scores, sorted by decreasing score, and its count in
+// cell_count; compact_corners makes the result of them.
+__kernel void select_corners(
+    __global     float     * scores,
+                 int         width,
+                 int         height,
+                 int         level,
+                 int         cell_size,
+                 int         cell_corners,
+    __global     int2      * cell_xy,
+    __global     float     * cell_scores,
+    __global     int       * cell_count
+) {
+    int const cx = get_global_id(0);
+    int const cy = get_global_id(1);
+    int const cell = cy * get_global_size(0) + cx;
+    int const round = (1 << level) - 1;
+    int const x0 = (cx * cell_size + round) >> level;
+    int const y0 = (cy * cell_size + round) >> level;
+    int const x1 = min(((cx + 1) * cell_size + round) >> level, width);
+    int const y1 = min(((cy + 1) * cell_size + round) >> level, height);
+    float best[MAX_CELL_CORNERS];
+    int2  best_xy[MAX_CELL_CORNERS];
+    int   n = 0;
+    for(int y = y0; y < y1; ++y){
+        for(int x = x0; x < x1; ++x){
+            float const v = scores[y * width + x];
+            if(v <= 0.0f)
+                continue;
+            bool keep = true;
+            for(int dy = -1; dy <= 1 && keep; ++dy){
+                for(int dx = -1; dx <= 1; ++dx){
+                    int const nx = x + dx;
+                    int const ny = y + dy;
+                    if((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= width || ny >= height)
+                        continue;
+                    float const u = scores[ny * width + nx];
+                    if(u > v || (u == v && (dy < 0 || (dy == 0 && dx < 0)))){
+                        keep = false;
+                        break;
+                    }
+                }
             }
+            if(!keep)
+                continue;
+            // insert into the list of the best corners, sorted by decreasing score
+            int i;
+            if(n < cell_corners)
+                i = n++;
+            else if(v > best[cell_corners - 1])
+                i = cell_corners - 1;
+            else
+                continue;
+            for(; i > 0 && best[i - 1] < v; --i){
+                best[i] = best[i - 1];
+                best_xy[i] = best_xy[i - 1];
+            }
+            best[i] = v;
+            best_xy[i] = (int2)(x, y);
         }
+    }
+    cell_count[cell] = n;
+    for(int i = 0; i < n; ++i){
+        cell_xy[cell * cell_corners + i] = best_xy[i];
+        cell_scores[cell * cell_corners + i] = best[i];
+    }
+}
 
+// Exclusive prefix sum of v over the work-group, the sum of all in *total.
+int group_scan(__local int * s, int const l, int const v, int * total)
+{
+    s[l] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int offset = 1; offset < COMPACT_GROUP_SIZE; offset <<= 1){
+        int const t = l >= offset ? s[l - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        s[l] += t;
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
-    
+    *total = s[COMPACT_GROUP_SIZE - 1];
+    int const sum = s[l] - v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return sum;
 }
 
+// The max_corners best corners of the cells of select_corners, one work-group of
+// COMPACT_GROUP_SIZE. The score of the max_corners-th best is found by a radix select over the
+// bits of the positive float scores (8 bits per pass), corners of that score are taken in slot
+// order. The result is in slot order: cells in raster order, by decreasing score within a cell.
+// count is the number of corners of all cells, only min(count, max_corners) are stored.
+__kernel __attribute__((reqd_work_group_size(COMPACT_GROUP_SIZE, 1, 1)))
+void compact_corners(
+    __global     int2      * cell_xy,
+    __global     float     * cell_scores,
+    __global     int       * cell_count,
+                 int         n_cells,
+                 int         cell_corners,
+                 int         max_corners,
+    __global     int2      * corners,
+    __global     float     * corner_scores,
+    __global     int       * count
+) {
+    __local int hist[256];
+    __local int scan[COMPACT_GROUP_SIZE];
+    __local uint prefix;
+    __local uint mask;
+    __local int rank;
+    __local int total;
+    int const l = get_local_id(0);
+    int const n = n_cells * cell_corners;
+    if(l == 0){
+        prefix = 0;
+        mask = 0;
+        rank = max_corners;
+    }
+    for(int shift = 24; shift >= 0; shift -= 8){
+        for(int b = l; b < 256; b += COMPACT_GROUP_SIZE)
+            hist[b] = 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for(int j = l; j < n; j += COMPACT_GROUP_SIZE){
+            uint const key = as_uint(cell_scores[j]);
+            if(j % cell_corners < cell_count[j / cell_corners] && (key & mask) == prefix)
+                atomic_inc(&hist[(key >> shift) & 255]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(l == 0){
+            if(shift == 24){
+                total = 0;
+                for(int b = 0; b < 256; ++b)
+                    total += hist[b];
+            }
+            // the bin of the rank-th largest key among the keys matching prefix
+            int b = 255;
+            for(; b > 0 && hist[b] < rank; --b)
+                rank -= hist[b];
+            prefix |= (uint)b << shift;
+            mask |= 255u << shift;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(total <= max_corners)
+            break;
+    }
+    // all corners if they fit: every score is above 0, otherwise the keys above prefix and the
+    // first rank keys equal to it
+    uint const threshold = total <= max_corners ? 0 : prefix;
+    int const ties = total <= max_corners ? 0 : rank;
+    int ties_before = 0;
+    int stored = 0;
+    for(int base = 0; base < n; base += COMPACT_GROUP_SIZE){
+        int const j = base + l;
+        int const valid = j < n && j % cell_corners < cell_count[j / cell_corners];
+        uint const key = valid ? as_uint(cell_scores[j]) : 0;
+        int ties_chunk, stored_chunk;
+        int const tie = group_scan(scan, l, valid && key == threshold, &ties_chunk) + ties_before;
+        int const take = valid && (key > threshold || (key == threshold && tie < ties));
+        int const slot = group_scan(scan, l, take, &stored_chunk) + stored;
+        if(take){
+            corners[slot] = cell_xy[j];
+            corner_scores[slot] = cell_scores[j];
+        }
+        ties_before += ties_chunk;
+        stored += stored_chunk;
+    }
+    if(l == 0)
+        count[0] = total;
+}
@@ -1,129 +1,100 @@
-void meanIntensity( image2d_t _image, image2d_t _integral, float kp_x, float kp_y,
-							  int scale, int rot, int* point, float3* patternLookupPtr, uchar* output)
-{
-    // Prepare a suitable OpenCL image sampler.
-    sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
-    // get point position in image
-    float3* FreakPoint = patternLookupPtr + (scale * FREAK_NB_ORIENTATION * FREAK_NB_POINTS + rot * FREAK_NB_POINTS + (*point));
-    float xf = FreakPoint->x + kp_x;
-    float yf = FreakPoint->y + kp_y;
-    int x = (int)xf;
-    int y = (int)yf;
+// Copyright (C) 2021  Majid Geravand
+// Copyright (C) 2021  Gfuse
 
-    // get the sigma:
-    float radius = FreakPoint->z;//sigma
+// FREAK descriptors of cv::xfeatures2d::FREAK with the tables of vio::FreakPattern, uploaded once.
+// FREAK_NB_ORIENTATION, FREAK_NB_POINTS, FREAK_NB_ORIENPAIRS and FREAK_NB_PAIRS come from the build
+// options.
 
-    // calculate output:
-    if( radius < 0.5 )
-    {
-        // interpolation multipliers:
-        const int r_x = (int)((xf - x) * 1024);
-        const int r_y = (int)((yf - y) * 1024);
-        const int r_x_1 = (1024 - r_x);
-        const int r_y_1 = (1024 - r_y);
-        uint ret_val;
-        // linear interpolation:
-        ret_val = (r_x_1 * r_y_1 * (int)(read_imageui(_image, sampler, (int2)(y  , x  ))).x)
-                + (r_x   * r_y_1 * (int)(read_imageui(_image, sampler, (int2)(y  , x+1))).x)
-                + (r_x_1 * r_y   * (int)(read_imageui(_image, sampler, (int2)(y+1, x  ))).x)
-                + (r_x   * r_y   * (int)(read_imageui(_image, sampler, (int2)(y+1, x+1))).x);
-        // return the rounded mean
+// Mean intensity of a pattern point: the box of radius sigma around the point from the integral
+// image, bilinear interpolation for small boxes. Rounded like FREAK::meanIntensity.
+uchar mean_intensity(
+    image2d_t image, sampler_t sampler, __global const int* integral, int const step,
+    float2 const kp, float2 const offset, float const sigma)
+{
+    float const xf = offset.x + kp.x;
+    float const yf = offset.y + kp.y;
+    int   const x  = (int)xf;
+    int   const y  = (int)yf;
+    if(sigma < 0.5f){
+        int const r_x   = (int)((xf - x) * 1024);
+        int const r_y   = (int)((yf - y) * 1024);
+        int const r_x_1 = 1024 - r_x;
+        int const r_y_1 = 1024 - r_y;
+        uint ret_val = r_x_1 * r_y_1 * (int)read_imageui(image, sampler, (int2)(x    , y    )).x
+                     + r_x   * r_y_1 * (int)read_imageui(image, sampler, (int2)(x + 1, y    )).x
+                     + r_x_1 * r_y   * (int)read_imageui(image, sampler, (int2)(x    , y + 1)).x
+                     + r_x   * r_y   * (int)read_imageui(image, sampler, (int2)(x + 1, y + 1)).x;
         ret_val += 2 * 1024 * 1024;
-        output[*point] = (uchar)(ret_val / (4 * 1024 * 1024));
+        return (uchar)(ret_val / (4 * 1024 * 1024));
     }
-
-    // calculate borders
-    const int x_left   = round(xf - radius);
-    const int y_top    = round(yf - radius);
-    const int x_right  = round(xf + radius + 1); // integral image is 1px wider
-    const int y_bottom = round(yf + radius + 1); // integral image is 1px higher
-    int ret_val;
-
-    ret_val  = read_imageui(_integral, sampler, (int2)(y_bottom, x_right)).x; // bottom right corner
-    ret_val -= read_imageui(_integral, sampler, (int2)(y_bottom, x_left)).x; // bottom left corner
-    ret_val += read_imageui(_integral, sampler, (int2)(y_top,    x_left)).x; // top left corner
-    ret_val -= read_imageui(_integral, sampler, (int2)(y_top,    x_right)).x; // top right corner
-    const int area = (x_right - x_left) * (y_bottom - y_top);
-    ret_val = (ret_val + area / 2) / area;
-    output[*point] = (uchar)(ret_val);
+    // cvRound rounds half to even like rint, the integral image is one pixel larger
+    int const x_left   = (int)rint(xf - sigma);
+    int const y_top    = (int)rint(yf - sigma);
+    int const x_right  = (int)rint(xf + sigma + 1);
+    int const y_bottom = (int)rint(yf + sigma + 1);
+    int ret_val = integral[y_bottom * step + x_right]
+                - integral[y_bottom * step + x_left]
+                + integral[y_top    * step + x_left]
+                - integral[y_top    * step + x_right];
+    int const area = (x_right - x_left) * (y_bottom - y_top);
+    return (uchar)((ret_val + area / 2) / area);
 }
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void freak(
-    __global		image2d_t*	image, // grayescale image
-	__global		image2d_t*	imgIntegral,
-    __global		float4*			keypoints, // ptx, pty, angle
-    __global		uchar*			descriptors, // kp_size * (64 = NB_PAIRS/8) - CV_8U with zero values
-	__global		int*				patternSizes, // array size : NB_SCALES = 64
-	__global		int4*				orientationPairs, // array size : FREAK_NB_ORIENTATION = 256
-	__global		float3*			patternLookup, // array size : NB_SCALES(64) * FREAK_NB_ORIENTATION(256) * FREAK_NB_POINTS(43)
-	__global		uchar2*			descriptionPairs, // array size : NB_PAIRS = 512
-	__global		int*				nOctaves,
-	__global		int*				kpScaleIdx //array size = kp_size - used to save pattern scale index corresponding to each keypoints
-	)
-{
-    const float sizeCst = (float)(NB_SCALES / (FREAK_LOG2 * *nOctaves));
-    uchar pointsValue[FREAK_NB_POINTS];
-    int thetaIdx = 0;
-    int direction0;
-    int direction1;
-
-	int k = get_global_id(0);
-
-    kpScaleIdx[k] = max( (int)(log(7.0 / FREAK_SMALLEST_KP_SIZE) * sizeCst + 0.5) ,0);
-    if( kpScaleIdx[k] >= NB_SCALES )
-        kpScaleIdx[k] = NB_SCALES - 1;
-
-    if( keypoints[k].x <= patternSizes[kpScaleIdx[k]] || // check if the description at this specific position and scale fits inside the image
-        keypoints[k].y <= patternSizes[kpScaleIdx[k]] ||
-        keypoints[k].x >= get_image_dim(image[(int)keypoints[k].w]).y - patternSizes[kpScaleIdx[k]] ||
-        keypoints[k].y >= get_image_dim(image[(int)keypoints[k].w]).x - patternSizes[kpScaleIdx[k]])
-		return;
 
-        // get the points intensity value in the un-rotated pattern
-        for( int i = FREAK_NB_POINTS; i--; )
-        {
-            meanIntensity(image[(int)keypoints[k].w], imgIntegral[(int)keypoints[k].w], keypoints[k].x, keypoints[k].y,
-                          *(kpScaleIdx + k), 0, &i, patternLookup, pointsValue);
-        }
-        direction0 = 0;
-        direction1 = 0;
-        for( int m = 45; m--; )
-        {
-            // iterate through the orientation pairs
-            const int delta = (pointsValue[ orientationPairs[m].w ] - pointsValue[ orientationPairs[m].x ]);
-            direction0 += delta * (orientationPairs[m].y) / 2048; // weight_dx
-            direction1 += delta * (orientationPairs[m].z) / 2048; // weight_dy
-        }
-
-        thetaIdx = round(FREAK_NB_ORIENTATION *
-						(float)(atan2((float)direction1,(float)direction0) * (180.0 / 3.141592653589793238462643383279502884197169399375)) *
-						(1 / 360.0));
-
-        if( thetaIdx < 0 )
-            thetaIdx += FREAK_NB_ORIENTATION;
-
-        if( thetaIdx >= FREAK_NB_ORIENTATION )
-            thetaIdx -= FREAK_NB_ORIENTATION;
-
-        // extract descriptor at the computed orientation
-        for( int i = FREAK_NB_POINTS; i--; )
-        {
-            meanIntensity(image[(int)keypoints[k].w], imgIntegral[(int)keypoints[k].w], keypoints[k].x, keypoints[k].y,
-                          *(kpScaleIdx + k), thetaIdx, &i, patternLookup, pointsValue);
-        }
+// One work item per keypoint: orientation from the unrotated pattern, the pairs of the rotated
+// pattern packed in the bit order of OpenCV (FreakPattern::descriptorByte/descriptorBit). The
+// keypoints are inside the pattern border of their scale.
+__kernel void freak_describe(
+    __read_only  image2d_t   image,
+    __global     int       * integral,          // of image, cols+1 ints per row
+    __global     float2    * keypoints,
+    __global     int       * scales,            // pattern scale of each keypoint
+                 int         n,
+    __global     float2    * points,            // [scale][orientation][point]
+    __global     float     * sigmas,            // [scale][point]
+    __global     int4      * orientation_pairs, // i, j, weight_dx, weight_dy
+    __global     uchar2    * description_pairs,
+    __global     uchar     * descriptors        // 64 bytes per keypoint
+) {
+    sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
 
-        // Extract descriptor
-		int cnt = 0;
-        for( int n = 0; n<4; n++ )
-        {
-			for (int m = 8; m >= 1; m--)
-			{
-				for(int kk = (n*16)+15; kk >= (n*16); --kk, ++cnt)
-				{
-					descriptors[(int)keypoints[k].w*300*64 + (k * 64) + kk] *= 2;
-					if (pointsValue[(int)descriptionPairs[cnt].x] >= pointsValue[(int)descriptionPairs[cnt].y])
-						descriptors[(int)keypoints[k].w*300*64 + (k * 64) + kk] += 1;
-				}
-			}
-        }
-}
\ No newline at end of file
+    int const k = get_global_id(0);
+    if(k >= n)
+        return;
+    int    const step  = get_image_width(image) + 1;
+    float2 const kp    = keypoints[k];
+    int    const scale = scales[k];
+    __global float2 const* pattern = points + scale * FREAK_NB_ORIENTATION * FREAK_NB_POINTS;
+    __global float  const* sigma   = sigmas + scale * FREAK_NB_POINTS;
+    uchar values[FREAK_NB_POINTS];
+    for(int i = 0; i < FREAK_NB_POINTS; ++i)
+        values[i] = mean_intensity(image, sampler, integral, step, kp, pattern[i], sigma[i]);
+    int direction0 = 0;
+    int direction1 = 0;
+    for(int m = 0; m < FREAK_NB_ORIENPAIRS; ++m){
+        int4 const pair  = orientation_pairs[m];
+        int  const delta = values[pair.x] - values[pair.y];
+        direction0 += delta * pair.z / 2048;
+        direction1 += delta * pair.w / 2048;
+    }
+    float const angle = atan2((float)direction1, (float)direction0) * 57.29577951308232f;
+    int theta = angle < 0.0f ? (int)(FREAK_NB_ORIENTATION * angle / 360.0f - 0.5f)
+                             : (int)(FREAK_NB_ORIENTATION * angle / 360.0f + 0.5f);
+    if(theta < 0)
+        theta += FREAK_NB_ORIENTATION;
+    if(theta >= FREAK_NB_ORIENTATION)
+        theta -= FREAK_NB_ORIENTATION;
+    pattern += theta * FREAK_NB_POINTS;
+    for(int i = 0; i < FREAK_NB_POINTS; ++i)
+        values[i] = mean_intensity(image, sampler, integral, step, kp, pattern[i], sigma[i]);
+    uchar desc[FREAK_NB_PAIRS / 8];
+    for(int i = 0; i < FREAK_NB_PAIRS / 8; ++i)
+        desc[i] = 0;
+    for(int c = 0; c < FREAK_NB_PAIRS; ++c){
+        uchar2 const pair = description_pairs[c];
+        if(values[pair.x] >= values[pair.y])
+            desc[(c >> 7) * 16 + 15 - (c & 15)] |= (uchar)(1 << ((c >> 4) & 7));
+    }
+    __global uchar* out = descriptors + k * (FREAK_NB_PAIRS / 8);
+    for(int i = 0; i < FREAK_NB_PAIRS / 8; ++i)
+        out[i] = desc[i];
+}
@@ -0,0 +1,22 @@
+// Copyright (C) 2021  Majid Geravand
+// Copyright (C) 2021  Gfuse
+
+// One pyramid level from the one above, mean of every 2x2 block truncated like the scalar
+// path of vk::halfSample. One work item per output pixel.
+__kernel void half_sample(
+    __read_only  image2d_t   in,
+    __write_only image2d_t   out
+) {
+    sampler_t const sampler = CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+    int  const x   = get_global_id(0);
+    int  const y   = get_global_id(1);
+    if(x>=get_image_width(out) || y>=get_image_height(out))
+        return;
+    int2 const xy  = (int2)(2*x, 2*y);
+    uint const sum = read_imageui(in, sampler, xy).x
+                   + read_imageui(in, sampler, xy + (int2)(1, 0)).x
+                   + read_imageui(in, sampler, xy + (int2)(0, 1)).x
+                   + read_imageui(in, sampler, xy + (int2)(1, 1)).x;
+    write_imageui(out, (int2)(x, y), (uint4)(sum/4, 0, 0, 0));
+}
@@ -1,14 +1,44 @@
-__kernel void integral_image(
-    __read_only	    image2d_t*	int_img, // grayescale image - height X width
-	__write_only	image2d_t*	out_img // (height+1) X (width+1) with zero values
-	)
-{
-	sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
-	int k = get_global_id(0)
-    int2 coord = (int2)(get_global_id(1)+1, get_global_id(2)+1);
-	int res = 0;
-	for (int i = 0; i < coord.x; i++)
-		for (int j = 0; j < coord.y; j++)
-			res += read_imageui(int_img[k], sampler, (int2)(i, j)); // bottom right corner
-	write_imageui(out_img[k], coord, res);
-}
\ No newline at end of file
+// Copyright (C) 2021  Majid Geravand
+// Copyright (C) 2021  Gfuse
+
+// Integral image of the FREAK box filters, (width+1) x (height+1) ints with a zero first row and
+// column like cv::integral: integral[y][x] is the sum of the pixels above and left of (x, y).
+// Two prefix-sum passes, integral_rows and then integral_cols.
+
+// Prefix sums along the rows of the image, one work item per image row.
+__kernel void integral_rows(
+    __read_only  image2d_t   image,
+    __global     int       * integral
+) {
+    sampler_t const sampler = CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
+
+    int  const y   = get_global_id(0);
+    int  const w   = get_image_width(image);
+    if(y >= get_image_height(image))
+        return;
+    __global int* row = integral + (y + 1) * (w + 1);
+    int sum = 0;
+    row[0] = 0;
+    for(int x = 0; x < w; ++x){
+        sum += read_imageui(image, sampler, (int2)(x, y)).x;
+        row[x + 1] = sum;
+    }
+}
+
+// Prefix sums along the columns of the row sums, one work item per column of the integral image.
+__kernel void integral_cols(
+                 int         width,
+                 int         height,
+    __global     int       * integral
+) {
+    int  const x    = get_global_id(0);
+    int  const step = width + 1;
+    if(x >= step)
+        return;
+    integral[x] = 0;
+    int sum = 0;
+    for(int y = 1; y <= height; ++y){
+        sum += integral[y * step + x];
+        integral[y * step + x] = sum;
+    }
+}
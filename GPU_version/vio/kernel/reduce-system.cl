@@ -0,0 +1,51 @@
+// Copyright (C) 2021  Majid Geravand
+// Copyright (C) 2021  Gfuse
+
+// Terms of sums, written by reduce_system:
+// [0] error, [1] chi2, [2..10] Hessian (row major), [11..13] b.
+#define REDUCE_TERMS 14
+
+// Sums over the features of the outputs of compute_residual, launched as a single work-group of
+// REDUCE_GROUP_SIZE work items. Every work item adds a strided subset of the features, a tree in
+// local memory adds the partial sums. The sums are those of the former host loop: feature 0 is
+// taken as it is, NaN terms of the other features are skipped in H and b and their Jacobian
+// terms are subtracted.
+__kernel void reduce_system(
+        __global     float       * errors,
+        __global     float       * Hessian,
+        __global     float3      * Jacobian,
+        __global     float       * chi,
+                     int           n,
+        __global     float       * sums
+)
+{
+    __local float partial[REDUCE_TERMS][REDUCE_GROUP_SIZE];
+    int const l = get_local_id(0);
+    float acc[REDUCE_TERMS];
+    for(int k = 0; k < REDUCE_TERMS; ++k)
+        acc[k] = 0.0f;
+    for(int f = l; f < n; f += REDUCE_GROUP_SIZE){
+        acc[0] += errors[f];
+        acc[1] += chi[f];
+        for(int k = 0; k < 9; ++k){
+            float const h = Hessian[f*9 + k];
+            acc[2 + k] += (f == 0) ? h : (isnan(h) ? 0.0f : h);
+        }
+        float3 const j = Jacobian[f];
+        float const jf[3] = {j.x, j.y, j.z};
+        for(int k = 0; k < 3; ++k)
+            acc[11 + k] += (f == 0) ? jf[k] : (isnan(jf[k]) ? 0.0f : -jf[k]);
+    }
+    for(int k = 0; k < REDUCE_TERMS; ++k)
+        partial[k][l] = acc[k];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int stride = REDUCE_GROUP_SIZE/2; stride > 0; stride >>= 1){
+        if(l < stride)
+            for(int k = 0; k < REDUCE_TERMS; ++k)
+                partial[k][l] += partial[k][l + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if(l == 0)
+        for(int k = 0; k < REDUCE_TERMS; ++k)
+            sums[k] = partial[k][0];
+}
@@ -0,0 +1,249 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/async_logger.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace vio {
+
+namespace {
+
+const char kMagic[8] = {'V','I','O','L','O','G','0','1'};
+const char kFormatTag = 'F';
+const char kRecordTag = 'R';
+
+} // namespace
+
+AsyncLogger::AsyncLogger(const std::string& path) :
+  file_(fopen(path.c_str(), "wb")),
+  cells_(new Cell[kQueueSize]),
+  enqueue_pos_(0),
+  dequeue_pos_(0),
+  dropped_(0),
+  written_(0),
+  running_(true),
+  thread_(NULL)
+{
+  for(size_t i=0; i<kQueueSize; ++i)
+    cells_[i].seq.store(i, std::memory_order_relaxed);
+  if(file_ == NULL)
+    return;
+  fwrite(kMagic, 1, sizeof(kMagic), file_);
+  thread_ = new boost::thread(&AsyncLogger::drainLoop, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+  running_ = false;
+  if(thread_ != NULL)
+  {
+    thread_->join();
+    delete thread_;
+  }
+  if(file_ != NULL)
+  {
+    drain();
+    if(dropped() > 0)
+    {
+      Record r;
+      r.stamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      r.format = "async logger dropped %d records\n";
+      r.types = 0;
+      r.n_args = 1;
+      r.args[0].i = static_cast<int64_t>(dropped());
+      writeRecord(r);
+    }
+    fclose(file_);
+  }
+  delete[] cells_;
+}
+
+// bounded multi-producer queue, D. Vyukov
+bool AsyncLogger::push(const Record& r)
+{
+  if(file_ == NULL)
+    return false;
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Cell* cell;
+  for(;;)
+  {
+    cell = &cells_[pos & (kQueueSize-1)];
+    const size_t seq = cell->seq.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if(diff == 0)
+    {
+      if(enqueue_pos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+        break;
+    }
+    else if(diff < 0)
+      return false;
+    else
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+  }
+  cell->record = r;
+  cell->seq.store(pos+1, std::memory_order_release);
+  return true;
+}
+
+bool AsyncLogger::pop(Record& r)
+{
+  Cell* cell = &cells_[dequeue_pos_ & (kQueueSize-1)];
+  if(cell->seq.load(std::memory_order_acquire) != dequeue_pos_+1)
+    return false;
+  r = cell->record;
+  cell->seq.store(dequeue_pos_+kQueueSize, std::memory_order_release);
+  ++dequeue_pos_;
+  return true;
+}
+
+size_t AsyncLogger::drain()
+{
+  size_t n = 0;
+  Record r;
+  while(pop(r))
+  {
+    writeRecord(r);
+    ++n;
+  }
+  if(n > 0)
+    fflush(file_);
+  written_.store(dequeue_pos_, std::memory_order_release);
+  return n;
+}
+
+void AsyncLogger::drainLoop()
+{
+  while(running_)
+    if(drain() == 0)
+      usleep(2000);
+}
+
+void AsyncLogger::flush()
+{
+  const size_t target = enqueue_pos_.load(std::memory_order_acquire);
+  while(thread_ != NULL && written_.load(std::memory_order_acquire) < target)
+    usleep(1000);
+}
+
+void AsyncLogger::writeRecord(const Record& r)
+{
+  // the format text is written once, records refer to it by id
+  uint16_t id = std::find(formats_.begin(), formats_.end(), r.format) - formats_.begin();
+  if(id == formats_.size())
+  {
+    formats_.push_back(r.format);
+    const uint16_t len = static_cast<uint16_t>(strlen(r.format));
+    fputc(kFormatTag, file_);
+    fwrite(&id, sizeof(id), 1, file_);
+    fwrite(&len, sizeof(len), 1, file_);
+    fwrite(r.format, 1, len, file_);
+  }
+  fputc(kRecordTag, file_);
+  fwrite(&r.stamp_ns, sizeof(r.stamp_ns), 1, file_);
+  fwrite(&id, sizeof(id), 1, file_);
+  fwrite(&r.n_args, sizeof(r.n_args), 1, file_);
+  fwrite(&r.types, sizeof(r.types), 1, file_);
+  fwrite(r.args, sizeof(r.args[0]), r.n_args, file_);
+}
+
+namespace {
+
+/// printf with the stored arguments, the conversions are adapted to int64/double.
+void printRecord(FILE* out, const std::string& format, const AsyncLogger::Record& r)
+{
+  size_t arg = 0;
+  for(size_t i=0; i<format.size(); ++i)
+  {
+    if(format[i] != '%')
+    {
+      fputc(format[i], out);
+      continue;
+    }
+    if(i+1 < format.size() && format[i+1] == '%')
+    {
+      fputc('%', out);
+      ++i;
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion
+    size_t end = i+1;
+    while(end < format.size() && strchr("-+ #0123456789.*", format[end]))
+      ++end;
+    std::string spec = format.substr(i, end-i);
+    while(end < format.size() && strchr("hlLqjzt", format[end]))
+      ++end;
+    if(end >= format.size())
+      break;
+    const char conv = format[end];
+    i = end;
+    if(arg >= r.n_args)
+    {
+      fputs("<?>", out);
+      continue;
+    }
+    const bool is_double = r.types & (1<<arg);
+    const double d = is_double ? r.args[arg].d : static_cast<double>(r.args[arg].i);
+    const long long ll = is_double ? static_cast<long long>(r.args[arg].d) : r.args[arg].i;
+    ++arg;
+    if(conv == 'c')
+      fprintf(out, (spec+conv).c_str(), static_cast<int>(ll));
+    else if(strchr("diouxX", conv))
+      fprintf(out, (spec+"ll"+conv).c_str(), ll);
+    else if(strchr("fFeEgGaA", conv))
+      fprintf(out, (spec+conv).c_str(), d);
+    else
+      fputs("<?>", out);
+  }
+}
+
+} // namespace
+
+bool decodeBinaryLog(FILE* in, FILE* out)
+{
+  char magic[sizeof(kMagic)];
+  if(fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    return false;
+  std::vector<std::string> formats;
+  int tag;
+  while((tag = fgetc(in)) != EOF)
+  {
+    uint16_t id;
+    if(tag == kFormatTag)
+    {
+      uint16_t len;
+      if(fread(&id, sizeof(id), 1, in) != 1 || fread(&len, sizeof(len), 1, in) != 1)
+        return false;
+      std::string format(len, '\0');
+      if(fread(&format[0], 1, len, in) != len)
+        return false;
+      if(formats.size() <= id)
+        formats.resize(id+1);
+      formats[id] = format;
+    }
+    else if(tag == kRecordTag)
+    {
+      AsyncLogger::Record r;
+      if(fread(&r.stamp_ns, sizeof(r.stamp_ns), 1, in) != 1 || fread(&id, sizeof(id), 1, in) != 1
+         || fread(&r.n_args, sizeof(r.n_args), 1, in) != 1 || fread(&r.types, sizeof(r.types), 1, in) != 1
+         || r.n_args > AsyncLogger::kMaxArgs || fread(r.args, sizeof(r.args[0]), r.n_args, in) != r.n_args
+         || id >= formats.size())
+        return false;
+      const time_t sec = static_cast<time_t>(r.stamp_ns/1000000000ull);
+      struct tm bt;
+      localtime_r(&sec, &bt);
+      fprintf(out, "[%02d:%02d:%02d.%03d] ", bt.tm_hour, bt.tm_min, bt.tm_sec,
+              static_cast<int>((r.stamp_ns/1000000ull)%1000));
+      printRecord(out, formats[id], r);
+    }
+    else
+      return false;
+  }
+  return true;
+}
+
+} // namespace vio
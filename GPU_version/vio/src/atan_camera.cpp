@@ -7,6 +7,7 @@
 
 
 #include <math.h>
+#include <algorithm>
 #include <vio/atan_camera.h>
 #include <vio/math_utils.h>
 
@@ -36,17 +37,60 @@ ATANCamera(double width, double height,
     tans_ = 0.0;
     distortion_ = false;
   }
-  param_ = (double *) malloc(5 * sizeof(double));
+  param_ = new double[6];
+
+  // cam2worldExact steps at the distorted radius 0.01, the cells across the step are not interpolated
+  const double cell = 1.5 * std::max(fx_inv_, fy_inv_);
+  lut_r2_min_ = distortion_ ? pow(std::max(0.01 - cell, 0.0), 2) : 0.0;
+  lut_r2_max_ = distortion_ ? pow(0.01 + cell, 2) : 0.0;
+
+  // bearings of the pixels, cam2world interpolates between them instead of calling tan
+  bearing_lut_.resize(3 * width_ * height_);
+  for(int y=0; y<height_; ++y)
+    for(int x=0; x<width_; ++x)
+    {
+      const Vector3d f = cam2worldExact(x, y);
+      float* b = &bearing_lut_[3 * (y * width_ + x)];
+      b[0] = f[0];
+      b[1] = f[1];
+      b[2] = f[2];
+    }
 }
 
 ATANCamera::
 ~ATANCamera()
 {
-    delete param_;
+    delete[] param_;
 }
 
 Vector3d ATANCamera::
 cam2world(const double& x, const double& y) const
+{
+  // bilinear between the bearings of the four pixels around, outside them the exact model
+  if(!(x >= 0.0 && y >= 0.0 && x < width_ - 1 && y < height_ - 1))
+    return cam2worldExact(x, y);
+  const double dist_x = (x - cx_) * fx_inv_;
+  const double dist_y = (y - cy_) * fy_inv_;
+  const double dist_r2 = dist_x * dist_x + dist_y * dist_y;
+  if(dist_r2 > lut_r2_min_ && dist_r2 < lut_r2_max_)
+    return cam2worldExact(x, y);
+  const int x0 = (int) x;
+  const int y0 = (int) y;
+  const float wx = x - x0;
+  const float wy = y - y0;
+  const float w_tl = (1.0f - wx) * (1.0f - wy);
+  const float w_tr = wx * (1.0f - wy);
+  const float w_bl = (1.0f - wx) * wy;
+  const float w_br = wx * wy;
+  const float* t = &bearing_lut_[3 * (y0 * width_ + x0)];
+  const float* b = t + 3 * width_;
+  return Vector3d(w_tl * t[0] + w_tr * t[3] + w_bl * b[0] + w_br * b[3],
+                  w_tl * t[1] + w_tr * t[4] + w_bl * b[1] + w_br * b[4],
+                  w_tl * t[2] + w_tr * t[5] + w_bl * b[2] + w_br * b[5]).normalized();
+}
+
+Vector3d ATANCamera::
+cam2worldExact(double x, double y) const
 {
   Vector2d dist_cam((x - cx_) * fx_inv_,
                     (y - cy_) * fy_inv_);
@@ -83,4 +127,41 @@ world2cam(const Vector2d& uv) const
                   cy_ + fy_ * dist_cam[1]);
 }
 
+void ATANCamera::
+world2cam(size_t n, const double* x, const double* y, const double* z, double* u, double* v) const
+{
+  double r = r_;
+  for(size_t i=0; i<n; ++i)
+  {
+    const double z_inv = 1.0 / z[i];
+    const double uv_x = x[i] * z_inv;
+    const double uv_y = y[i] * z_inv;
+    r = sqrt(uv_x*uv_x + uv_y*uv_y);
+    const double factor = rtrans_factor(r);
+    u[i] = cx_ + fx_ * factor * uv_x;
+    v[i] = cy_ + fy_ * factor * uv_y;
+  }
+  r_ = r; // as after the last world2cam call
+}
+
+void ATANCamera::
+approximationError(double& bearing_error, double& px_error) const
+{
+  const double r = r_;
+  bearing_error = 0.0;
+  px_error = 0.0;
+  for(double y=0.25; y<height_-1; y+=1.5)
+    for(double x=0.25; x<width_-1; x+=1.5)
+    {
+      const Vector3d f = cam2worldExact(x, y);
+      bearing_error = max(bearing_error, (cam2world(x, y) - f).norm());
+      const Vector2d uv = project2d(f);
+      const double r_uv = uv.norm();
+      const double factor = (r_uv < 0.001 || s_ == 0.0) ? 1.0 : s_inv_ * atan(r_uv * tans_) / r_uv;
+      const Vector2d px(cx_ + fx_ * factor * uv[0], cy_ + fy_ * factor * uv[1]);
+      px_error = max(px_error, (world2cam(f) - px).norm());
+    }
+  r_ = r;
+}
+
 } /* end vk */
@@ -2,24 +2,103 @@
 // Created by root on 4/27/21.
 //
 #include <vio/cl_class.h>
-opencl::opencl(vk::AbstractCamera* cam):cam(cam) {
+#include <vio/compute_backend.h>
+#include <vio/freak_pattern.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const char kCacheMagic[8] = {'V','I','O','C','L','B','0','1'};
+
+uint64_t fnv1a(const std::string& data,uint64_t hash=14695981039346656037ull){
+    for(auto&& c:data){
+        hash^=(unsigned char)c;
+        hash*=1099511628211ull;
+    }
+    return hash;
+}
+
+std::string toHex(uint64_t value){
+    char buf[17];
+    snprintf(buf,sizeof(buf),"%016llx",(unsigned long long)value);
+    return buf;
+}
+
+/// The file starts with the full key, a hash collision of the file name is detected.
+bool readProgramCache(const std::string& path,const std::string& key,std::vector<unsigned char>& binary){
+    FILE* fp=fopen(path.c_str(),"rb");
+    if(fp==NULL)return false;
+    char magic[sizeof(kCacheMagic)];
+    uint32_t key_size=0;
+    uint64_t size=0;
+    bool ok=fread(magic,1,sizeof(magic),fp)==sizeof(magic) && memcmp(magic,kCacheMagic,sizeof(magic))==0 &&
+            fread(&key_size,sizeof(key_size),1,fp)==1 && key_size==key.size();
+    if(ok){
+        std::string stored(key_size,'\0');
+        ok=fread(&stored[0],1,key_size,fp)==key_size && stored==key &&
+           fread(&size,sizeof(size),1,fp)==1 && size>0 && size<(1ull<<30);
+    }
+    if(ok){
+        binary.resize(size);
+        ok=fread(binary.data(),1,size,fp)==size;
+    }
+    fclose(fp);
+    return ok;
+}
+
+void makeDirs(const std::string& dir){
+    for(size_t i=1;i<=dir.size();++i)
+        if(i==dir.size() || dir[i]=='/')
+            mkdir(dir.substr(0,i).c_str(),ACCESSPERMS);
+}
+
+/// Written to a temporary file and renamed, a crash never leaves a truncated cache entry.
+void writeProgramCache(const std::string& dir,const std::string& path,const std::string& key,const cl::Program& program){
+    VECTOR_CLASS< ::size_t> sizes=program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+    VECTOR_CLASS<char*> binaries=program.getInfo<CL_PROGRAM_BINARIES>();
+    if(sizes.size()==1 && sizes[0]>0 && binaries.size()==1 && binaries[0]!=NULL){
+        makeDirs(dir);
+        const std::string tmp=path+"."+std::to_string(getpid());
+        FILE* fp=fopen(tmp.c_str(),"wb");
+        if(fp!=NULL){
+            const uint32_t key_size=key.size();
+            const uint64_t size=sizes[0];
+            bool ok=fwrite(kCacheMagic,1,sizeof(kCacheMagic),fp)==sizeof(kCacheMagic) &&
+                    fwrite(&key_size,sizeof(key_size),1,fp)==1 &&
+                    fwrite(key.data(),1,key.size(),fp)==key.size() &&
+                    fwrite(&size,sizeof(size),1,fp)==1 &&
+                    fwrite(binaries[0],1,size,fp)==size;
+            ok=(fclose(fp)==0) && ok;
+            if(!ok || rename(tmp.c_str(),path.c_str())!=0){
+                std::cout << "Can not write the OpenCL program cache "<<path<<'\n';
+                unlink(tmp.c_str());
+            }
+        }
+    }
+    for(auto&& b:binaries)delete[] b;
+}
+
+} // namespace
+
+opencl::opencl(vk::AbstractCamera* cam,cl_device_type type,const std::string& cache_dir):cam(cam) {
     std::vector<cl::Platform> all_platforms;
     cl::Platform::get(&all_platforms);
-    if (all_platforms.size() == 0){
-        std::cerr << " No platforms found. Check OpenCL installation!\n";
-        exit(1);
-    }
-    //get default device of the default platform
+    if (all_platforms.size() == 0)
+        throw std::runtime_error("No OpenCL platforms found. Check OpenCL installation!");
+    //first device of the requested type over all platforms
     std::vector<cl::Device> all_devices;
     for(auto i:all_platforms){
         std::cout << "Find platform number:"<< i.getInfo<CL_PLATFORM_NAME>() << "\n";
-        i.getDevices(CL_DEVICE_TYPE_GPU, &all_devices);
+        std::vector<cl::Device> devices;
+        if(i.getDevices(type, &devices)==CL_SUCCESS)
+            all_devices.insert(all_devices.end(),devices.begin(),devices.end());
     }
 
-    if (all_devices.size() == 0){
-        std::cout << " No devices found. Check OpenCL installation!\n";
-        exit(1);
-    }
+    if (all_devices.size() == 0)
+        throw std::runtime_error("No OpenCL device of the requested type found. Check OpenCL installation!");
 
     device = new cl::Device(all_devices[0]);
     std::cout << "CL_DEVICE_NAME: " << device->getInfo<CL_DEVICE_NAME>() <<'\n'
@@ -32,30 +111,135 @@ opencl::opencl(vk::AbstractCamera* cam):cam(cam) {
               << "CL_DEVICE_EXTENSIONS: " <<device->getInfo<CL_DEVICE_EXTENSIONS>()<<'\n';
     context=new cl::Context({ *device });
     cl::Program::Sources sources;
+    // polynomial atan of the camera model, shared with the CPU
+    read_cl fast_atan(std::string(KERNEL_DIR)+"/../include/vio/fast_atan.h");
+    sources.push_back({ fast_atan.src_str, fast_atan.size });
     read_cl fast(std::string(KERNEL_DIR)+"/fast-gray.cl");
     sources.push_back({ fast.src_str, fast.size });
     read_cl compute_residual(std::string(KERNEL_DIR)+"/compute-residual.cl");
     sources.push_back({ compute_residual.src_str, compute_residual.size });
-    program=new cl::Program(*context, sources);
+    read_cl half_sample(std::string(KERNEL_DIR)+"/half-sample.cl");
+    sources.push_back({ half_sample.src_str, half_sample.size });
+    read_cl reduce_system(std::string(KERNEL_DIR)+"/reduce-system.cl");
+    sources.push_back({ reduce_system.src_str, reduce_system.size });
+    read_cl integral_image(std::string(KERNEL_DIR)+"/integral_image.cl");
+    sources.push_back({ integral_image.src_str, integral_image.size });
+    read_cl freak(std::string(KERNEL_DIR)+"/freak.cl");
+    sources.push_back({ freak.src_str, freak.size });
     double* camera=cam->params();
-    std::string options="-DFAST_THRESH=40 -DPATCH_SIZE=8 -DPATCH_HALFSIZE=4 -DF_X="+ std::to_string(camera[0]) +
+    std::string options="-DPATCH_SIZE=8 -DPATCH_HALFSIZE=4 -DF_X="+ std::to_string(camera[0]) +
                         " -DF_Y="+std::to_string(camera[1])+
                         " -DC_X="+std::to_string(camera[2])+
                         " -DC_Y="+std::to_string(camera[3])+
                         " -DS="+std::to_string(camera[4])+
-                        " -DFREAK_LOG2=0.693147180559945 -DFREAK_NB_ORIENTATION=256 -DFREAK_NB_POINTS=43"+
-                        " -DFREAK_SMALLEST_KP_SIZE=7 -DNB_PAIRS=512 -DNB_SCALES=64";
-    if(program->build({ *device },options.c_str()) !=0)
-        std::cout << " Error building: " << program->getBuildInfo<CL_PROGRAM_BUILD_STATUS>(*device)<<'\n'
-                  << " Binary type: " << program->getBuildInfo<CL_PROGRAM_BINARY_TYPE>(*device)<<'\n'
-                  <<program->getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device) << '\n';
+                        " -DFREAK_NB_ORIENTATION="+std::to_string(vio::FreakPattern::kNbOrientation)+
+                        " -DFREAK_NB_POINTS="+std::to_string(vio::FreakPattern::kNbPoints)+
+                        " -DFREAK_NB_ORIENPAIRS="+std::to_string(vio::FreakPattern::kNbOrienPairs)+
+                        " -DFREAK_NB_PAIRS="+std::to_string(vio::FreakPattern::kNbPairs)+
+                        " -DREDUCE_GROUP_SIZE="+std::to_string(REDUCE_GROUP_SIZE)+
+                        " -DCOMPACT_GROUP_SIZE="+std::to_string(COMPACT_GROUP_SIZE)+
+                        " -DMAX_CELL_CORNERS="+std::to_string(vio::ComputeBackend::kMaxCellCorners);
+    // the binary depends on the device, the driver, the sources and the options (camera intrinsics)
+    uint64_t source_hash=fnv1a(std::string());
+    for(auto&& src:sources)source_hash=fnv1a(std::string(src.first,src.second),source_hash);
+    const std::string key=device->getInfo<CL_DEVICE_NAME>()+'\n'+device->getInfo<CL_DRIVER_VERSION>()+'\n'+
+                          options+'\n'+toHex(source_hash);
+    const std::string cache_path=cache_dir.empty() ? std::string() : cache_dir+"/"+toHex(fnv1a(key))+".bin";
+    std::vector<unsigned char> binary;
+    if(!cache_path.empty() && readProgramCache(cache_path,key,binary)){
+        cl::Program::Binaries binaries(1,std::make_pair((const void*)binary.data(),binary.size()));
+        cl_int error;
+        program=new cl::Program(*context,{ *device },binaries,NULL,&error);
+        if(error!=CL_SUCCESS || program->build({ *device },options.c_str())!=CL_SUCCESS){
+            std::cout << "Cached OpenCL program "<<cache_path<<" is not valid, rebuilding\n";
+            delete program;
+            program=nullptr;
+        }
+    }
+    if(program==nullptr){
+        program=new cl::Program(*context, sources);
+        if(program->build({ *device },options.c_str()) !=0){
+            // the kernels can not be made, the caller falls back to another backend
+            const std::string log=program->getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device);
+            delete program;
+            delete context;
+            delete device;
+            throw std::runtime_error("OpenCL program build failed:\n"+log);
+        }
+        if(!cache_path.empty())
+            writeProgramCache(cache_dir,cache_path,key,*program);
+    }
     queue=new cl::CommandQueue(*context,*device,CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,NULL);
 }
 opencl::~opencl() {
-    clear_buf();
     queue->finish();
+    _kernels.clear();
+    _buffers.clear();
+    _images.clear();
+    delete queue;
     delete program;
     delete context;
     delete device;
 }
+int opencl::acquireBuffer(size_t bytes){
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    size_t size_class=256;
+    while(size_class<bytes)size_class<<=1;
+    for(size_t i=0;i<_buffers.size();++i)
+        if(!_buffers[i].in_use && _buffers[i].bytes==size_class){
+            _buffers[i].in_use=true;
+            return (int)i;
+        }
+    cl_int error;
+    _buffers.push_back(PooledBuffer{cl::Buffer(*context,CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,size_class,NULL,&error),size_class,true});
+    assert(error == CL_SUCCESS);
+    return (int)_buffers.size()-1;
+}
+ImageHandle opencl::allocateImage(int width,int height){
+    ImageHandle handle;
+    handle.width=width;
+    handle.height=height;
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    for(size_t i=0;i<_images.size();++i)
+        if(!_images[i].in_use && _images[i].width==width && _images[i].height==height){
+            _images[i].in_use=true;
+            handle.slot=(int)i;
+            return handle;
+        }
+    cl_int error;
+    _images.push_back(PooledImage{cl::Image2D(*context,CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                              cl::ImageFormat(CL_R, CL_UNSIGNED_INT8),width,height,0,NULL,&error),
+                                  width,height,true});
+    assert(error == CL_SUCCESS);
+    handle.slot=(int)_images.size()-1;
+    return handle;
+}
+cl::Event opencl::writeAsync(const ImageHandle& handle,const cv::Mat& img,const std::vector<cl::Event>& wait){
+    assert(handle.valid() && img.type()==CV_8UC1 && img.cols==handle.width && img.rows==handle.height);
+    cl::size_t<3> origin;
+    cl::size_t<3> region;
+    region[0]=img.cols;
+    region[1]=img.rows;
+    region[2]=1;
+    cl::Event event;
+    cl_int error=queue->enqueueWriteImage(_images.at(handle.slot).image,CL_NON_BLOCKING,origin,region,img.step,0,img.data,waitList(wait),&event);
+    assert(error == CL_SUCCESS);
+    return event;
+}
+cl::Event opencl::readAsync(const ImageHandle& handle,cv::Mat& img,const std::vector<cl::Event>& wait){
+    assert(handle.valid() && img.type()==CV_8UC1 && img.cols==handle.width && img.rows==handle.height);
+    cl::size_t<3> origin;
+    cl::size_t<3> region;
+    region[0]=img.cols;
+    region[1]=img.rows;
+    region[2]=1;
+    cl::Event event;
+    cl_int error=queue->enqueueReadImage(_images.at(handle.slot).image,CL_NON_BLOCKING,origin,region,img.step,0,img.data,waitList(wait),&event);
+    assert(error == CL_SUCCESS);
+    queue->flush();
+    return event;
+}
+void opencl::write(const ImageHandle& handle,const cv::Mat& img){
+    writeAsync(handle,img).wait();
+}
 
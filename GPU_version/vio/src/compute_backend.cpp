@@ -0,0 +1,690 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/compute_backend.h>
+#include <vio/cl_class.h>
+#include <vio/freak_pattern.h>
+#include <ros/console.h>
+#include <stdexcept>
+
+namespace vio {
+
+ComputeBackend* ComputeBackend::create(vk::AbstractCamera* cam, const std::string& name, const std::string& cache_dir)
+{
+  if(name == "gpu" || name == "cpu")
+  {
+    try{
+      return new OpenCLBackend(cam, name == "gpu" ? OPENCL_GPU : OPENCL_CPU, cache_dir);
+    }catch(const std::exception& e){
+      ROS_WARN("compute backend %s is not available (%s), using the native backend", name.c_str(), e.what());
+    }
+  }
+  else if(name != "native")
+    ROS_WARN("unknown compute backend %s, using the native backend", name.c_str());
+  return new NativeBackend(cam);
+}
+
+namespace {
+
+/// Arguments of fast_score (fast-gray.cl).
+enum FastArg {FAST_IMAGE, FAST_THRESHOLD, FAST_SCORES};
+
+/// Arguments of select_corners (fast-gray.cl).
+enum SelectArg {SEL_SCORES, SEL_WIDTH, SEL_HEIGHT, SEL_LEVEL, SEL_CELL_SIZE, SEL_CELL_CORNERS,
+                SEL_CELL_XY, SEL_CELL_SCORES, SEL_CELL_COUNT};
+
+/// Arguments of compact_corners (fast-gray.cl).
+enum CompactArg {CMP_CELL_XY, CMP_CELL_SCORES, CMP_CELL_COUNT, CMP_N_CELLS, CMP_CELL_CORNERS, CMP_MAX_CORNERS,
+                 CMP_CORNERS, CMP_CORNER_SCORES, CMP_COUNT};
+
+/// Arguments of integral_rows and integral_cols (integral_image.cl).
+enum IntegralRowsArg {ROWS_IMAGE, ROWS_INTEGRAL};
+enum IntegralColsArg {COLS_WIDTH, COLS_HEIGHT, COLS_INTEGRAL};
+
+/// Arguments of freak_describe (freak.cl).
+enum FreakArg {FREAK_IMAGE, FREAK_INTEGRAL, FREAK_KEYPOINTS, FREAK_SCALES, FREAK_N, FREAK_POINTS, FREAK_SIGMAS,
+               FREAK_ORIENTATION_PAIRS, FREAK_DESCRIPTION_PAIRS, FREAK_DESCRIPTORS};
+
+/// Arguments of half_sample (half-sample.cl).
+enum HalfSampleArg {HALF_IN, HALF_OUT};
+
+/// Arguments of reference_patch (compute-residual.cl).
+enum ReferenceArg {REF_IMAGE, REF_PX, REF_LEVEL, REF_PATCH, REF_VISIBLE};
+
+/// Arguments of compute_residual (compute-residual.cl).
+enum ResidualArg {RES_CUR_IMAGE, RES_CUR_POSE, RES_REF_POSE, RES_REF_INDEX, RES_FEATURES, RES_LEVEL, RES_REF_PATCH, RES_REF_VISIBLE,
+                  RES_ERRORS, RES_HESSIAN, RES_JACOBIAN, RES_CHI2, RES_SCALE};
+
+/// PATCH_SIZE*PATCH_SIZE of the OpenCL build, work items per feature of compute_residual.
+const size_t kPatchArea = NativeBackend::kPatchSize*NativeBackend::kPatchSize;
+
+/// Arguments of reduce_system (reduce-system.cl).
+enum ReduceArg {RED_ERRORS, RED_HESSIAN, RED_JACOBIAN, RED_CHI2, RED_N, RED_SUMS};
+
+/// Layout of the sums of reduce_system.
+enum ReduceSum {SUM_ERROR = 0, SUM_CHI2 = 1, SUM_HESSIAN = 2, SUM_B = 11, SUM_TERMS = 14};
+
+/// One FAST level in flight.
+struct FastJob
+{
+  cv::Mat img;
+  int max_corners;
+  ImageHandle image;                    //!< uploaded copy of img, invalid for a resident level.
+  BufferHandle<cl_float> scores;        //!< score of every pixel, only read on the device.
+  BufferHandle<cl_int2> cell_xy;        //!< best corners of every cell, only read on the device.
+  BufferHandle<cl_float> cell_scores;
+  BufferHandle<cl_int> cell_count;
+  BufferHandle<cl_int2> corners;
+  BufferHandle<cl_float> corner_scores;
+  BufferHandle<cl_int> count;
+  std::vector<cl_int2> host_corners;
+  std::vector<cl_float> host_scores;
+  cl_int host_count[1];
+  std::vector<cl::Event> done;
+};
+
+/// One FREAK extraction in flight.
+struct FreakJob
+{
+  cv::Mat img;                          //!< source of the image upload.
+  ImageHandle image;                    //!< uploaded copy of img, invalid for a resident level.
+  BufferHandle<cl_int> integral;        //!< only read on the device.
+  BufferHandle<cl_float2> keypoints;
+  BufferHandle<cl_int> scales;
+  BufferHandle<cl_uchar> descriptors;
+  std::vector<cl_float2> host_keypoints;
+  std::vector<cl_int> host_scales;
+  std::vector<cl::Event> done;
+};
+
+/// Pyramid resident on the device, level 0 is uploaded once and half_sample makes the others.
+class DevicePyramid : public ImagePyramid
+{
+public:
+  DevicePyramid(const std::shared_ptr<opencl>& cl, const KernelHandle& half_sample,
+                const cv::Mat& img_level_0, int n_levels) :
+    ImagePyramid(img_level_0, n_levels),
+    cl_(cl),
+    images_(n_levels),
+    done_(n_levels)
+  {
+    images_[0] = cl_->allocateImage(cols(0),rows(0));
+    done_[0] = cl_->writeAsync(images_[0],level(0));
+    for(int i=1; i<n_levels; ++i)
+    {
+      images_[i] = cl_->allocateImage(cols(i),rows(i));
+      cl_->setArg(half_sample,HALF_IN,images_[i-1]);
+      cl_->setArg(half_sample,HALF_OUT,images_[i]);
+      done_[i] = cl_->enqueue(half_sample,cols(i),rows(i),1,{done_[i-1]});
+    }
+  }
+
+  virtual ~DevicePyramid()
+  {
+    opencl::wait(done_);
+    for(auto&& image:images_)
+      cl_->release(image);
+  }
+
+  const opencl* device() const { return cl_.get(); }
+  const ImageHandle& image(int level) const { return images_[level]; }
+  /// Event of the command which wrote the level.
+  const cl::Event& done(int level) const { return done_[level]; }
+
+protected:
+  virtual void download(int level, cv::Mat& img) const
+  {
+    cl_->readAsync(images_[level],img,{done_[level]}).wait();
+  }
+
+private:
+  std::shared_ptr<opencl> cl_;
+  std::vector<ImageHandle> images_;
+  std::vector<cl::Event> done_;
+};
+
+/// Level of pyr resident on the device of cl, NULL if pyr is a host pyramid or of another device.
+const DevicePyramid* residentOn(const opencl* cl, const ImagePyramid& pyr)
+{
+  const DevicePyramid* resident = dynamic_cast<const DevicePyramid*>(&pyr);
+  return resident != NULL && resident->device() == cl ? resident : NULL;
+}
+
+/// fast_score, select_corners and compact_corners on image after the events of ready, img is
+/// uploaded if image is invalid. The count is downloaded first, then only the stored corners.
+std::future<ComputeBackend::FastResult> launchFast(
+    const std::shared_ptr<opencl>& cl, const KernelHandle& fast, const KernelHandle& select,
+    const KernelHandle& compact, const cv::Mat& img,
+    const ImageHandle& image, const std::vector<cl::Event>& ready, int level,
+    const ComputeBackend::FastOptions& options, int max_corners)
+{
+  std::shared_ptr<FastJob> job = std::make_shared<FastJob>();
+  job->img = img;
+  job->max_corners = max_corners;
+  const int width = image.valid() ? image.width : img.cols;
+  const int height = image.valid() ? image.height : img.rows;
+  const int cell_corners = std::min(options.cell_corners,(int)ComputeBackend::kMaxCellCorners);
+  // one work item per cell of level 0 which has pixels on the level
+  const int n_cols = ((width<<level)+options.cell_size-1)/options.cell_size;
+  const int n_rows = ((height<<level)+options.cell_size-1)/options.cell_size;
+  const int n_cells = n_cols*n_rows;
+  job->scores = cl->allocate<cl_float>((size_t)width*height);
+  job->cell_xy = cl->allocate<cl_int2>((size_t)n_cells*cell_corners);
+  job->cell_scores = cl->allocate<cl_float>((size_t)n_cells*cell_corners);
+  job->cell_count = cl->allocate<cl_int>(n_cells);
+  job->corners = cl->allocate<cl_int2>(max_corners);
+  job->corner_scores = cl->allocate<cl_float>(max_corners);
+  job->count = cl->allocate<cl_int>(1);
+  job->host_count[0] = 0;
+  // upload -> fast_score -> select_corners -> compact_corners -> count, the host only waits in get()
+  std::vector<cl::Event> inputs = ready;
+  if(!image.valid())
+  {
+    job->image = cl->allocateImage(img.cols,img.rows);
+    inputs.push_back(cl->writeAsync(job->image,job->img));
+  }
+  const ImageHandle& input = image.valid() ? image : job->image;
+  cl->setArg(fast,FAST_IMAGE,input);
+  cl->setArg(fast,FAST_THRESHOLD,(cl_int)options.threshold);
+  cl->setArg(fast,FAST_SCORES,job->scores);
+  const std::vector<cl::Event> scored = {cl->enqueue(fast,width,height,1,inputs)};
+  cl->setArg(select,SEL_SCORES,job->scores);
+  cl->setArg(select,SEL_WIDTH,(cl_int)width);
+  cl->setArg(select,SEL_HEIGHT,(cl_int)height);
+  cl->setArg(select,SEL_LEVEL,(cl_int)level);
+  cl->setArg(select,SEL_CELL_SIZE,(cl_int)options.cell_size);
+  cl->setArg(select,SEL_CELL_CORNERS,(cl_int)cell_corners);
+  cl->setArg(select,SEL_CELL_XY,job->cell_xy);
+  cl->setArg(select,SEL_CELL_SCORES,job->cell_scores);
+  cl->setArg(select,SEL_CELL_COUNT,job->cell_count);
+  const std::vector<cl::Event> selected = {cl->enqueue(select,n_cols,n_rows,1,scored)};
+  // the best max_corners by score, independent of the order the cells ran in
+  cl->setArg(compact,CMP_CELL_XY,job->cell_xy);
+  cl->setArg(compact,CMP_CELL_SCORES,job->cell_scores);
+  cl->setArg(compact,CMP_CELL_COUNT,job->cell_count);
+  cl->setArg(compact,CMP_N_CELLS,(cl_int)n_cells);
+  cl->setArg(compact,CMP_CELL_CORNERS,(cl_int)cell_corners);
+  cl->setArg(compact,CMP_MAX_CORNERS,(cl_int)max_corners);
+  cl->setArg(compact,CMP_CORNERS,job->corners);
+  cl->setArg(compact,CMP_CORNER_SCORES,job->corner_scores);
+  cl->setArg(compact,CMP_COUNT,job->count);
+  const std::vector<cl::Event> compacted = {cl->enqueue(compact,cl::NDRange(COMPACT_GROUP_SIZE),
+                                                        cl::NDRange(COMPACT_GROUP_SIZE),selected)};
+  job->done.push_back(cl->readAsync(job->count,1,job->host_count,compacted));
+  return std::async(std::launch::deferred, [cl, job]
+  {
+    opencl::wait(job->done);
+    ComputeBackend::FastResult result;
+    result.count = job->host_count[0];
+    // only the stored corners cross the bus, at most max_corners
+    const int stored = std::min(result.count,job->max_corners);
+    if(stored>0)
+    {
+      job->host_corners.resize(stored);
+      job->host_scores.resize(stored);
+      opencl::wait({cl->readAsync(job->corners,stored,job->host_corners.data()),
+                    cl->readAsync(job->corner_scores,stored,job->host_scores.data())});
+      result.corners.reserve(stored);
+      result.scores.reserve(stored);
+      for(int i=0;i<stored;++i)
+      {
+        result.corners.push_back(cv::Point2i(job->host_corners[i].x,job->host_corners[i].y));
+        result.scores.push_back(job->host_scores[i]);
+      }
+    }
+    cl->release(job->image);
+    cl->release(job->scores);
+    cl->release(job->cell_xy);
+    cl->release(job->cell_scores);
+    cl->release(job->cell_count);
+    cl->release(job->corners);
+    cl->release(job->corner_scores);
+    cl->release(job->count);
+    return result;
+  });
+}
+
+} // namespace
+
+/// Points and patches of a reference frame on the device, one patch buffer per pyramid level.
+struct OpenCLBackend::Reference : public AlignmentReference
+{
+  explicit Reference(const std::shared_ptr<opencl>& cl) : cl(cl) {}
+
+  virtual ~Reference()
+  {
+    opencl::wait(ready);
+    opencl::wait(points_ready);
+    opencl::wait(reads);
+    cl->release(pose);
+    cl->release(features);
+    cl->release(px);
+    for(auto&& buffer:patch)
+      cl->release(buffer);
+    for(auto&& buffer:visible)
+      cl->release(buffer);
+  }
+
+  virtual size_t size() const { return n; }
+
+  virtual void setPoints(const std::vector<Eigen::Vector3f>& xyz_ref, const Eigen::Vector3f& ref_pose)
+  {
+    assert(xyz_ref.size() == n);
+    if(n == 0)
+      return;
+    // the last upload of the host copies was taken by an earlier alignment, this does not stall
+    opencl::wait(points_ready);
+    for(size_t i=0;i<n;++i)
+      host_features[i] = {xyz_ref[i].x(),xyz_ref[i].y(),xyz_ref[i].z()};
+    host_pose[0] = {ref_pose.x(),ref_pose.y(),ref_pose.z()};
+    // the buffers are rewritten after the copies of the alignment problems which read them
+    points_ready = {cl->writeAsync(pose,host_pose,1,reads), cl->writeAsync(features,host_features.data(),n,reads)};
+    reads.clear();
+  }
+
+  std::shared_ptr<opencl> cl;
+  size_t n = 0;
+  BufferHandle<cl_float3> pose, features;
+  BufferHandle<cl_float2> px;
+  std::vector<BufferHandle<cl_float4>> patch;   //!< intensity and gradient of the patches, per level.
+  std::vector<BufferHandle<cl_int>> visible;    //!< per level.
+  cl_float3 host_pose[1];
+  std::vector<cl_float3> host_features;
+  std::vector<cl_float2> host_px;
+  std::vector<cl::Event> ready;                 //!< px upload and reference_patch launches.
+  std::vector<cl::Event> points_ready;          //!< last upload of pose and features.
+  mutable std::vector<cl::Event> reads;         //!< copies of pose and features into alignment problems.
+};
+
+struct OpenCLBackend::Buffers
+{
+  KernelHandle fast;
+  KernelHandle select;
+  KernelHandle compact;
+  KernelHandle residual;
+  KernelHandle half_sample;
+  KernelHandle reduce;
+  KernelHandle reference;
+  KernelHandle integral_rows;
+  KernelHandle integral_cols;
+  KernelHandle freak;
+  BufferHandle<cl_float2> freak_points; //!< tables of FreakPattern::instance(), uploaded once.
+  BufferHandle<cl_float> freak_sigmas;
+  BufferHandle<cl_int4> freak_orientation_pairs;
+  BufferHandle<cl_uchar2> freak_description_pairs;
+  size_t n = 0;                         //!< features of the alignment problem, 0: no problem set.
+  std::vector<std::shared_ptr<const Reference>> refs; //!< references of the alignment problem.
+  BufferHandle<cl_float3> cur_pose, ref_poses, features, J;
+  BufferHandle<cl_int> ref_index, ref_visible;
+  BufferHandle<cl_float4> ref_patch;    //!< patches of all references on the level.
+  BufferHandle<cl_float> errors, H, chi2, sums;
+  ImageHandle cur_img;                  //!< uploaded level of a host pyramid.
+  cv::Mat cur_mat;                      //!< source of the image upload.
+  cl_float3 host_pose[1];
+  std::vector<cl_int> host_index;
+  cl_float host_sums[SUM_TERMS];        //!< sums of the last computeResiduals.
+  std::vector<cl::Event> uploads;       //!< writes the next residual launch waits for.
+};
+
+OpenCLBackend::OpenCLBackend(vk::AbstractCamera* cam, Type type, const std::string& cache_dir) :
+  type_(type),
+  cl_(new opencl(cam, type == OPENCL_GPU ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, cache_dir)),
+  buf_(new Buffers())
+{
+  buf_->fast = cl_->make_kernel("fast_score");
+  buf_->select = cl_->make_kernel("select_corners");
+  buf_->compact = cl_->make_kernel("compact_corners");
+  buf_->residual = cl_->make_kernel("compute_residual");
+  buf_->half_sample = cl_->make_kernel("half_sample");
+  buf_->reduce = cl_->make_kernel("reduce_system");
+  buf_->reference = cl_->make_kernel("reference_patch");
+  buf_->integral_rows = cl_->make_kernel("integral_rows");
+  buf_->integral_cols = cl_->make_kernel("integral_cols");
+  buf_->freak = cl_->make_kernel("freak_describe");
+  // the pattern tables do not change, they are uploaded and bound once
+  Buffers& b = *buf_;
+  const FreakPattern& pattern = FreakPattern::instance();
+  std::vector<cl_float2> points(pattern.points().size());
+  for(size_t i=0;i<points.size();++i)
+    points[i] = {pattern.points()[i].x,pattern.points()[i].y};
+  std::vector<cl_int4> orientation_pairs(FreakPattern::kNbOrienPairs);
+  for(int m=0;m<FreakPattern::kNbOrienPairs;++m)
+  {
+    const FreakPattern::OrientationPair& pair = pattern.orientationPairs()[m];
+    orientation_pairs[m] = {pair.i,pair.j,pair.weight_dx,pair.weight_dy};
+  }
+  std::vector<cl_uchar2> description_pairs(FreakPattern::kNbPairs);
+  for(int k=0;k<FreakPattern::kNbPairs;++k)
+    description_pairs[k] = {pattern.descriptionPairs()[k].i,pattern.descriptionPairs()[k].j};
+  b.freak_points = cl_->allocate<cl_float2>(points.size());
+  b.freak_sigmas = cl_->allocate<cl_float>(pattern.sigmas().size());
+  b.freak_orientation_pairs = cl_->allocate<cl_int4>(orientation_pairs.size());
+  b.freak_description_pairs = cl_->allocate<cl_uchar2>(description_pairs.size());
+  cl_->write(b.freak_points,points.data(),points.size());
+  cl_->write(b.freak_sigmas,pattern.sigmas().data(),pattern.sigmas().size());
+  cl_->write(b.freak_orientation_pairs,orientation_pairs.data(),orientation_pairs.size());
+  cl_->write(b.freak_description_pairs,description_pairs.data(),description_pairs.size());
+  cl_->setArg(b.freak,FREAK_POINTS,b.freak_points);
+  cl_->setArg(b.freak,FREAK_SIGMAS,b.freak_sigmas);
+  cl_->setArg(b.freak,FREAK_ORIENTATION_PAIRS,b.freak_orientation_pairs);
+  cl_->setArg(b.freak,FREAK_DESCRIPTION_PAIRS,b.freak_description_pairs);
+}
+
+OpenCLBackend::~OpenCLBackend()
+{
+  releaseAlignment();
+  cl_->release(buf_->freak_points);
+  cl_->release(buf_->freak_sigmas);
+  cl_->release(buf_->freak_orientation_pairs);
+  cl_->release(buf_->freak_description_pairs);
+  buf_.reset();
+}
+
+std::shared_ptr<ImagePyramid> OpenCLBackend::createPyramid(const cv::Mat& img_level_0, int n_levels)
+{
+  return std::make_shared<DevicePyramid>(cl_,buf_->half_sample,img_level_0,n_levels);
+}
+
+std::future<ComputeBackend::FastResult> OpenCLBackend::detectFastAsync(const cv::Mat& img, int level, const FastOptions& options, int max_corners)
+{
+  return launchFast(cl_,buf_->fast,buf_->select,buf_->compact,img,ImageHandle(),{},level,options,max_corners);
+}
+
+std::future<ComputeBackend::FastResult> OpenCLBackend::detectFastAsync(const ImagePyramid& pyr, int level, const FastOptions& options, int max_corners)
+{
+  const DevicePyramid* resident = residentOn(cl_.get(),pyr);
+  if(resident == NULL)
+    return detectFastAsync(pyr.level(level),level,options,max_corners);
+  return launchFast(cl_,buf_->fast,buf_->select,buf_->compact,cv::Mat(),resident->image(level),{resident->done(level)},level,options,max_corners);
+}
+
+std::future<void> OpenCLBackend::describeAsync(const ImagePyramid& pyr, const std::vector<cv::KeyPoint>& keypoints,
+                                              uint8_t* descriptors)
+{
+  Buffers& b = *buf_;
+  const size_t n = keypoints.size();
+  if(n == 0)
+    return std::async(std::launch::deferred, []{});
+  std::shared_ptr<FreakJob> job = std::make_shared<FreakJob>();
+  const FreakPattern& pattern = FreakPattern::instance();
+  job->host_keypoints.resize(n);
+  job->host_scales.resize(n);
+  for(size_t i=0;i<n;++i)
+  {
+    job->host_keypoints[i] = {keypoints[i].pt.x,keypoints[i].pt.y};
+    job->host_scales[i] = pattern.scaleIndex(keypoints[i].size);
+    assert(pattern.fits(keypoints[i].pt,job->host_scales[i],pyr.cols(0),pyr.rows(0)));
+  }
+  // level 0 -> integral_rows -> integral_cols -> freak_describe -> download, the host only waits in get()
+  std::vector<cl::Event> inputs;
+  const DevicePyramid* resident = residentOn(cl_.get(),pyr);
+  if(resident == NULL)
+  {
+    job->img = pyr.level(0);
+    job->image = cl_->allocateImage(job->img.cols,job->img.rows);
+    inputs.push_back(cl_->writeAsync(job->image,job->img));
+  }
+  else
+    inputs.push_back(resident->done(0));
+  const ImageHandle& image = resident != NULL ? resident->image(0) : job->image;
+  const int width = pyr.cols(0);
+  const int height = pyr.rows(0);
+  job->integral = cl_->allocate<cl_int>((size_t)(width+1)*(height+1));
+  job->keypoints = cl_->allocate<cl_float2>(n);
+  job->scales = cl_->allocate<cl_int>(n);
+  job->descriptors = cl_->allocate<cl_uchar>(n*FreakPattern::kDescriptorSize);
+  cl_->setArg(b.integral_rows,ROWS_IMAGE,image);
+  cl_->setArg(b.integral_rows,ROWS_INTEGRAL,job->integral);
+  const std::vector<cl::Event> rows = {cl_->enqueue(b.integral_rows,height,1,1,inputs)};
+  cl_->setArg(b.integral_cols,COLS_WIDTH,(cl_int)width);
+  cl_->setArg(b.integral_cols,COLS_HEIGHT,(cl_int)height);
+  cl_->setArg(b.integral_cols,COLS_INTEGRAL,job->integral);
+  std::vector<cl::Event> ready = {cl_->enqueue(b.integral_cols,width+1,1,1,rows)};
+  ready.push_back(cl_->writeAsync(job->keypoints,job->host_keypoints.data(),n));
+  ready.push_back(cl_->writeAsync(job->scales,job->host_scales.data(),n));
+  cl_->setArg(b.freak,FREAK_IMAGE,image);
+  cl_->setArg(b.freak,FREAK_INTEGRAL,job->integral);
+  cl_->setArg(b.freak,FREAK_KEYPOINTS,job->keypoints);
+  cl_->setArg(b.freak,FREAK_SCALES,job->scales);
+  cl_->setArg(b.freak,FREAK_N,(cl_int)n);
+  cl_->setArg(b.freak,FREAK_DESCRIPTORS,job->descriptors);
+  const std::vector<cl::Event> described = {cl_->enqueue(b.freak,n,1,1,ready)};
+  // the descriptors go straight to the caller, no staging copy
+  job->done.push_back(cl_->readAsync(job->descriptors,n*FreakPattern::kDescriptorSize,descriptors,described));
+  std::shared_ptr<opencl> cl = cl_;
+  return std::async(std::launch::deferred, [cl, job]
+  {
+    opencl::wait(job->done);
+    cl->release(job->image);
+    cl->release(job->integral);
+    cl->release(job->keypoints);
+    cl->release(job->scales);
+    cl->release(job->descriptors);
+  });
+}
+
+std::shared_ptr<AlignmentReference> OpenCLBackend::createAlignmentReference(
+    const std::vector<Eigen::Vector3f>& xyz_ref,
+    const std::vector<Eigen::Vector2f>& px_ref,
+    const Eigen::Vector3f& ref_pose,
+    const ImagePyramid& ref_pyr)
+{
+  Buffers& b = *buf_;
+  std::shared_ptr<Reference> ref = std::make_shared<Reference>(cl_);
+  ref->n = xyz_ref.size();
+  if(ref->n == 0)
+    return ref;
+  ref->host_features.resize(ref->n);
+  ref->host_px.resize(ref->n);
+  for(size_t i=0;i<ref->n;++i)
+  {
+    ref->host_features[i] = {xyz_ref[i].x(),xyz_ref[i].y(),xyz_ref[i].z()};
+    ref->host_px[i] = {px_ref[i].x(),px_ref[i].y()};
+  }
+  ref->host_pose[0] = {ref_pose.x(),ref_pose.y(),ref_pose.z()};
+  ref->pose = cl_->allocate<cl_float3>(1);
+  ref->features = cl_->allocate<cl_float3>(ref->n);
+  ref->px = cl_->allocate<cl_float2>(ref->n);
+  ref->points_ready.push_back(cl_->writeAsync(ref->pose,ref->host_pose,1));
+  ref->points_ready.push_back(cl_->writeAsync(ref->features,ref->host_features.data(),ref->n));
+  const cl::Event px_ready = cl_->writeAsync(ref->px,ref->host_px.data(),ref->n);
+  ref->ready.push_back(px_ready);
+  // reference_patch on every level, resident levels are read in place and host levels uploaded
+  const DevicePyramid* resident = residentOn(cl_.get(),ref_pyr);
+  std::vector<ImageHandle> uploaded;
+  std::vector<cl::Event> patched;
+  cl_->setArg(b.reference,REF_PX,ref->px);
+  for(int level=0; level<ref_pyr.size(); ++level)
+  {
+    std::vector<cl::Event> inputs = {px_ready};
+    if(resident != NULL)
+    {
+      cl_->setArg(b.reference,REF_IMAGE,resident->image(level));
+      inputs.push_back(resident->done(level));
+    }
+    else
+    {
+      uploaded.push_back(cl_->allocateImage(ref_pyr.cols(level),ref_pyr.rows(level)));
+      inputs.push_back(cl_->writeAsync(uploaded.back(),ref_pyr.level(level)));
+      cl_->setArg(b.reference,REF_IMAGE,uploaded.back());
+    }
+    ref->patch.push_back(cl_->allocate<cl_float4>(kPatchArea*ref->n));
+    ref->visible.push_back(cl_->allocate<cl_int>(ref->n));
+    cl_->setArg(b.reference,REF_LEVEL,(cl_int)level);
+    cl_->setArg(b.reference,REF_PATCH,ref->patch.back());
+    cl_->setArg(b.reference,REF_VISIBLE,ref->visible.back());
+    patched.push_back(cl_->enqueue(b.reference,kPatchArea*ref->n,1,1,inputs));
+  }
+  // the uploaded images are only needed for the patches
+  if(!uploaded.empty())
+  {
+    opencl::wait(patched);
+    for(auto&& image:uploaded)
+      cl_->release(image);
+  }
+  ref->ready.insert(ref->ready.end(),patched.begin(),patched.end());
+  return ref;
+}
+
+void OpenCLBackend::setAlignmentProblem(const std::vector<std::shared_ptr<const AlignmentReference>>& refs,
+                                        const Eigen::Vector3f& cur_pose)
+{
+  releaseAlignment();
+  Buffers& b = *buf_;
+  for(auto&& ref:refs)
+  {
+    std::shared_ptr<const Reference> reference = std::dynamic_pointer_cast<const Reference>(ref);
+    assert(reference != NULL && reference->cl == cl_);
+    if(reference->n == 0)
+      continue;
+    b.host_index.insert(b.host_index.end(),reference->n,(cl_int)b.refs.size());
+    b.refs.push_back(reference);
+  }
+  b.n = b.host_index.size();
+  assert(b.n > 0);
+  b.host_pose[0] = {cur_pose.x(),cur_pose.y(),cur_pose.z()};
+  b.cur_pose = cl_->allocate<cl_float3>(1);
+  b.ref_poses = cl_->allocate<cl_float3>(b.refs.size());
+  b.ref_index = cl_->allocate<cl_int>(b.n);
+  b.features = cl_->allocate<cl_float3>(b.n);
+  b.ref_patch = cl_->allocate<cl_float4>(kPatchArea*b.n);
+  b.ref_visible = cl_->allocate<cl_int>(b.n);
+  b.errors = cl_->allocate<cl_float>(b.n);
+  b.H = cl_->allocate<cl_float>(9*b.n);
+  b.J = cl_->allocate<cl_float3>(b.n);
+  b.chi2 = cl_->allocate<cl_float>(b.n);
+  b.sums = cl_->allocate<cl_float>(SUM_TERMS);
+  b.uploads.push_back(cl_->writeAsync(b.cur_pose,b.host_pose,1));
+  b.uploads.push_back(cl_->writeAsync(b.ref_index,b.host_index.data(),b.n));
+  // the features of the references are stacked on the device
+  size_t offset = 0;
+  for(size_t i=0;i<b.refs.size();++i)
+  {
+    const Reference& ref = *b.refs[i];
+    // releaseAlignment waited for the copies of the previous problem
+    ref.reads.clear();
+    b.uploads.push_back(cl_->copyAsync(ref.pose,0,b.ref_poses,i,1,ref.points_ready));
+    ref.reads.push_back(b.uploads.back());
+    b.uploads.push_back(cl_->copyAsync(ref.features,0,b.features,offset,ref.n,ref.points_ready));
+    ref.reads.push_back(b.uploads.back());
+    offset += ref.n;
+  }
+  cl_->setArg(b.residual,RES_CUR_POSE,b.cur_pose);
+  cl_->setArg(b.residual,RES_REF_POSE,b.ref_poses);
+  cl_->setArg(b.residual,RES_REF_INDEX,b.ref_index);
+  cl_->setArg(b.residual,RES_FEATURES,b.features);
+  cl_->setArg(b.residual,RES_REF_PATCH,b.ref_patch);
+  cl_->setArg(b.residual,RES_REF_VISIBLE,b.ref_visible);
+  cl_->setArg(b.residual,RES_ERRORS,b.errors);
+  cl_->setArg(b.residual,RES_HESSIAN,b.H);
+  cl_->setArg(b.residual,RES_JACOBIAN,b.J);
+  cl_->setArg(b.residual,RES_CHI2,b.chi2);
+  cl_->setArg(b.reduce,RED_ERRORS,b.errors);
+  cl_->setArg(b.reduce,RED_HESSIAN,b.H);
+  cl_->setArg(b.reduce,RED_JACOBIAN,b.J);
+  cl_->setArg(b.reduce,RED_CHI2,b.chi2);
+  cl_->setArg(b.reduce,RED_N,(cl_int)b.n);
+  cl_->setArg(b.reduce,RED_SUMS,b.sums);
+}
+
+void OpenCLBackend::setAlignmentLevel(const ImagePyramid& cur_pyr, int level)
+{
+  Buffers& b = *buf_;
+  assert(b.n > 0);
+  // the image of the previous level can still be written, its residuals were read back
+  opencl::wait(b.uploads);
+  b.uploads.clear();
+  cl_->release(b.cur_img);
+  b.cur_mat.release();
+  // a resident level is used in place, a host pyramid is uploaded
+  const DevicePyramid* resident = residentOn(cl_.get(),cur_pyr);
+  if(resident != NULL)
+  {
+    cl_->setArg(b.residual,RES_CUR_IMAGE,resident->image(level));
+    b.uploads.push_back(resident->done(level));
+  }
+  else
+  {
+    b.cur_mat = cur_pyr.level(level);
+    b.cur_img = cl_->allocateImage(b.cur_mat.cols,b.cur_mat.rows);
+    b.uploads.push_back(cl_->writeAsync(b.cur_img,b.cur_mat));
+    cl_->setArg(b.residual,RES_CUR_IMAGE,b.cur_img);
+  }
+  cl_->setArg(b.residual,RES_LEVEL,(cl_int)level);
+  // patches of the level of all references, one residual launch covers them
+  size_t offset = 0;
+  for(auto&& ref:b.refs)
+  {
+    assert(level < (int)ref->patch.size());
+    b.uploads.push_back(cl_->copyAsync(ref->patch[level],0,b.ref_patch,kPatchArea*offset,kPatchArea*ref->n,ref->ready));
+    b.uploads.push_back(cl_->copyAsync(ref->visible[level],0,b.ref_visible,offset,ref->n,ref->ready));
+    offset += ref->n;
+  }
+}
+
+void OpenCLBackend::computeResiduals(float scale, float& error, float& chi2)
+{
+  Buffers& b = *buf_;
+  assert(b.n > 0);
+  // compute_residual writes every output, reduce_system leaves SUM_TERMS floats to transfer
+  cl_->setArg(b.residual,RES_SCALE,(cl_float)scale);
+  const std::vector<cl::Event> computed = {cl_->enqueue(b.residual,cl::NDRange(kPatchArea*b.n),
+                                                       cl::NDRange(kPatchArea),b.uploads)};
+  b.uploads.clear();
+  const std::vector<cl::Event> reduced = {cl_->enqueue(b.reduce,cl::NDRange(REDUCE_GROUP_SIZE),
+                                                       cl::NDRange(REDUCE_GROUP_SIZE),computed)};
+  cl_->readAsync(b.sums,SUM_TERMS,b.host_sums,reduced).wait();
+  error = b.host_sums[SUM_ERROR];
+  chi2 = b.host_sums[SUM_CHI2];
+}
+
+void OpenCLBackend::linearSystem(Eigen::Matrix3f& H, Eigen::Vector3f& b)
+{
+  assert(buf_->n > 0);
+  const cl_float* sums = buf_->host_sums;
+  H = Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor>>(sums+SUM_HESSIAN);
+  b = Eigen::Map<const Eigen::Vector3f>(sums+SUM_B);
+}
+
+Eigen::Vector3f OpenCLBackend::alignmentPose()
+{
+  // the kernel only reads the pose, the host copy is current
+  const cl_float3& pos = buf_->host_pose[0];
+  return Eigen::Vector3f(pos.x,pos.y,pos.z);
+}
+
+void OpenCLBackend::setAlignmentPose(const Eigen::Vector3f& pose)
+{
+  Buffers& b = *buf_;
+  // a pending upload still reads host_pose
+  opencl::wait(b.uploads);
+  b.uploads.clear();
+  b.host_pose[0] = {pose.x(),pose.y(),pose.z()};
+  b.uploads.push_back(cl_->writeAsync(b.cur_pose,b.host_pose,1));
+}
+
+void OpenCLBackend::releaseAlignment()
+{
+  Buffers& b = *buf_;
+  opencl::wait(b.uploads);
+  b.uploads.clear();
+  cl_->release(b.cur_img);
+  b.cur_mat.release();
+  cl_->release(b.cur_pose);
+  cl_->release(b.ref_poses);
+  cl_->release(b.ref_index);
+  cl_->release(b.features);
+  cl_->release(b.ref_patch);
+  cl_->release(b.ref_visible);
+  cl_->release(b.errors);
+  cl_->release(b.H);
+  cl_->release(b.J);
+  cl_->release(b.chi2);
+  cl_->release(b.sums);
+  b.refs.clear();
+  b.host_index.clear();
+  b.n = 0;
+}
+
+} // namespace vio
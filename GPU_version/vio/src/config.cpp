@@ -22,6 +22,15 @@ namespace vio {
 Config::Config() :
     trace_name(vk::getParam<string>("vio/trace_name", "VIO")),
     trace_dir(vk::getParam<string>("vio/trace_dir", "/tmp")),
+    compute_backend(vk::getParam<string>("vio/compute_backend", "gpu")),
+    kernel_cache_dir(vk::getParam<string>("vio/kernel_cache_dir", string(PROJECT_DIR)+"/kernel_cache")),
+    fast_threshold(vk::getParam<int>("vio/fast_threshold", 40)),
+    fast_target_corners(vk::getParam<int>("vio/fast_target_corners", 1000)),
+    match_window_sigma(vk::getParam<double>("vio/match_window_sigma", 3.0)),
+    match_window_min(vk::getParam<double>("vio/match_window_min", 16.0)),
+    match_window_max(vk::getParam<double>("vio/match_window_max", 96.0)),
+    kf_grid_cell_size(vk::getParam<double>("vio/kf_grid_cell_size", 5.0)),
+    close_kfs_radius(vk::getParam<double>("vio/close_kfs_radius", 40.0)),
     n_pyr_levels(vk::getParam<int>("vio/n_pyr_levels", 3)),
     use_imu(vk::getParam<bool>("vio/use_imu", false)),
     core_n_kfs(vk::getParam<int>("vio/core_n_kfs", 3)),
@@ -32,6 +41,7 @@ Config::Config() :
     init_min_inliers(vk::getParam<int>("vio/init_min_inliers", 40)),
     klt_max_level(vk::getParam<int>("vio/klt_max_level", 4)),
     klt_min_level(vk::getParam<int>("vio/klt_min_level", 2)),
+    joint_img_align(vk::getParam<bool>("vio/joint_img_align", false)),
     reproj_thresh(vk::getParam<double>("vio/reproj_thresh", 2.0)),
     poseoptim_thresh(vk::getParam<double>("vio/poseoptim_thresh", 2.0)),
     poseoptim_num_iter(vk::getParam<int>("vio/poseoptim_num_iter", 10)),
@@ -14,9 +14,13 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cmath>
 #include <vio/feature_detection.h>
+#include <vio/freak_pattern.h>
 #include <vio/feature.h>
 #include <vio/vision.h>
+#include <vio/config.h>
 #include <vio/for_it.hpp>
 
 namespace vio {
@@ -56,72 +60,104 @@ void AbstractDetector::setGridOccpuancy(const Vector2d& px)
     + static_cast<int>(px[0]/cell_size_)) = true;
 }
 
+FastThreshold::FastThreshold(int n_levels, int initial_threshold, int target_corners) :
+    threshold_(n_levels, static_cast<double>(initial_threshold)),
+    target_(n_levels)
+{
+  for(int L=0; L<n_levels; ++L)
+    target_[L] = std::max(1.0, target_corners/static_cast<double>(1<<(2*L)));
+}
+
+void FastThreshold::update(int level, int count)
+{
+  // the corner count falls about exponentially with the threshold: a proportional step on the
+  // log ratio, half way per frame, converges without oscillating on the next frames
+  const double gain = 0.5;
+  const double error = std::log((count+1.0)/(target_.at(level)+1.0));
+  threshold_[level] = std::min<double>(kMaxThreshold, std::max<double>(kMinThreshold,
+                                       threshold_[level]*(1.0+gain*std::max(-1.0, std::min(1.0, error)))));
+}
+
 FastDetector::FastDetector(
     const int img_width,
     const int img_height,
     const int cell_size,
-    opencl* gpu_fast_,
-    const int n_pyr_levels) :
-        AbstractDetector(img_width, img_height, cell_size, n_pyr_levels),gpu_fast_(gpu_fast_)
+    ComputeBackend* backend,
+    const int n_pyr_levels,
+    FastThreshold* threshold) :
+        AbstractDetector(img_width, img_height, cell_size, n_pyr_levels),backend_(backend),threshold_(threshold)
 {
 }
 
 void FastDetector::detect(
     std::shared_ptr<Frame> frame,
-    const ImgPyr& img_pyr,
+    const ImagePyramid& img_pyr,
     const double detection_threshold,
     list<shared_ptr<Feature>>& fts)
     {
+  FeatureTable table;
+  detect(frame, img_pyr, detection_threshold, table);
+  for(size_t i=0; i<table.size(); ++i)
+    fts.push_back(make_shared<Feature>(frame, PointHandle(), table.px(i), table.f(i), table.score(i),
+                                       table.level(i), table.descriptor(i)));
+}
+
+void FastDetector::detect(
+    std::shared_ptr<Frame> frame,
+    const ImagePyramid& img_pyr,
+    const double detection_threshold,
+    FeatureTable& table)
+{
   std::vector<cv::KeyPoint> keypoints;
-  for(int L=0; L<n_pyr_levels_; ++L)
   {
-    if(L>img_pyr.size())return;
-    int scale = (1<<L);
-    cv::Mat img=img_pyr.at(L);
-    gpu_fast_->load(0,0,img);
-    cl_int2* fast_corner=(cl_int2*)calloc(2000, sizeof(cl_int2));
-    gpu_fast_->load(0,1,2000,fast_corner);
-    cl_int icorner[1]={0};
-    gpu_fast_->load(0,2,1,icorner);
-    gpu_fast_->run(0,img.cols,img.rows);
-    cl_int count[1]={0};
-    gpu_fast_->read(0,2,1,count);
-    if(count[0]<1 ){
-        ROS_ERROR("Can not communicate with GPU");
-        exit(0);
-    }
-    const int size=count[0];
-    if(size<1 || size > 2000){
-        gpu_fast_->release(0,0);
-        gpu_fast_->release(0,1);
-        gpu_fast_->release(0,2);
-        free(fast_corner);
-        return;
+    VIO_SPAN("fast");
+    // all levels are queued at once and stay on the device, which scores the corners and keeps
+    // the best of every cell; a reprojector cell takes at most Config::gridSize() features
+    const int n_levels = std::min<int>(n_pyr_levels_, img_pyr.size());
+    ComputeBackend::FastOptions options;
+    options.cell_size = cell_size_;
+    options.cell_corners = Config::gridSize();
+    std::vector<std::future<ComputeBackend::FastResult>> levels;
+    for(int L=0; L<n_levels; ++L)
+    {
+      options.threshold = threshold_ != NULL ? threshold_->threshold(L) : Config::fastThreshold();
+      levels.push_back(backend_->detectFastAsync(img_pyr,L,options,2000));
     }
-    cl_int2* fast_corners=(cl_int2*)calloc(size, sizeof(cl_int2));
-    gpu_fast_->read(0,1,size,fast_corners);
-    for(uint i=0;i<size;++i)
+    for(int L=0; L<n_levels; ++L)
     {
-      if(fast_corners[i].x<5 || fast_corners[i].x>img_pyr[L].cols-5 || fast_corners[i].y>img_pyr[L].rows-5 || fast_corners[i].y<5){
-          continue;
+      // every future is taken, the OpenCL backend returns its buffers in get(); a level over
+      // the budget keeps its best corners and steers the threshold of the next frame up
+      const ComputeBackend::FastResult result = levels[L].get();
+      if(threshold_ != NULL)
+        threshold_->update(L, result.count);
+      int scale = (1<<L);
+      for(size_t i=0; i<result.corners.size(); ++i)
+      {
+        const cv::Point2i& c = result.corners[i];
+        keypoints.push_back(cv::KeyPoint(c.x*scale, c.y*scale, 7.f,-1,result.scores[i]));
       }
-      float score = vk::shiTomasiScore(img_pyr[L], fast_corners[i].x, fast_corners[i].y);
-      keypoints.push_back(cv::KeyPoint(fast_corners[i].x*scale, fast_corners[i].y*scale, 7.f,-1,score));
     }
-    gpu_fast_->release(0,0);
-    gpu_fast_->release(0,1);
-    gpu_fast_->release(0,2);
-    free(fast_corner);
-    free(fast_corners);
   }
   if(keypoints.size()<1){
       assert(0 && "GPU Driver crash try again!");
   }
-  cv::Ptr<cv::xfeatures2d::FREAK> extractor = cv::xfeatures2d::FREAK::create(true, true, 22.0f, 4);
-  cv::Mat descriptor;
-  extractor->compute(frame->img(), keypoints, descriptor);
-  for(auto&& p:_for(keypoints)){
-      fts.push_back(make_shared<Feature>(frame, Vector2d(p.item.pt.x, p.item.pt.y), p.item.response ,0,descriptor.data+(p.index*64)));
+  // FREAK drops the keypoints whose pattern leaves the image, the backend expects them removed
+  const FreakPattern& pattern = FreakPattern::instance();
+  const int scale = pattern.scaleIndex(7.f);
+  keypoints.erase(std::remove_if(keypoints.begin(), keypoints.end(), [&](const cv::KeyPoint& kp)
+  {
+    return !pattern.fits(kp.pt, scale, img_pyr.cols(0), img_pyr.rows(0));
+  }), keypoints.end());
+  table.clear();
+  table.reserve(keypoints.size());
+  for(auto&& kp:keypoints)
+  {
+    const Vector2d px(kp.pt.x, kp.pt.y);
+    table.add(px, frame->cam_->cam2world(px), 0, kp.response);
+  }
+  {
+    VIO_SPAN("freak");
+    backend_->describeAsync(img_pyr, keypoints, table.descriptors()).get();
   }
 }
 
@@ -0,0 +1,66 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/feature_table.h>
+#include <vio/feature.h>
+#include <vio/point.h>
+#include <string.h>
+
+namespace vio {
+
+void FeatureTable::clear()
+{
+  px_.clear();
+  f_.clear();
+  level_.clear();
+  score_.clear();
+  point_id_.clear();
+  descriptors_.clear();
+  features_.clear();
+}
+
+void FeatureTable::reserve(size_t n)
+{
+  px_.reserve(n);
+  f_.reserve(n);
+  level_.reserve(n);
+  score_.reserve(n);
+  point_id_.reserve(n);
+  descriptors_.reserve(n);
+  features_.reserve(n);
+}
+
+int FeatureTable::add(const Eigen::Vector2d& px, const Eigen::Vector3d& f, int level, float score,
+                      const uint8_t* descriptor)
+{
+  px_.push_back(px);
+  f_.push_back(f);
+  level_.push_back(level);
+  score_.push_back(score);
+  point_id_.push_back(-1);
+  descriptors_.push_back(Descriptor());
+  if(descriptor != NULL)
+    memcpy(descriptors_.back().data, descriptor, kDescriptorSize);
+  else
+    memset(descriptors_.back().data, 0, kDescriptorSize);
+  features_.push_back(NULL);
+  return (int)px_.size()-1;
+}
+
+int FeatureTable::add(const std::shared_ptr<Feature>& ftr)
+{
+  const int i = add(ftr->px, ftr->f, ftr->level, ftr->score, ftr->descriptor);
+  point_id_[i] = ftr->point != NULL ? ftr->point->id_ : -1;
+  features_[i] = ftr;
+  return i;
+}
+
+void FeatureTable::updatePoints()
+{
+  for(size_t i=0; i<features_.size(); ++i)
+    if(features_[i] != NULL)
+      point_id_[i] = features_[i]->point != NULL ? features_[i]->point->id_ : -1;
+}
+
+} // namespace vio
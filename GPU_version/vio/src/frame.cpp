@@ -22,29 +22,36 @@
 #include <vio/math_utils.h>
 #include <vio/vision.h>
 #include <vio/map.h>
+#include <vio/compute_backend.h>
 
 namespace vio {
 
 int Frame::frame_counter_ = 0;
 
-Frame::Frame(vk::AbstractCamera* cam, const cv::Mat& img, double timestamp) :
+Frame::Frame(vk::AbstractCamera* cam, const cv::Mat& img, double timestamp, ComputeBackend* backend) :
     id_(frame_counter_++),
     timestamp_(timestamp),
     cam_(cam),
+    backend_(NULL),
     key_pts_(5),
     is_keyframe_(false),
     v_kf_(NULL),
-    T_f_w_(SE2_5(0.0,0.0,0.0))
+    T_f_w_(SE2_5(0.0,0.0,0.0)),
+    Cov_(Matrix3d::Zero())
 {
-  initFrame(img);
+  initFrame(img, backend);
 }
 
 Frame::~Frame()
 {
-  for(auto&& f:fts_)f.reset();
+  // features point back to the frame without owning it, no point keeps an observation of a
+  // destroyed frame; this also releases the point <-> feature references of the frame
+  for(auto&& ftr:fts_)
+    if(ftr->point != NULL)
+      ftr->point->deleteFrameRef(this);
 }
 
-void Frame::initFrame(const cv::Mat& img)
+void Frame::initFrame(const cv::Mat& img, ComputeBackend* backend)
 {
   // check image
   if(img.empty() || img.type() != CV_8UC1 || img.cols != cam_->width() || img.rows != cam_->height())
@@ -54,18 +61,113 @@ void Frame::initFrame(const cv::Mat& img)
   for(auto&& ftr:key_pts_)ftr.reset();
 
   // Build Image Pyramid
-   createImgPyramid(img, max(Config::nPyrLevels(), Config::kltMaxLevel()+1), img_pyr_);
+  VIO_SPAN("pyramid");
+  const int n_levels = max(Config::nPyrLevels(), Config::kltMaxLevel()+1);
+  backend_ = backend;
+  invalidateAlignmentReference();
+  if(backend != NULL)
+    img_pyr_ = backend->createPyramid(img, n_levels);
+  else
+    img_pyr_ = std::make_shared<ImagePyramid>(img, n_levels);
 }
 
 void Frame::setKeyframe()
 {
   is_keyframe_ = true;
   setKeyPoints();
+  if(backend_ != NULL)
+  {
+    std::atomic_store(&align_ref_, createAlignmentReference(align_fts_));
+    align_points_moved_ = false;
+  }
+}
+
+std::shared_ptr<AlignmentReference> Frame::alignmentReference()
+{
+  if(!is_keyframe_)
+  {
+    vector<std::shared_ptr<Feature>> fts;
+    return createAlignmentReference(fts);
+  }
+  std::shared_ptr<AlignmentReference> ref = std::atomic_load(&align_ref_);
+  if(ref != NULL && align_points_moved_.exchange(false))
+  {
+    // the patches stay, only the points and the pose are uploaded again
+    std::vector<Eigen::Vector3f> xyz;
+    if(alignmentPoints(align_fts_, xyz))
+      ref->setPoints(xyz, Eigen::Vector3f((float)pos()(0), (float)pos()(1), (float)T_f_w_.pitch()));
+    else
+      ref.reset();
+  }
+  if(ref == NULL)
+  {
+    ref = createAlignmentReference(align_fts_);
+    align_points_moved_ = false;
+    std::atomic_store(&align_ref_, ref);
+  }
+  return ref;
+}
+
+void Frame::invalidateAlignmentReference()
+{
+  std::atomic_store(&align_ref_, std::shared_ptr<AlignmentReference>());
+}
+
+std::shared_ptr<AlignmentReference> Frame::createAlignmentReference(vector<std::shared_ptr<Feature>>& fts) const
+{
+  assert(backend_ != NULL);
+  const Eigen::Vector3f pose((float)pos()(0), (float)pos()(1), (float)T_f_w_.pitch());
+  fts.clear();
+  for(auto&& ftr:fts_)
+    if(ftr->point != NULL && !ftr->point->pos_.hasNaN() && ftr->point->pos_.norm() != 0.)
+      fts.push_back(ftr);
+  std::vector<Eigen::Vector3f> xyz;
+  std::vector<Eigen::Vector2f> px;
+  alignmentPoints(fts, xyz);
+  px.reserve(fts.size());
+  for(auto&& ftr:fts)
+    px.push_back(ftr->px.cast<float>());
+  return backend_->createAlignmentReference(xyz, px, pose, *img_pyr_);
+}
+
+bool Frame::alignmentPoints(const vector<std::shared_ptr<Feature>>& fts, std::vector<Eigen::Vector3f>& xyz) const
+{
+  xyz.clear();
+  xyz.reserve(fts.size());
+  for(auto&& ftr:fts)
+  {
+    if(ftr->point == NULL || ftr->point->pos_.hasNaN() || ftr->point->pos_.norm() == 0.)
+      return false;
+    xyz.push_back((ftr->f*w2f(ftr->point->pos_).norm()).cast<float>());
+  }
+  return true;
 }
 
 void Frame::addFeature(std::shared_ptr<Feature> ftr)
 {
   fts_.push_back(ftr);
+  ftr_table_dirty_ = true;
+}
+
+Features::iterator Frame::eraseFeature(Features::iterator it)
+{
+  ftr_table_dirty_ = true;
+  return fts_.erase(it);
+}
+
+const FeatureTable& Frame::featureTable()
+{
+  if(ftr_table_dirty_)
+  {
+    ftr_table_.clear();
+    ftr_table_.reserve(fts_.size());
+    for(auto&& ftr:fts_)
+      ftr_table_.add(ftr);
+    ftr_table_dirty_ = false;
+  }
+  else
+    ftr_table_.updatePoints();
+  return ftr_table_;
 }
 
 void Frame::setKeyPoints()
@@ -77,7 +179,7 @@ void Frame::setKeyPoints()
   for(auto&& ftr:fts_)if(ftr->point != NULL) checkKeyPoints(ftr);
 }
 
-void Frame::checkKeyPoints(std::shared_ptr<Feature> ftr)
+void Frame::checkKeyPoints(const std::shared_ptr<Feature>& ftr)
 {
   const int cu = cam_->width()/2;
   const int cv = cam_->height()/2;
@@ -142,11 +244,37 @@ void Frame::removeKeyPoint(std::shared_ptr<Feature> ftr)
     setKeyPoints();
 }
 
+void Frame::w2f(PointBatch& batch) const
+{
+  const size_t n = batch.size();
+  batch.x_f.resize(n);
+  batch.y_f.resize(n);
+  batch.z_f.resize(n);
+  const SE3& T = T_f_w_.inverse();
+  transformPoints(T.rotation_matrix(), T.translation(), n, batch.x_w.data(), batch.y_w.data(), batch.z_w.data(),
+                  batch.x_f.data(), batch.y_f.data(), batch.z_f.data());
+}
+
+void Frame::w2c(PointBatch& batch) const
+{
+  w2f(batch);
+  const size_t n = batch.size();
+  batch.u.resize(n);
+  batch.v.resize(n);
+  batch.visible.resize(n);
+  cam_->world2cam(n, batch.x_f.data(), batch.y_f.data(), batch.z_f.data(), batch.u.data(), batch.v.data());
+  const double width = cam_->width();
+  const double height = cam_->height();
+  for(size_t i=0; i<n; ++i)
+    batch.visible[i] = id_ && batch.z_f[i] >= 0.0 && batch.u[i] >= 0.0 && batch.v[i] >= 0.0
+                       && batch.u[i] < width && batch.v[i] < height;
+}
+
 bool Frame::isVisible(const Vector3d& xyz_w) const
 {
   if(!id_)return false;
   if(xyz_w.hasNaN())return false;
-  Vector3d xyz_f = this->se3().inverse()*xyz_w;
+  Vector3d xyz_f = T_f_w_.inverse()*xyz_w;
   if(xyz_f.z() < 0.0)
     return false; // point is behind the camera
   Vector2d px = f2c(xyz_f);
@@ -155,30 +283,27 @@ bool Frame::isVisible(const Vector3d& xyz_w) const
   return false;
 }
 
-void Frame::createImgPyramid(const cv::Mat& img_level_0, int n_levels, ImgPyr& pyr)
-{
-  pyr.resize(n_levels);
-  pyr[0] = img_level_0;
-  for(int i=1; i<n_levels; ++i)
-  {
-    pyr[i] = cv::Mat(pyr[i-1].rows/2, pyr[i-1].cols/2, CV_8U);
-    vk::halfSample(pyr[i-1], pyr[i]);
-  }
-}
-
 bool Frame::getSceneDepth(vio::Map& map,double& depth_mean, double& depth_min)
 {
+  // depths of all points in one batch, one row per feature as the deletions reset points
+  PointBatch batch;
+  batch.reserve(fts_.size());
+  for(auto&& ftr : fts_)
+    batch.push_back(ftr->point != NULL ? ftr->point->pos_ : Vector3d::Zero());
+  w2f(batch);
+
   vector<double> depth_vec;
-  for(auto it=fts_.begin(); it!=fts_.end();)
+  size_t i = 0;
+  for(auto it=fts_.begin(); it!=fts_.end(); ++i)
   {
       if((*it)->point==NULL){
           ++it;
           continue;
       }
-      double z=w2f((*it)->point->pos_).z();
+      double z=batch.z_f[i];
       if((*it)->point->pos_.hasNaN() || (*it)->point->pos_.norm()==0. || z<0.05 || z > 20.0){
           map.safeDeletePoint((*it)->point);
-          it = fts_.erase(it);
+          it = eraseFeature(it);
           continue;
       }
       depth_vec.push_back(z);
@@ -30,6 +30,9 @@ namespace vio
 {
 
 // definition of global and static variables which were declared in the header
+#ifdef VIO_TRACE
+vk::PerformanceMonitor* g_permon = NULL;
+#endif
 
 FrameHandlerBase::FrameHandlerBase() :
   stage_(STAGE_PAUSED),
@@ -37,10 +40,29 @@ FrameHandlerBase::FrameHandlerBase() :
   set_start_(false),
   num_obs_last_(0)
 {
+#ifdef VIO_TRACE
+  // init monitoring
+  g_permon = new vk::PerformanceMonitor();
+  g_permon->addTimer("pyramid");
+  g_permon->addTimer("fast");
+  g_permon->addTimer("freak");
+  g_permon->addTimer("reproject_match");
+  g_permon->addTimer("sparse_img_align");
+  g_permon->addTimer("pose_optimizer");
+  g_permon->addTimer("point_optimizer");
+  g_permon->addTimer("ba_glob");
+  g_permon->addTimer("imu_update");
+  g_permon->addTimer("cmd_update");
+  g_permon->addTimer("tot_time");
+#endif
 }
 
 FrameHandlerBase::~FrameHandlerBase()
 {
+#ifdef VIO_TRACE
+  delete g_permon;
+  g_permon = NULL;
+#endif
 }
 
 bool FrameHandlerBase::startFrameProcessingCommon(const double timestamp)
@@ -125,6 +147,7 @@ void FrameHandlerBase::posEdit(
                     Eigen::JacobiSVD<Eigen::Matrix<double,4,4>> svd(A, Eigen::ComputeFullU | Eigen::ComputeFullV);
                     const Eigen::Matrix<double,4,1> singular_vector = svd.matrixV().block<4, 1>(0, 3);
                     it->point->pos_=singular_vector.block<3, 1>(0, 0) / singular_vector(3);
+                    it->point->alignmentPointsMoved();
                 }
                 //if(frame->w2f(it->point->pos_).z()<1e-9)map_.safeDeletePoint(it->point);
             }else{
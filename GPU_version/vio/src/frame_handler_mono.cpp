@@ -37,17 +37,16 @@ FrameHandlerMono::FrameHandlerMono(vk::AbstractCamera* cam,Eigen::Matrix<double,
   ukfPtr_(init),
   time_(ros::Time::now())
 {
-    gpu_fast_= new opencl(cam_);
-    gpu_fast_->make_kernel("fast_gray");
-    gpu_fast_->make_kernel("compute_residual");
+    backend_=ComputeBackend::create(cam_,Config::computeBackend(),Config::kernelCacheDir());
+    ROS_INFO("compute backend: %s",backend_->name().c_str());
     initialize();
 #if VIO_DEBUG
-    log_ =fopen((std::string(PROJECT_DIR)+"/frame_handler_log.txt").c_str(),"w+");
-    assert(log_);
-    chmod((std::string(PROJECT_DIR)+"/frame_handler_log.txt").c_str(), ACCESSPERMS);
-    klt_homography_init_=new initialization::KltHomographyInit(gpu_fast_,&ukfPtr_,log_);
+    log_ =new AsyncLogger(std::string(PROJECT_DIR)+"/frame_handler_log.bin");
+    assert(log_->isOpen());
+    chmod((std::string(PROJECT_DIR)+"/frame_handler_log.bin").c_str(), ACCESSPERMS);
+    klt_homography_init_=new initialization::KltHomographyInit(backend_,&ukfPtr_,log_);
 #else
-    klt_homography_init_=new initialization::KltHomographyInit(gpu_fast_&ukfPtr_);
+    klt_homography_init_=new initialization::KltHomographyInit(backend_,&ukfPtr_);
 #endif
 }
 
@@ -60,6 +59,10 @@ void FrameHandlerMono::initialize()
 FrameHandlerMono::~FrameHandlerMono()
 {
   delete ba_glob_;
+  delete backend_;
+#if VIO_DEBUG
+  delete log_;
+#endif
 }
 
 void FrameHandlerMono::addImage(const cv::Mat& img, const double timestamp,const ros::Time& time)
@@ -68,10 +71,11 @@ void FrameHandlerMono::addImage(const cv::Mat& img, const double timestamp,const
   if(!startFrameProcessingCommon(timestamp)){
       return;
   }
+  VIO_SPAN("tot_time");
   // some cleanup from last iteration, can't do before because of visualization
   overlap_kfs_.clear();
   // create new frame
-  new_frame_=std::make_shared<Frame>(cam_, img.clone(), timestamp);
+  new_frame_=std::make_shared<Frame>(cam_, img.clone(), timestamp, backend_);
   time_=time;
   // process frame
   UpdateResult res = RESULT_FAILURE;
@@ -85,7 +89,7 @@ void FrameHandlerMono::addImage(const cv::Mat& img, const double timestamp,const
   // finish processing
   finishFrameProcessingCommon(last_frame_->id_, res, last_frame_->nObs());
 #if VIO_DEBUG
-    fprintf(log_,"[%s] frame process finished the id is: %d the obs is:%d \n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("frame process finished the id is: %d the obs is:%d \n",
             last_frame_->id_,last_frame_->nObs());
 #endif
 
@@ -101,16 +105,16 @@ FrameHandlerMono::UpdateResult FrameHandlerMono::processFirstFrame()
   //map_.addKeyframe(new_frame_);
   stage_ = STAGE_SECOND_FRAME;
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Init: Selected first frame. \n",vio::time_in_HH_MM_SS_MMM().c_str());
+    log_->write("Init: Selected first frame. \n");
 #endif
   return RESULT_IS_KEYFRAME;
 }
 
 FrameHandlerBase::UpdateResult FrameHandlerMono::processSecondFrame()
 {
-  initialization::InitResult res = klt_homography_init_->addSecondFrame(new_frame_);
+  initialization::InitResult res = klt_homography_init_->addSecondFrame(new_frame_, map_);
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Init: distance between the first and current frame is x:%f ,z=%f,angle between two frames: %f \n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("Init: distance between the first and current frame is x:%f ,z=%f,angle between two frames: %f \n",
             new_frame_->T_f_w_.se2().translation().x()-last_frame_->T_f_w_.se2().translation().x(),
             new_frame_->T_f_w_.se2().translation().y()-last_frame_->T_f_w_.se2().translation().y(),
             new_frame_->T_f_w_.pitch()-last_frame_->T_f_w_.pitch());
@@ -129,8 +133,7 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processSecondFrame()
   new_frame_->getSceneDepth(map_,depth_mean, depth_min);
   // add frame to map
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Init: Selected Second frame. \t The number of features: %d depth mean:%f min:%f\n",
-                       vio::time_in_HH_MM_SS_MMM().c_str(),new_frame_->fts_.size(),depth_mean,depth_min);
+    log_->write("Init: Selected Second frame. \t The number of features: %d depth mean:%f min:%f\n",new_frame_->fts_.size(),depth_mean,depth_min);
 #endif
   //ba_glob_->new_key_frame();
   ROS_INFO("VIO initialized :)");
@@ -141,14 +144,15 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processSecondFrame()
 
 FrameHandlerBase::UpdateResult FrameHandlerMono::processFrame()
 {
+  ba_glob_->applyResults();
   auto init_f= ukfPtr_.get_location();
   new_frame_->T_f_w_=init_f.second;
   new_frame_->Cov_ = init_f.first;
-  reprojector_.reprojectMap(new_frame_, last_frame_,overlap_kfs_, gpu_fast_, log_);
+  reprojector_.reprojectMap(new_frame_, last_frame_,overlap_kfs_, backend_, log_);
   int n_point=0;
   for(auto i:overlap_kfs_)n_point+=i.second;
 #if VIO_DEBUG
-    fprintf(log_,"[%s] After Reprojection Map nMatches:%d ,distance between ekf and vo x:%f ,z=%f,angle between two frames:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("After Reprojection Map nMatches:%d ,distance between ekf and vo x:%f ,z=%f,angle between two frames:%f\n",
             n_point,
             new_frame_->T_f_w_.se2().translation().x()-init_f.second.se2().translation().x(),
             new_frame_->T_f_w_.se2().translation().y()-init_f.second.se2().translation().y(),
@@ -157,11 +161,14 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processFrame()
   boost::unique_lock< boost::mutex > lock(ba_glob_->ba_mux_);
   size_t sfba_n_edges_final=0;
   double sfba_thresh, sfba_error_init, sfba_error_final;
-  pose_optimizer::optimizeGaussNewton(
+  {
+    VIO_SPAN("pose_optimizer");
+    pose_optimizer::optimizeGaussNewton(
             10,
             new_frame_, sfba_thresh, sfba_error_init, sfba_error_final, sfba_n_edges_final,map_,log_);
+  }
 #if VIO_DEBUG
-    fprintf(log_,"[%s] After pose optimization, distance between ekf and vo x:%f ,z=%f,angle between two frames:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("After pose optimization, distance between ekf and vo x:%f ,z=%f,angle between two frames:%f\n",
             new_frame_->T_f_w_.se2().translation().x()-init_f.second.se2().translation().x(),
             new_frame_->T_f_w_.se2().translation().y()-init_f.second.se2().translation().y(),
             fabs(new_frame_->T_f_w_.pitch()-init_f.second.pitch()));
@@ -176,17 +183,20 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processFrame()
   new_frame_->T_f_w_ =result.second;
   new_frame_->Cov_ = result.first;
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Update EKF and 3D points the number of feature in the new frame: %d and number of obs: %d\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("Update EKF and 3D points the number of feature in the new frame: %d and number of obs: %d\n",
             new_frame_->fts_.size(),new_frame_->nObs());
 #endif
   double depth_mean=0.0, depth_min=0.0;
     new_frame_->getSceneDepth(map_, depth_mean, depth_min);
 #if VIO_DEBUG
-    fprintf(log_,"[%s] frame Scene Depth mean:%f ,depth min:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("frame Scene Depth mean:%f ,depth min:%f\n",
             depth_mean,
             depth_min);
 #endif
-  optimizeStructure(new_frame_, Config::structureOptimMaxPts(), Config::structureOptimNumIter());
+  {
+    VIO_SPAN("point_optimizer");
+    optimizeStructure(new_frame_, Config::structureOptimMaxPts(), Config::structureOptimNumIter());
+  }
 
   // select keyframe
 
@@ -197,7 +207,7 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processFrame()
 
   new_frame_->setKeyframe();
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Choose frame as a key frame Scene Depth mean:%f ,depth min:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("Choose frame as a key frame Scene Depth mean:%f ,depth min:%f\n",
             depth_mean,
             depth_min);
 #endif
@@ -218,11 +228,15 @@ FrameHandlerBase::UpdateResult FrameHandlerMono::processFrame()
   }
   // add keyframe to map
   map_.addKeyframe(new_frame_);
+#if VIO_DEBUG
+    log_->write("Map validation after key frame %d: %d errors, %d points in %d slots\n", new_frame_->id_,
+                (int)map_.validate(new_frame_->id_), (int)map_.nPoints(), (int)map_.pointCapacity());
+#endif
   if(map_.checkKeyFrames()){
       ba_glob_->new_key_frame();
 /*      std::unique_ptr<feature_detection::FastDetector> detector=std::make_unique<feature_detection::FastDetector>(
-              new_frame_->img().cols, new_frame_->img().rows, Config::gridSize(), gpu_fast_,Config::nPyrLevels());
-      detector->detect(new_frame_, new_frame_->img_pyr_, Config::triangMinCornerScore(), new_frame_->fts_);*/
+              new_frame_->img().cols, new_frame_->img().rows, Config::gridSize(), backend_,Config::nPyrLevels());
+      detector->detect(new_frame_, *new_frame_->img_pyr_, Config::triangMinCornerScore(), new_frame_->fts_);*/
       return RESULT_IS_KEYFRAME;
   }
   return RESULT_FAILURE;
@@ -245,16 +259,21 @@ bool FrameHandlerMono::needNewKf()
       if(it.first->id_==last_frame_->id_)continue;
       if(it.second>com_obs){
           com_obs=it.second;
-          closest_kfs=SE2_5(it.first->T_f_w_.se2());
+          closest_kfs=it.first->T_f_w_;
       }
   }
 #if VIO_DEBUG
-    fprintf(log_,"[%s] need key frame pitch dis: %f translation dif:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("need key frame pitch dis: %f translation dif:%f\n",
             fabs(closest_kfs.pitch()-new_frame_->T_f_w_.pitch()),(closest_kfs.se2().translation()-new_frame_->T_f_w_.se2().translation()).norm());
 #endif
   if(fabs(closest_kfs.pitch()-new_frame_->T_f_w_.pitch()) > 0.1 || fabs((closest_kfs.se2().translation()-new_frame_->T_f_w_.se2().translation()).norm())>0.1)return true;
   return false;
 }
+void FrameHandlerMono::addImage(const cv::Mat& img, const double timestamp)
+{
+    addImage(img, timestamp, ros::Time(timestamp));
+}
+
 void FrameHandlerMono::UpdateIMU(double* value,const ros::Time& time){
     if(value== nullptr)return;
     ukfPtr_.UpdateIMU(value[0],value[1],value[2],time);
@@ -263,5 +282,11 @@ void FrameHandlerMono::UpdateCmd(double* value,const ros::Time& time){
     if(value== nullptr)return;
     ukfPtr_.UpdateCmd(value[0],value[1],value[2],time);
 }
+void FrameHandlerMono::UpdateIMU(double* value,const double timestamp){
+    UpdateIMU(value, ros::Time(timestamp));
+}
+void FrameHandlerMono::UpdateCmd(double* value,const double timestamp){
+    UpdateCmd(value, ros::Time(timestamp));
+}
 
 } // namespace vio
@@ -0,0 +1,199 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/freak_extractor.h>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+
+#if __AVX2__
+# include <immintrin.h>
+#elif __SSE2__
+# include <emmintrin.h>
+#elif __ARM_NEON__ || __ARM_NEON
+# include <arm_neon.h>
+#endif
+
+namespace vio {
+
+FreakExtractor::FreakExtractor(const FreakPattern& pattern) :
+    pattern_(pattern)
+{
+  for(int r=0; r<FreakPattern::kNbPairs/16; ++r)
+  {
+    for(int p=0; p<16; ++p)
+    {
+      // comparison of bit r%8 of byte p of block r/8
+      const FreakPattern::DescriptionPair& pair = pattern_.descriptionPairs()[(r/8)*128+(r%8)*16+15-p];
+      pair_i_[16*r+p] = pair.i;
+      pair_j_[16*r+p] = pair.j;
+    }
+  }
+}
+
+void FreakExtractor::compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, uint8_t* descriptors)
+{
+  compute(img, keypoints, descriptors, integral_);
+}
+
+void FreakExtractor::compute(const cv::Mat& img, const std::vector<cv::KeyPoint>& keypoints, uint8_t* descriptors,
+                             cv::Mat& integral) const
+{
+  assert(img.type() == CV_8UC1);
+  if(keypoints.empty())
+    return;
+  cv::integral(img, integral, CV_32S);
+  cv::parallel_for_(cv::Range(0, (int)keypoints.size()), [&](const cv::Range& range)
+  {
+    alignas(16) uint8_t values[kValuesSize] = {0};
+    for(int k=range.start; k<range.end; ++k)
+    {
+      const cv::KeyPoint& kp = keypoints[k];
+      const int scale = pattern_.scaleIndex(kp.size);
+      assert(pattern_.fits(kp.pt, scale, img.cols, img.rows));
+      for(int i=0; i<FreakPattern::kNbPoints; ++i)
+        values[i] = meanIntensity(img, integral, kp.pt.x, kp.pt.y, scale, 0, i);
+      const int theta = orientation(values);
+      for(int i=0; i<FreakPattern::kNbPoints; ++i)
+        values[i] = meanIntensity(img, integral, kp.pt.x, kp.pt.y, scale, theta, i);
+      describe(values, descriptors+k*FreakPattern::kDescriptorSize);
+    }
+  });
+}
+
+uint8_t FreakExtractor::meanIntensity(const cv::Mat& img, const cv::Mat& integral, float kp_x, float kp_y, int scale,
+                                      int orientation, int point) const
+{
+  const cv::Point2f& offset = pattern_.point(scale, orientation, point);
+  const float xf = offset.x+kp_x;
+  const float yf = offset.y+kp_y;
+  const int x = int(xf);
+  const int y = int(yf);
+  const float radius = pattern_.sigma(scale, point);
+  if(radius < 0.5)
+  {
+    // bilinear interpolation, the divisor of FREAK is four times the weight sum
+    const int r_x = static_cast<int>((xf-x)*1024);
+    const int r_y = static_cast<int>((yf-y)*1024);
+    const int r_x_1 = 1024-r_x;
+    const int r_y_1 = 1024-r_y;
+    unsigned int ret_val = r_x_1*r_y_1*int(img.at<uint8_t>(y, x))
+                         + r_x*r_y_1*int(img.at<uint8_t>(y, x+1))
+                         + r_x_1*r_y*int(img.at<uint8_t>(y+1, x))
+                         + r_x*r_y*int(img.at<uint8_t>(y+1, x+1));
+    ret_val += 2*1024*1024;
+    return static_cast<uint8_t>(ret_val/(4*1024*1024));
+  }
+  const int x_left = cvRound(xf-radius);
+  const int y_top = cvRound(yf-radius);
+  const int x_right = cvRound(xf+radius+1);
+  const int y_bottom = cvRound(yf+radius+1);
+  const int* top = integral.ptr<int>(y_top);
+  const int* bottom = integral.ptr<int>(y_bottom);
+  int ret_val = bottom[x_right]-bottom[x_left]+top[x_left]-top[x_right];
+  const int area = (x_right-x_left)*(y_bottom-y_top);
+  ret_val = (ret_val+area/2)/area;
+  return static_cast<uint8_t>(ret_val);
+}
+
+int FreakExtractor::orientation(const uint8_t* values) const
+{
+  int direction0 = 0;
+  int direction1 = 0;
+  for(int m=0; m<FreakPattern::kNbOrienPairs; ++m)
+  {
+    const FreakPattern::OrientationPair& pair = pattern_.orientationPairs()[m];
+    const int delta = values[pair.i]-values[pair.j];
+    direction0 += delta*pair.weight_dx/2048;
+    direction1 += delta*pair.weight_dy/2048;
+  }
+  // the angle goes through the float of KeyPoint::angle and the bin through double, as in FREAK
+  const float angle = static_cast<float>(std::atan2((double)(float)direction1, (double)(float)direction0)*(180.0/CV_PI));
+  int theta;
+  if(angle < 0.f)
+    theta = int(FreakPattern::kNbOrientation*angle*(1/360.0)-0.5);
+  else
+    theta = int(FreakPattern::kNbOrientation*angle*(1/360.0)+0.5);
+  if(theta < 0)
+    theta += FreakPattern::kNbOrientation;
+  if(theta >= FreakPattern::kNbOrientation)
+    theta -= FreakPattern::kNbOrientation;
+  return theta;
+}
+
+void FreakExtractor::describe(const uint8_t* values, uint8_t* descriptor) const
+{
+  // values of the pairs in descriptor order, then a >= b of 16 pairs sets one bit of 16 bytes
+#if (__ARM_NEON__ || __ARM_NEON) && __aarch64__
+  const uint8x16x3_t table = {{vld1q_u8(values), vld1q_u8(values+16), vld1q_u8(values+32)}};
+  for(int block=0; block<FreakPattern::kDescriptorSize/16; ++block)
+  {
+    uint8x16_t bits = vdupq_n_u8(0);
+    for(int g=0; g<8; ++g)
+    {
+      const int r = 16*(8*block+g);
+      const uint8x16_t a = vqtbl3q_u8(table, vld1q_u8(pair_i_+r));
+      const uint8x16_t b = vqtbl3q_u8(table, vld1q_u8(pair_j_+r));
+      bits = vorrq_u8(bits, vandq_u8(vcgeq_u8(a, b), vdupq_n_u8(1<<g)));
+    }
+    vst1q_u8(descriptor+16*block, bits);
+  }
+#else
+  alignas(32) uint8_t a[FreakPattern::kNbPairs];
+  alignas(32) uint8_t b[FreakPattern::kNbPairs];
+  for(int k=0; k<FreakPattern::kNbPairs; ++k)
+  {
+    a[k] = values[pair_i_[k]];
+    b[k] = values[pair_j_[k]];
+  }
+  for(int block=0; block<FreakPattern::kDescriptorSize/16; ++block)
+  {
+    const uint8_t* a_block = a+128*block;
+    const uint8_t* b_block = b+128*block;
+#if __AVX2__
+    // two bit rows per register, the halves are merged at the end
+    __m256i bits = _mm256_setzero_si256();
+    for(int g=0; g<8; g+=2)
+    {
+      const __m256i va = _mm256_load_si256((const __m256i*)(a_block+16*g));
+      const __m256i vb = _mm256_load_si256((const __m256i*)(b_block+16*g));
+      const __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(va, vb), va);
+      const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi8((char)(1<<g))),
+                                                   _mm_set1_epi8((char)(2<<g)), 1);
+      bits = _mm256_or_si256(bits, _mm256_and_si256(ge, mask));
+    }
+    _mm_storeu_si128((__m128i*)(descriptor+16*block),
+                     _mm_or_si128(_mm256_castsi256_si128(bits), _mm256_extracti128_si256(bits, 1)));
+#elif __SSE2__
+    __m128i bits = _mm_setzero_si128();
+    for(int g=0; g<8; ++g)
+    {
+      const __m128i va = _mm_load_si128((const __m128i*)(a_block+16*g));
+      const __m128i vb = _mm_load_si128((const __m128i*)(b_block+16*g));
+      const __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(va, vb), va);
+      bits = _mm_or_si128(bits, _mm_and_si128(ge, _mm_set1_epi8((char)(1<<g))));
+    }
+    _mm_storeu_si128((__m128i*)(descriptor+16*block), bits);
+#elif __ARM_NEON__ || __ARM_NEON
+    uint8x16_t bits = vdupq_n_u8(0);
+    for(int g=0; g<8; ++g)
+    {
+      const uint8x16_t ge = vcgeq_u8(vld1q_u8(a_block+16*g), vld1q_u8(b_block+16*g));
+      bits = vorrq_u8(bits, vandq_u8(ge, vdupq_n_u8(1<<g)));
+    }
+    vst1q_u8(descriptor+16*block, bits);
+#else
+    for(int p=0; p<16; ++p)
+    {
+      uint8_t bits = 0;
+      for(int g=0; g<8; ++g)
+        bits |= (a_block[16*g+p] >= b_block[16*g+p]) << g;
+      descriptor[16*block+p] = bits;
+    }
+#endif
+  }
+#endif
+}
+
+} // namespace vio
@@ -0,0 +1,132 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/freak_pattern.h>
+#include <algorithm>
+#include <cmath>
+
+namespace vio {
+
+namespace {
+
+const double kLog2 = 0.693147180559945;
+
+/// Indices into the 903 pairs (i, j<i) of the 43 points of the pairs FREAK learned, in the order of
+/// the descriptor bits (FREAK_DEF_PAIRS of OpenCV).
+const int kDefaultPairs[FreakPattern::kNbPairs] =
+{
+    404, 431, 818, 511, 181, 52, 311, 874, 774, 543, 719, 230, 417, 205, 11, 560,
+    149, 265, 39, 306, 165, 857, 250, 8, 61, 15, 55, 717, 44, 412, 592, 134,
+    761, 695, 660, 782, 625, 487, 549, 516, 271, 665, 762, 392, 178, 796, 773, 31,
+    672, 845, 548, 794, 677, 654, 241, 831, 225, 238, 849, 83, 691, 484, 826, 707,
+    122, 517, 583, 731, 328, 339, 571, 475, 394, 472, 580, 381, 137, 93, 380, 327,
+    619, 729, 808, 218, 213, 459, 141, 806, 341, 95, 382, 568, 124, 750, 193, 749,
+    706, 843, 79, 199, 317, 329, 768, 198, 100, 466, 613, 78, 562, 783, 689, 136,
+    838, 94, 142, 164, 679, 219, 419, 366, 418, 423, 77, 89, 523, 259, 683, 312,
+    555, 20, 470, 684, 123, 458, 453, 833, 72, 113, 253, 108, 313, 25, 153, 648,
+    411, 607, 618, 128, 305, 232, 301, 84, 56, 264, 371, 46, 407, 360, 38, 99,
+    176, 710, 114, 578, 66, 372, 653, 129, 359, 424, 159, 821, 10, 323, 393, 5,
+    340, 891, 9, 790, 47, 0, 175, 346, 236, 26, 172, 147, 574, 561, 32, 294,
+    429, 724, 755, 398, 787, 288, 299, 769, 565, 767, 722, 757, 224, 465, 723, 498,
+    467, 235, 127, 802, 446, 233, 544, 482, 800, 318, 16, 532, 801, 441, 554, 173,
+    60, 530, 713, 469, 30, 212, 630, 899, 170, 266, 799, 88, 49, 512, 399, 23,
+    500, 107, 524, 90, 194, 143, 135, 192, 206, 345, 148, 71, 119, 101, 563, 870,
+    158, 254, 214, 276, 464, 332, 725, 188, 385, 24, 476, 40, 231, 620, 171, 258,
+    67, 109, 844, 244, 187, 388, 701, 690, 50, 7, 850, 479, 48, 522, 22, 154,
+    12, 659, 736, 655, 577, 737, 830, 811, 174, 21, 237, 335, 353, 234, 53, 270,
+    62, 182, 45, 177, 245, 812, 673, 355, 556, 612, 166, 204, 54, 248, 365, 226,
+    242, 452, 700, 685, 573, 14, 842, 481, 468, 781, 564, 416, 179, 405, 35, 819,
+    608, 624, 367, 98, 643, 448, 2, 460, 676, 440, 240, 130, 146, 184, 185, 430,
+    65, 807, 377, 82, 121, 708, 239, 310, 138, 596, 730, 575, 477, 851, 797, 247,
+    27, 85, 586, 307, 779, 326, 494, 856, 324, 827, 96, 748, 13, 397, 125, 688,
+    702, 92, 293, 716, 277, 140, 112, 4, 80, 855, 839, 1, 413, 347, 584, 493,
+    289, 696, 19, 751, 379, 76, 73, 115, 6, 590, 183, 734, 197, 483, 217, 344,
+    330, 400, 186, 243, 587, 220, 780, 200, 793, 246, 824, 41, 735, 579, 81, 703,
+    322, 760, 720, 139, 480, 490, 91, 814, 813, 163, 152, 488, 763, 263, 425, 410,
+    576, 120, 319, 668, 150, 160, 302, 491, 515, 260, 145, 428, 97, 251, 395, 272,
+    252, 18, 106, 358, 854, 485, 144, 550, 131, 133, 378, 68, 102, 104, 58, 361,
+    275, 209, 697, 582, 338, 742, 589, 325, 408, 229, 28, 304, 191, 189, 110, 126,
+    486, 211, 547, 533, 70, 215, 670, 249, 36, 581, 389, 605, 331, 518, 442, 822
+};
+
+} // namespace
+
+const FreakPattern& FreakPattern::instance()
+{
+  static const FreakPattern pattern(22.0f, 4);
+  return pattern;
+}
+
+FreakPattern::FreakPattern(float pattern_scale, int n_octaves) :
+    points_(kNbScales*kNbOrientation*kNbPoints),
+    sigmas_(kNbScales*kNbPoints),
+    size_cst_(static_cast<float>(kNbScales/(kLog2*n_octaves)))
+{
+  // points on 7 concentric circles of 6 and the center, radius normalized to 1 (outer point
+  // position+sigma), the circles are staggered by half a step
+  const int n[8] = {6,6,6,6,6,6,6,1};
+  const double big_r = 2.0/3.0;
+  const double small_r = 2.0/24.0;
+  const double unit_space = (big_r-small_r)/21.0;
+  const double radius[8] = {big_r, big_r-6*unit_space, big_r-11*unit_space, big_r-15*unit_space,
+                            big_r-18*unit_space, big_r-20*unit_space, small_r, 0.0};
+  const double sigma[8] = {radius[0]/2.0, radius[1]/2.0, radius[2]/2.0, radius[3]/2.0,
+                           radius[4]/2.0, radius[5]/2.0, radius[6]/2.0, radius[6]/2.0};
+  const double scale_step = std::pow(2.0, (double)n_octaves/kNbScales);
+  for(int scale=0; scale<kNbScales; ++scale)
+  {
+    sizes_[scale] = 0;
+    const double scaling_factor = std::pow(scale_step, scale);
+    for(int orientation=0; orientation<kNbOrientation; ++orientation)
+    {
+      const double theta = double(orientation)*2*CV_PI/double(kNbOrientation);
+      int point = 0;
+      for(int i=0; i<8; ++i)
+      {
+        for(int k=0; k<n[i]; ++k, ++point)
+        {
+          const double beta = CV_PI/n[i]*(i%2);
+          const double alpha = double(k)*2*CV_PI/double(n[i])+beta+theta;
+          points_[(scale*kNbOrientation+orientation)*kNbPoints+point] =
+              cv::Point2f(static_cast<float>(radius[i]*cos(alpha)*scaling_factor*pattern_scale),
+                          static_cast<float>(radius[i]*sin(alpha)*scaling_factor*pattern_scale));
+          sigmas_[scale*kNbPoints+point] = static_cast<float>(sigma[i]*scaling_factor*pattern_scale);
+          const int size_max = static_cast<int>(ceil((radius[i]+sigma[i])*scaling_factor*pattern_scale))+1;
+          if(sizes_[scale] < size_max)
+            sizes_[scale] = size_max;
+        }
+      }
+    }
+  }
+
+  // orientation from the gradients between the points of the 5 outer circles: opposite points
+  // and points two apart
+  const int circle_pairs[9][2] = {{0,3},{1,4},{2,5},{0,2},{1,3},{2,4},{3,5},{4,0},{5,1}};
+  for(int m=0; m<kNbOrienPairs; ++m)
+  {
+    OrientationPair& pair = orientation_pairs_[m];
+    pair.i = (m/9)*6+circle_pairs[m%9][0];
+    pair.j = (m/9)*6+circle_pairs[m%9][1];
+    const float dx = points_[pair.i].x-points_[pair.j].x;
+    const float dy = points_[pair.i].y-points_[pair.j].y;
+    const float norm_sq = dx*dx+dy*dy;
+    pair.weight_dx = int((dx/norm_sq)*4096.0+0.5);
+    pair.weight_dy = int((dy/norm_sq)*4096.0+0.5);
+  }
+
+  std::vector<DescriptionPair> all_pairs;
+  for(int i=1; i<kNbPoints; ++i)
+    for(int j=0; j<i; ++j)
+      all_pairs.push_back(DescriptionPair{(uint8_t)i, (uint8_t)j});
+  for(int k=0; k<kNbPairs; ++k)
+    description_pairs_[k] = all_pairs[kDefaultPairs[k]];
+}
+
+int FreakPattern::scaleIndex(float size) const
+{
+  const int scale = std::max((int)(std::log(size/kSmallestKpSize)*size_cst_+0.5), 0);
+  return std::min(scale, kNbScales-1);
+}
+
+} // namespace vio
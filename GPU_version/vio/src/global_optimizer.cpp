@@ -48,15 +48,18 @@ namespace vio {
             assert(false && "Camera initialization in BA");
         }
 #if VIO_DEBUG
-        log_ =fopen((std::string(PROJECT_DIR)+"/loop_closure_log.txt").c_str(),"w+");
-        assert(log_);
-        chmod((std::string(PROJECT_DIR)+"/loop_closure_log.txt").c_str(), ACCESSPERMS);
+        log_ =new AsyncLogger(std::string(PROJECT_DIR)+"/loop_closure_log.bin");
+        assert(log_->isOpen());
+        chmod((std::string(PROJECT_DIR)+"/loop_closure_log.bin").c_str(), ACCESSPERMS);
 #endif
     }
 
     BA_Glob::~BA_Glob()
     {
         stopThread();
+#if VIO_DEBUG
+        delete log_;
+#endif
     }
 
     void BA_Glob::startThread()
@@ -75,7 +78,7 @@ namespace vio {
             thread_ = NULL;
         }
 #if VIO_DEBUG
-        fclose(log_);
+        log_->flush();
 #endif
     }
     void BA_Glob::updateLoop()
@@ -86,10 +89,10 @@ namespace vio {
             while(map_.keyframes_.empty() || new_keyframe_ == false)
                 cond_.wait(lk);
 #if VIO_DEBUG
-            fprintf(log_,"[%s] BA loop run \n",
-                    vio::time_in_HH_MM_SS_MMM().c_str());
+            log_->write("BA loop run \n");
 #endif
             new_keyframe_=false;
+            VIO_SPAN("ba_glob");
             // init g2o
             g2o::OptimizableGraph::VertexContainer points;
             ba_mux_.lock();
@@ -141,8 +144,7 @@ namespace vio {
             structure_only_ba.calc(points, vio::Config::lobaNumIter());
 
 #if VIO_DEBUG
-            fprintf(log_,"[%s] init error: %f \n",
-                    vio::time_in_HH_MM_SS_MMM().c_str(),optimizer_->activeChi2());
+            log_->write("init error: %f \n",optimizer_->activeChi2());
 #endif
             if(optimizer_->optimize(vio::Config::lobaNumIter())<1){
                 optimizer_->clear();
@@ -150,22 +152,24 @@ namespace vio {
                 continue;
             }
 #if VIO_DEBUG
-            fprintf(log_,"[%s] end error: %f \n",
-                    vio::time_in_HH_MM_SS_MMM().c_str(),optimizer_->activeChi2());
+            log_->write("end error: %f \n",optimizer_->activeChi2());
 #endif
-            // Update Keyframe and MapPoint Positions
+            // Keep the Keyframe and MapPoint Positions for applyResults(), the tracking thread reads
+            // them without a lock
+            kf_results_.clear();
+            pt_results_.clear();
             for(list<FramePtr>::iterator it_kf = map_.keyframes_.begin();
                 it_kf != map_.keyframes_.end();++it_kf)
             {
-                (*it_kf)->T_f_w_ = SE2_5(SE3((*it_kf)->v_kf_->estimate().rotation().toRotationMatrix(),
-                                        (*it_kf)->v_kf_->estimate().translation()));
+                kf_results_.push_back(std::make_pair(*it_kf, SE2_5(SE3((*it_kf)->v_kf_->estimate().rotation().toRotationMatrix(),
+                                                                      (*it_kf)->v_kf_->estimate().translation()))));
                 for(Features::iterator it_ftr=(*it_kf)->fts_.begin(); it_ftr!=(*it_kf)->fts_.end(); ++it_ftr)
                 {
                     if((*it_ftr)->point == NULL)
                         continue;
                     if((*it_ftr)->point->v_pt_ == NULL)
                         continue;       // mp was updated before
-                    (*it_ftr)->point->pos_ = (*it_ftr)->point->v_pt_->estimate();
+                    pt_results_.push_back(std::make_pair((*it_ftr)->point, (*it_ftr)->point->v_pt_->estimate()));
                     (*it_ftr)->point->v_pt_.reset();
                 }
             }
@@ -174,6 +178,25 @@ namespace vio {
         }
     }
 
+    void BA_Glob::applyResults()
+    {
+        boost::unique_lock<boost::mutex> lock(ba_mux_, boost::try_to_lock);
+        if(!lock.owns_lock() || kf_results_.empty())
+            return;
+        for(auto&& r:kf_results_)
+        {
+            r.first->T_f_w_ = r.second;
+            r.first->alignmentPointsMoved();
+            map_.updateKeyframe(r.first);
+        }
+        // the points deleted since are NULL
+        for(auto&& r:pt_results_)
+            if(r.first != NULL)
+                r.first->pos_ = r.second;
+        kf_results_.clear();
+        pt_results_.clear();
+    }
+
    std::shared_ptr<g2o::VertexSE3Expmap>
    BA_Glob::createG2oFrameSE3(FramePtr frame, bool state)
    {
@@ -221,7 +244,7 @@ namespace vio {
    void BA_Glob::reset_map(){
         for(auto&& f:map_.keyframes_){
             f->v_kf_.reset();
-            for(auto p:f->fts_)
+            for(auto&& p:f->fts_)
                 if(p->point!=NULL)
                     p->point->v_pt_.reset();
         }
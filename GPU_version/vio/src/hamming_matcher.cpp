@@ -0,0 +1,169 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/hamming_matcher.h>
+#include <opencv2/core/utility.hpp>
+#include <limits>
+#include <string.h>
+
+#if __AVX512F__ && __AVX512VPOPCNTDQ__
+# include <immintrin.h>
+#elif __AVX2__
+# include <immintrin.h>
+#elif __ARM_NEON__ || __ARM_NEON
+# include <arm_neon.h>
+#endif
+
+namespace vio {
+
+namespace {
+
+/// Popcount of a xor b over 64 bytes. For bit pairs (NORM_HAMMING2) the two bits of a pair are
+/// folded onto the lower one first, a shift across a byte border only reaches the masked bit.
+inline int hammingDistance(const uint8_t* a, const uint8_t* b, bool pairs)
+{
+#if __AVX512F__ && __AVX512VPOPCNTDQ__
+  __m512i x = _mm512_xor_si512(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+  if(pairs)
+    x = _mm512_and_si512(_mm512_or_si512(x, _mm512_srli_epi64(x, 1)), _mm512_set1_epi8(0x55));
+  return (int)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+#elif __AVX2__
+  const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                       0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)a), _mm256_loadu_si256((const __m256i*)b));
+  __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a+32)), _mm256_loadu_si256((const __m256i*)(b+32)));
+  if(pairs)
+  {
+    const __m256i m55 = _mm256_set1_epi8(0x55);
+    x0 = _mm256_and_si256(_mm256_or_si256(x0, _mm256_srli_epi16(x0, 1)), m55);
+    x1 = _mm256_and_si256(_mm256_or_si256(x1, _mm256_srli_epi16(x1, 1)), m55);
+  }
+  // per byte popcount of both nibbles, at most 16 per byte after adding both halves
+  const __m256i c0 = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x0, low)),
+                                     _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x0, 4), low)));
+  const __m256i c1 = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x1, low)),
+                                     _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x1, 4), low)));
+  const __m256i sum = _mm256_sad_epu8(_mm256_add_epi8(c0, c1), _mm256_setzero_si256());
+  const __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  return (int)(_mm_cvtsi128_si64(sum128)+_mm_extract_epi64(sum128, 1));
+#elif __ARM_NEON__ || __ARM_NEON
+  uint8x16_t count = vdupq_n_u8(0);
+  for(int i=0; i<64; i+=16)
+  {
+    uint8x16_t x = veorq_u8(vld1q_u8(a+i), vld1q_u8(b+i));
+    if(pairs)
+      x = vandq_u8(vorrq_u8(x, vshrq_n_u8(x, 1)), vdupq_n_u8(0x55));
+    count = vaddq_u8(count, vcntq_u8(x));
+  }
+#if __aarch64__
+  return vaddlvq_u8(count);
+#else
+  const uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(count)));
+  return (int)(vgetq_lane_u64(sum, 0)+vgetq_lane_u64(sum, 1));
+#endif
+#else
+  int distance = 0;
+  for(int i=0; i<64; i+=8)
+  {
+    uint64_t x, y;
+    memcpy(&x, a+i, 8);
+    memcpy(&y, b+i, 8);
+    x ^= y;
+    if(pairs)
+      x = (x | (x >> 1)) & 0x5555555555555555ull;
+    distance += __builtin_popcountll(x);
+  }
+  return distance;
+#endif
+}
+
+/// Best and second best distance of a query.
+struct Best
+{
+  int train = -1;
+  int distance = std::numeric_limits<int>::max();
+  int second = std::numeric_limits<int>::max();
+
+  void add(int t, int d)
+  {
+    if(d < distance)
+    {
+      second = distance;
+      distance = d;
+      train = t;
+    }
+    else if(d < second)
+      second = d;
+  }
+};
+
+/// Matches of the queries with a best train descriptor which pass the ratio test of k == 2.
+void collect(const std::vector<Best>& best, const HammingMatcher::Options& options, std::vector<cv::DMatch>& matches)
+{
+  for(size_t q=0; q<best.size(); ++q)
+  {
+    if(best[q].train < 0)
+      continue;
+    if(options.k == 2 && best[q].second != std::numeric_limits<int>::max() &&
+       !(best[q].distance < options.ratio*best[q].second))
+      continue;
+    matches.push_back(cv::DMatch((int)q, best[q].train, static_cast<float>(best[q].distance)));
+  }
+}
+
+} // namespace
+
+HammingMatcher::HammingMatcher(const Options& options) :
+    options_(options)
+{
+  assert(options_.k == 1 || options_.k == 2);
+}
+
+int HammingMatcher::distance(const uint8_t* a, const uint8_t* b, Norm norm)
+{
+  return hammingDistance(a, b, norm == NORM_HAMMING2);
+}
+
+void HammingMatcher::match(const uint8_t* query, int n_query, const uint8_t* train, int n_train,
+                           std::vector<cv::DMatch>& matches, const uint8_t* const* masks) const
+{
+  if(n_query <= 0 || n_train <= 0)
+    return;
+  const bool pairs = options_.norm == NORM_HAMMING2;
+  std::vector<Best> best(n_query);
+  cv::parallel_for_(cv::Range(0, n_query), [&](const cv::Range& range)
+  {
+    for(int q=range.start; q<range.end; ++q)
+    {
+      const uint8_t* desc = query+q*kDescriptorSize;
+      const uint8_t* mask = masks != NULL ? masks[q] : NULL;
+      for(int t=0; t<n_train; ++t)
+        if(mask == NULL || mask[t] != 0)
+          best[q].add(t, hammingDistance(desc, train+t*kDescriptorSize, pairs));
+    }
+  });
+  collect(best, options_, matches);
+}
+
+void HammingMatcher::match(const uint8_t* query, int n_query, const uint8_t* train, const int* offsets,
+                           const int* candidates, std::vector<cv::DMatch>& matches) const
+{
+  if(n_query <= 0)
+    return;
+  const bool pairs = options_.norm == NORM_HAMMING2;
+  std::vector<Best> best(n_query);
+  cv::parallel_for_(cv::Range(0, n_query), [&](const cv::Range& range)
+  {
+    for(int q=range.start; q<range.end; ++q)
+    {
+      const uint8_t* desc = query+q*kDescriptorSize;
+      for(int c=offsets[q]; c<offsets[q+1]; ++c)
+        best[q].add(candidates[c], hammingDistance(desc, train+candidates[c]*kDescriptorSize, pairs));
+    }
+  });
+  collect(best, options_, matches);
+}
+
+} // namespace vio
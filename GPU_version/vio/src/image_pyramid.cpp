@@ -0,0 +1,44 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/image_pyramid.h>
+#include <vio/vision.h>
+
+namespace vio {
+
+ImagePyramid::ImagePyramid(const cv::Mat& img_level_0, int n_levels) :
+  host_(n_levels),
+  ready_(new std::atomic<bool>[n_levels])
+{
+  assert(n_levels > 0 && img_level_0.type() == CV_8UC1);
+  host_[0] = img_level_0;
+  ready_[0].store(true, std::memory_order_relaxed);
+  for(int i=1; i<n_levels; ++i)
+    ready_[i].store(false, std::memory_order_relaxed);
+}
+
+const ImgPyr& ImagePyramid::host() const
+{
+  for(int i=1; i<size(); ++i)
+    level(i);
+  return host_;
+}
+
+void ImagePyramid::materialize(int level) const
+{
+  if(ready_[level].load(std::memory_order_relaxed))
+    return;
+  cv::Mat img(rows(level), cols(level), CV_8U);
+  download(level, img);
+  host_[level] = img;
+  ready_[level].store(true, std::memory_order_release);
+}
+
+void ImagePyramid::download(int level, cv::Mat& img) const
+{
+  materialize(level-1);
+  vk::halfSample(host_[level-1], img);
+}
+
+} // namespace vio
@@ -18,6 +18,7 @@
 #include <vio/frame.h>
 #include <vio/point.h>
 #include <vio/feature.h>
+#include <vio/map.h>
 #include <vio/initialization.h>
 #include <vio/feature_detection.h>
 #include <vio/math_utils.h>
@@ -30,14 +31,14 @@ InitResult KltHomographyInit::addFirstFrame(FramePtr frame_ref)
   reset();
   features_ref_.clear();
   px_ref_.clear();
-  detectFeatures(frame_ref, px_ref_, features_ref_, gpu_fast_);
+  detectFeatures(frame_ref, px_ref_, features_ref_, backend_);
   if(px_ref_.size() < 100)
   {
     ROS_WARN("Process first frame. Detected observations are px=%d, features=%d less than 100",px_ref_.size(),features_ref_.size());
     return FAILURE;
   }
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Init: frame zero: %f, %f %f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("Init: frame zero: %f, %f %f\n",
             frame_ref->T_f_w_.se2().translation().x(),
             frame_ref->T_f_w_.se2().translation().y(),
             frame_ref->T_f_w_.pitch());
@@ -47,7 +48,7 @@ InitResult KltHomographyInit::addFirstFrame(FramePtr frame_ref)
   return SUCCESS;
 }
 
-InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
+InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur, Map& map)
 {
   trackKlt(frame_ref_, frame_cur, px_ref_, px_cur_, features_ref_, disparities_);
   if(disparities_.size() < 1){
@@ -56,7 +57,7 @@ InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
   }
   if(disparities_.size() < 20){
 #if VIO_DEBUG
-      fprintf(log_,"[%s] VIO can not be initialized goodbye :)\n",vio::time_in_HH_MM_SS_MMM().c_str());
+      log_->write("VIO can not be initialized goodbye :)\n");
 #endif
       assert(0);
   }
@@ -66,7 +67,7 @@ InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
         auto result=ukf_->get_location();
         if(fabs(result.second.se2().translation().x())>0.2 || fabs(result.second.pitch())>0.0698132)ukf_->UpdateVO(0.0,result.second.se2().translation().y(),0.0);
 #if VIO_DEBUG
-        fprintf(log_,"[%s] Init: px average disparity is:%f ,While minimum is: %f  KLT tracked : %d\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+        log_->write("Init: px average disparity is:%f ,While minimum is: %f  KLT tracked : %d\n",
                 disparity,
                 Config::initMinDisparity(),
                 disparities_.size());
@@ -79,8 +80,7 @@ InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
       inliers_, xyz_in_cur_, T_cur_from_ref_);
   if(inliers_.size() < Config::initMinInliers()){
 #if VIO_DEBUG
-      fprintf(log_,"[%s] Init: Homography RANSAC (inlier) is:%d ,While %d inliers minimum required.  px average disparity is:%f ,While minimum is: %f  KLT tracked: %d\n",
-              vio::time_in_HH_MM_SS_MMM().c_str(),
+      log_->write("Init: Homography RANSAC (inlier) is:%d ,While %d inliers minimum required.  px average disparity is:%f ,While minimum is: %f  KLT tracked: %d\n",
               inliers_.size(),
               Config::initMinInliers(),
               disparity,
@@ -96,7 +96,7 @@ InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
           if(frame_cur->cam_->isInFrame(Vector2d(px_cur_.at(f.index).x,px_cur_.at(f.index).y).cast<int>(), 10) &&
              frame_ref_->cam_->isInFrame(f.item->px.cast<int>(), 10)){
               Vector3d pos = xyz_in_cur_.at(f.index);
-              std::shared_ptr<Point> new_point = std::make_shared<Point>(pos);
+              PointHandle new_point = map.newPoint(pos);
               std::shared_ptr<Feature> ftr_cur=std::make_shared<Feature>(frame_cur, new_point, Vector2d(px_cur_.at(f.index).x,px_cur_.at(f.index).y),
                                                                          frame_cur->c2f(px_cur_.at(f.index).x,px_cur_.at(f.index).y), f.item->score,f.item->level,f.item->descriptor);
               frame_cur->addFeature(ftr_cur);
@@ -113,8 +113,7 @@ InitResult KltHomographyInit::addSecondFrame(FramePtr frame_cur)
   }
   //debug(frame_ref_,frame_cur);
 #if VIO_DEBUG
-    fprintf(log_,"[%s] Init finished: Homography RANSAC (inlier) is:%d ,While %d inliers minimum required.  px average disparity is:%f ,While minimum is: %f  KLT tracked: %d\n",
-            vio::time_in_HH_MM_SS_MMM().c_str(),
+    log_->write("Init finished: Homography RANSAC (inlier) is:%d ,While %d inliers minimum required.  px average disparity is:%f ,While minimum is: %f  KLT tracked: %d\n",
             inliers_.size(),
             Config::initMinInliers(),
             disparity,
@@ -134,12 +133,12 @@ void detectFeatures(
     FramePtr frame,
     vector<cv::Point2f>& px_vec,
     Features& new_features,
-    opencl* gpu_fast)
+    ComputeBackend* backend)
 {
 
   std::unique_ptr<feature_detection::FastDetector> detector=std::make_unique<feature_detection::FastDetector>(
-      frame->img().cols, frame->img().rows, Config::gridSize(), gpu_fast,Config::nPyrLevels());
-  detector->detect(frame, frame->img_pyr_, Config::triangMinCornerScore(), new_features);
+      frame->img().cols, frame->img().rows, Config::gridSize(), backend,Config::nPyrLevels());
+  detector->detect(frame, *frame->img_pyr_, Config::triangMinCornerScore(), new_features);
 
   // now for all maximum corners, initialize a new seed
   px_vec.clear();
@@ -163,8 +162,8 @@ void trackKlt(
         vector<float> error;
         vector<float> min_eig_vec;
         cv::TermCriteria termcrit(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, klt_max_iter, klt_eps);
-        if(frame_ref->img_pyr_[0].empty() || frame_cur->img_pyr_[0].empty())return;
-        cv::calcOpticalFlowPyrLK(frame_ref->img_pyr_[0], frame_cur->img_pyr_[0],
+        if(frame_ref->img().empty() || frame_cur->img().empty())return;
+        cv::calcOpticalFlowPyrLK(frame_ref->img(), frame_cur->img(),
                                  px_ref, px_cur,
                                  status, error,
                                  cv::Size2i(klt_win_size, klt_win_size),
@@ -0,0 +1,139 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <math.h>
+#include <algorithm>
+#include <vio/keyframe_grid.h>
+#include <vio/frame.h>
+
+namespace vio {
+
+KeyframeGrid::KeyframeGrid(double cell_size) :
+    cell_size_(cell_size)
+{}
+
+void KeyframeGrid::clear()
+{
+  cells_.clear();
+  cell_of_.clear();
+}
+
+int64_t KeyframeGrid::key(const Vector2d& pos) const
+{
+  return key((int) floor(pos[0] / cell_size_), (int) floor(pos[1] / cell_size_));
+}
+
+void KeyframeGrid::insert(const FramePtr& kf)
+{
+  const int64_t k = key(kf->pos());
+  cells_[k].push_back(kf);
+  cell_of_[kf.get()] = k;
+}
+
+void KeyframeGrid::erase(const Frame* kf)
+{
+  auto it = cell_of_.find(kf);
+  if(it == cell_of_.end())
+    return;
+  auto cell = cells_.find(it->second);
+  std::vector<FramePtr>& kfs = cell->second;
+  kfs.erase(std::find_if(kfs.begin(), kfs.end(), [kf](const FramePtr& f){ return f.get() == kf; }));
+  if(kfs.empty())
+    cells_.erase(cell);
+  cell_of_.erase(it);
+}
+
+void KeyframeGrid::update(const FramePtr& kf)
+{
+  auto it = cell_of_.find(kf.get());
+  if(it == cell_of_.end() || it->second == key(kf->pos()))
+    return;
+  erase(kf.get());
+  insert(kf);
+}
+
+void KeyframeGrid::query(const Vector2d& pos, double pitch, double radius, double max_angle,
+                         std::vector<FramePtr>& kfs) const
+{
+  const int ix0 = (int) floor((pos[0] - radius) / cell_size_);
+  const int ix1 = (int) floor((pos[0] + radius) / cell_size_);
+  const int iz0 = (int) floor((pos[1] - radius) / cell_size_);
+  const int iz1 = (int) floor((pos[1] + radius) / cell_size_);
+  auto add = [&](const std::vector<FramePtr>& cell)
+  {
+    for(auto&& kf : cell)
+    {
+      if((kf->pos() - pos).norm() > radius)
+        continue;
+      const double dpitch = remainder(kf->T_f_w_.pitch() - pitch, 2.0 * M_PI);
+      if(fabs(dpitch) <= max_angle)
+        kfs.push_back(kf);
+    }
+  };
+  // the cells in the square around pos, or the occupied ones if there are fewer
+  if((size_t)(ix1 - ix0 + 1) * (size_t)(iz1 - iz0 + 1) <= cells_.size())
+  {
+    for(int ix=ix0; ix<=ix1; ++ix)
+      for(int iz=iz0; iz<=iz1; ++iz)
+      {
+        auto it = cells_.find(key(ix, iz));
+        if(it != cells_.end())
+          add(it->second);
+      }
+  }
+  else
+  {
+    for(auto&& c : cells_)
+    {
+      int ix, iz;
+      cell(c.first, ix, iz);
+      if(ix >= ix0 && ix <= ix1 && iz >= iz0 && iz <= iz1)
+        add(c.second);
+    }
+  }
+}
+
+FramePtr KeyframeGrid::furthest(const Vector2d& pos) const
+{
+  // a keyframe of a cell is at least as far as the nearest point of the cell and at most as far
+  // as its furthest corner, the furthest keyframe is in a cell reaching the largest lower bound
+  std::vector<std::pair<double, const std::vector<FramePtr>*> > bounds;
+  bounds.reserve(cells_.size());
+  double lower = 0.0;
+  for(auto&& c : cells_)
+  {
+    int ix, iz;
+    cell(c.first, ix, iz);
+    const double x0 = ix * cell_size_ - pos[0], x1 = x0 + cell_size_;
+    const double z0 = iz * cell_size_ - pos[1], z1 = z0 + cell_size_;
+    const double near_x = std::max(0.0, std::max(x0, -x1));
+    const double near_z = std::max(0.0, std::max(z0, -z1));
+    const double far_x = std::max(fabs(x0), fabs(x1));
+    const double far_z = std::max(fabs(z0), fabs(z1));
+    lower = std::max(lower, sqrt(near_x*near_x + near_z*near_z));
+    bounds.push_back(std::make_pair(sqrt(far_x*far_x + far_z*far_z), &c.second));
+  }
+
+  FramePtr furthest_kf;
+  double maxdist = 0.0;
+  for(auto&& b : bounds)
+  {
+    if(b.first < lower)
+      continue;
+    for(auto&& kf : *b.second)
+    {
+      if(kf->T_f_w_.empty())
+        continue;
+      const double dist = (kf->pos() - pos).norm();
+      if(dist > maxdist)
+      {
+        maxdist = dist;
+        furthest_kf = kf;
+      }
+    }
+  }
+  return furthest_kf;
+}
+
+} // namespace vio
@@ -15,16 +15,20 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <set>
+#include <algorithm>
 #include <vio/map.h>
 #include <vio/point.h>
 #include <vio/frame.h>
 #include <vio/feature.h>
+#include <vio/config.h>
 #include <boost/bind.hpp>
 #include <vio/for_it.hpp>
 
 namespace vio {
 
-Map::Map() {}
+Map::Map() :
+    kf_grid_(Config::kfGridCellSize())
+{}
 
 Map::~Map()
 {
@@ -34,7 +38,13 @@ Map::~Map()
 void Map::reset()
 {
   keyframes_.clear();
+  {
+    boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+    kf_grid_.clear();
+  }
   emptyTrash();
+  // after the keyframes, a released frame still drops its observations from the points
+  points_.clear();
 }
 
 bool Map::safeDeleteFrame(FramePtr frame)
@@ -50,18 +60,21 @@ bool Map::safeDeleteFrame(FramePtr frame)
           break;
       }
   }
-  std::list<std::shared_ptr<Frame>>::iterator left=keyframes_.begin();
-  std::advance(left,position);
-  keyframes_.erase(left);
-
   if(found)
+  {
+    std::list<std::shared_ptr<Frame>>::iterator left=keyframes_.begin();
+    std::advance(left,position);
+    keyframes_.erase(left);
+    boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+    kf_grid_.erase(frame.get());
     return true;
+  }
 
   //VIO_ERROR_STREAM("Tried to delete Keyframe in map which was not there.");
   return false;
 }
 
-void Map::removePtFrameRef(FramePtr frame, std::shared_ptr<Feature> ftr)
+void Map::removePtFrameRef(const FramePtr& frame, const std::shared_ptr<Feature>& ftr)
 {
   if(ftr->point == NULL)
     return; // mappoint may have been deleted in a previous ref. removal
@@ -71,11 +84,11 @@ void Map::removePtFrameRef(FramePtr frame, std::shared_ptr<Feature> ftr)
     safeDeletePoint(ftr->point);
     return;
   }
-  ftr->point->deleteFrameRef(frame);  // Remove reference from map_point
+  ftr->point->deleteFrameRef(frame.get());  // Remove reference from map_point
   frame->removeKeyPoint(ftr); // Check if mp was keyMp in keyframe
 }
 
-void Map::safeDeletePoint(std::shared_ptr<Point> pt)
+void Map::safeDeletePoint(PointHandle pt)
 {
   boost::unique_lock<boost::mutex> lock(point_mut_);
   // Delete references to mappoints in all keyframes
@@ -85,6 +98,7 @@ void Map::safeDeletePoint(std::shared_ptr<Point> pt)
           if(ftr->frame!=nullptr){
               if(ftr->frame->is_keyframe_){
                   ftr->frame->removeKeyPoint(ftr);
+                  ftr->frame->invalidateAlignmentReference();
               }
           }
           if(ftr->point!=nullptr)ftr->point.reset();
@@ -92,6 +106,8 @@ void Map::safeDeletePoint(std::shared_ptr<Point> pt)
   }else{
       if(!pt->obs_.empty()){
           if(pt->obs_.front()->point!=nullptr){
+              if(pt->obs_.front()->frame!=nullptr && pt->obs_.front()->frame->is_keyframe_)
+                  pt->obs_.front()->frame->invalidateAlignmentReference();
               pt->obs_.back()->point.reset();
           }
       }
@@ -101,7 +117,7 @@ void Map::safeDeletePoint(std::shared_ptr<Point> pt)
   deletePoint(pt);
 }
 
-void Map::deletePoint(std::shared_ptr<Point> pt)
+void Map::deletePoint(PointHandle pt)
 {
   pt->type_ = Point::TYPE_DELETED;
   trash_points_.push_back(pt);
@@ -110,33 +126,77 @@ void Map::deletePoint(std::shared_ptr<Point> pt)
 void Map::addKeyframe(FramePtr new_keyframe)
 {
   keyframes_.push_back(new_keyframe);
+  boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+  kf_grid_.insert(new_keyframe);
+}
+
+void Map::updateKeyframe(const FramePtr& kf)
+{
+  boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+  kf_grid_.update(kf);
 }
 
 
 FramePtr Map::getFurthestKeyframe(const Vector2d& pos)
 {
-  FramePtr furthest_kf;
-  double maxdist = 0.0;
-  for(auto it=keyframes_.begin(); it!=keyframes_.end(); )
+  boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+  return kf_grid_.furthest(pos);
+}
+
+
+void Map::getCloseKeyframes(const FramePtr& frame, list< pair<FramePtr,double> >& close_kfs)
+{
+  // only keyframes near the frame, heading less than its horizontal field of view apart, can overlap
+  const vk::AbstractCamera* cam = frame->cam_;
+  const Vector3d left = cam->cam2world(0.0, 0.5 * cam->height());
+  const Vector3d right = cam->cam2world(cam->width() - 1.0, 0.5 * cam->height());
+  const double fov = fabs(atan2(right[0], right[2]) - atan2(left[0], left[2]));
+  vector<FramePtr> kfs;
+  {
+    boost::unique_lock<boost::mutex> lock(kf_grid_mut_);
+    kf_grid_.query(frame->pos(), frame->T_f_w_.pitch(), Config::closeKfsRadius(), fov, kfs);
+  }
+
+  // project the key points of these keyframes in one batch, offsets[k] is the first of keyframe k
+  PointBatch batch;
+  vector<size_t> offsets;
+  offsets.reserve(kfs.size()+1);
+  for(auto&& kf : kfs)
+  {
+    offsets.push_back(batch.size());
+    for(auto&& keypoint : kf->key_pts_)
+    {
+      if(keypoint == nullptr)
+        continue;
+      if(keypoint->point==NULL)continue;
+      batch.push_back(keypoint->point->pos_);
+    }
+  }
+  offsets.push_back(batch.size());
+  frame->w2c(batch);
+
+  size_t k = 0;
+  for(auto&& kf : kfs)
   {
-      if((*it)->T_f_w_.empty()){
-          it=keyframes_.erase(it);
+    // check if kf has overlaping field of view with frame, use therefore KeyPoints
+    for(size_t i=offsets[k]; i<offsets[k+1]; ++i)
+    {
+      if(batch.visible[i])
+      {
+        close_kfs.push_back(
+                std::make_pair(
+                        kf, (frame->pos()-kf->pos()).norm()));
+        break; // this keyframe has an overlapping field of view -> add to close_kfs
       }
-    double dist = ((*it)->pos()-pos).norm();
-    if(dist > maxdist) {
-      maxdist = dist;
-      furthest_kf = *it;
     }
-      ++it;
+    ++k;
   }
-  return furthest_kf;
 }
 
-
 void Map::emptyTrash()
 {
   if(trash_points_.empty())return;
-  for(auto&& t:trash_points_)t.reset();
+  for(auto&& t:trash_points_)points_.destroy(t);
   trash_points_.clear();
 }
 bool Map::checkKeyFrames() {
@@ -152,76 +212,80 @@ bool Map::checkKeyFrames() {
 }
 
 
-namespace map_debug {
-
-void mapValidation(Map* map, int id)
-{
-  for(auto&& it:map->keyframes_)
-    frameValidation(it, id);
-
-}
-
-void frameValidation(FramePtr frame, int id)
+size_t Map::validate(int id) const
 {
-  for(auto it = frame->fts_.begin(); it!=frame->fts_.end(); ++it)
+  size_t n_errors = 0;
+  std::set<const Point*> points;
+  for(auto&& kf:keyframes_)
   {
-    if((*it)->point==NULL)
-      continue;
-
-    if((*it)->point->type_ == Point::TYPE_DELETED)
-      printf("ERROR DataValidation %i: Referenced point was deleted.\n", id);
-
-    if(!(*it)->point->findFrameRef(frame))
-      printf("ERROR DataValidation %i: Frame has reference but point does not have a reference back.\n", id);
-
-    pointValidation((*it)->point, id);
-  }
-  for(auto it=frame->key_pts_.begin(); it!=frame->key_pts_.end(); ++it)
-    if(*it != NULL)
-      if((*it)->point == NULL)
-        printf("ERROR DataValidation %i: KeyPoints not correct!\n", id);
-}
-
-void pointValidation(std::shared_ptr<Point> point, int id)
-{
-  for(auto it=point->obs_.begin(); it!=point->obs_.end(); ++it)
-  {
-    bool found=false;
-    for(auto it_ftr=(*it)->frame->fts_.begin(); it_ftr!=(*it)->frame->fts_.end(); ++it_ftr)
-     if((*it_ftr)->point == point) {
-       found=true; break;
-     }
-    if(!found)
-      printf("ERROR DataValidation %i: Point %i has inconsistent reference in frame %i, is candidate = %i\n", id, point->id_, (*it)->frame->id_, (int) point->type_);
+    for(auto&& ftr:kf->fts_)
+    {
+      if(ftr->frame != kf.get())
+      {
+        printf("ERROR DataValidation %i: Feature of frame %i belongs to another frame.\n", id, kf->id_);
+        ++n_errors;
+      }
+      if(ftr->point == NULL)
+        continue;
+      if(ftr->point->type_ == Point::TYPE_DELETED)
+      {
+        printf("ERROR DataValidation %i: Frame %i references the deleted point %i.\n", id, kf->id_, ftr->point->id_);
+        ++n_errors;
+      }
+      if(ftr->point->findFrameRef(kf.get()) == NULL)
+      {
+        printf("ERROR DataValidation %i: Frame %i references point %i which has no reference back.\n", id, kf->id_, ftr->point->id_);
+        ++n_errors;
+      }
+      points.insert(ftr->point.get());
+    }
+    for(auto&& key_pt:kf->key_pts_)
+      if(key_pt != NULL && (key_pt->point == NULL || key_pt->frame != kf.get()))
+      {
+        printf("ERROR DataValidation %i: KeyPoints of frame %i not correct!\n", id, kf->id_);
+        ++n_errors;
+      }
   }
-}
-
-void mapStatistics(Map* map)
-{
-  // compute average number of features which each frame observes
-  size_t n_pt_obs(0);
-  for(auto it=map->keyframes_.begin(); it!=map->keyframes_.end(); ++it)
-    n_pt_obs += (*it)->nObs();
-  printf("\n\nMap Statistics: Frame avg. point obs = %f\n", (float) n_pt_obs/map->size());
-
-  // compute average number of observations that each point has
-  size_t n_frame_obs(0);
-  size_t n_pts(0);
-  std::set<std::shared_ptr<Point>> points;
-  for(auto it=map->keyframes_.begin(); it!=map->keyframes_.end(); ++it)
+  for(auto&& point:points)
   {
-    for(auto ftr=(*it)->fts_.begin(); ftr!=(*it)->fts_.end(); ++ftr)
+    for(auto&& ftr:point->obs_)
     {
-      if((*ftr)->point == NULL)
+      if(ftr->frame == NULL)
+      {
+        printf("ERROR DataValidation %i: Point %i has an observation without frame.\n", id, point->id_);
+        ++n_errors;
         continue;
-      if(points.insert((*ftr)->point).second) {
-        ++n_pts;
-        n_frame_obs += (*ftr)->point->nRefs();
+      }
+      if(ftr->point.get() != point)
+      {
+        printf("ERROR DataValidation %i: Point %i has an observation of another point in frame %i.\n", id, point->id_, ftr->frame->id_);
+        ++n_errors;
+      }
+      if(std::find(ftr->frame->fts_.begin(), ftr->frame->fts_.end(), ftr) == ftr->frame->fts_.end())
+      {
+        printf("ERROR DataValidation %i: Point %i has inconsistent reference in frame %i, is candidate = %i\n", id, point->id_, ftr->frame->id_, (int) point->type_);
+        ++n_errors;
       }
     }
   }
-  printf("Map Statistics: Point avg. frame obs = %f\n\n", (float) n_frame_obs/n_pts);
+  for(auto&& point:trash_points_)
+  {
+    if(point != NULL && !point->obs_.empty())
+    {
+      printf("ERROR DataValidation %i: Deleted point %i still has observations.\n", id, point->id_);
+      ++n_errors;
+    }
+    points.insert(point.get());
+  }
+  points_.forEach([&](const PointHandle& point)
+  {
+    if(points.count(point.get()) == 0)
+    {
+      printf("ERROR DataValidation %i: Point %i is neither seen by a keyframe nor in the trash.\n", id, point->id_);
+      ++n_errors;
+    }
+  });
+  return n_errors;
 }
 
-} // namespace map_debug
 } // namespace vio
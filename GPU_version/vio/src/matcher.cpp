@@ -183,25 +183,25 @@ bool Matcher::findMatchDirect(
                                             halfpatch_size_ + 2, ref_ftr_->level))
           return false;
   }
-  if(ref_ftr_->frame->img_pyr_.empty())return false;
-  if(cur_frame.img_pyr_.empty())return false;
-  if(ref_ftr_->frame->img_pyr_[ref_ftr_->level].empty())return false;
-  if(cur_frame.img_pyr_[ref_ftr_->level].empty())return false;
+  if(ref_ftr_->frame->img_pyr_ == NULL)return false;
+  if(cur_frame.img_pyr_ == NULL)return false;
+  if(ref_ftr_->frame->img(ref_ftr_->level).empty())return false;
+  if(cur_frame.img(ref_ftr_->level).empty())return false;
   // warp affine
   warp::getWarpMatrixAffine(
       *ref_ftr_->frame->cam_, *(cur_frame.cam_), ref_ftr_->px, ref_ftr_->f,
-      (ref_ftr_->frame->se3().inverse()*pt.pos_).norm(),/*(Vector3d(ref_ftr_->frame->pos()(0),0.0,ref_ftr_->frame->pos()(1)) - pt.pos_).norm(),*/
-      cur_frame.se3().inverse() * ref_ftr_->frame->se3(), ref_ftr_->level, A_cur_ref_);
+      (ref_ftr_->frame->T_f_w_.inverse()*pt.pos_).norm(),/*(Vector3d(ref_ftr_->frame->pos()(0),0.0,ref_ftr_->frame->pos()(1)) - pt.pos_).norm(),*/
+      cur_frame.T_f_w_.inverse() * ref_ftr_->frame->se3(), ref_ftr_->level, A_cur_ref_);
 
   //search_level_ = warp::getBestSearchLevel(A_cur_ref_, Config::nPyrLevels()-1);
   /// TODO paches will be mirrored while robot is rotating around it self
-  if(!warp::warpAffine(A_cur_ref_, ref_ftr_->frame->img_pyr_[ref_ftr_->level], ref_ftr_->px,
+  if(!warp::warpAffine(A_cur_ref_, ref_ftr_->frame->img(ref_ftr_->level), ref_ftr_->px,
                    ref_ftr_->level, ref_ftr_->level, halfpatch_size_+1, patch_with_border_))return false;
   createPatchFromPatchWithBorder();
   // px_cur should be set
 
   bool success = false;
-  if(!warp::warpAffine(A_cur_ref_.inverse(), cur_frame.img_pyr_[ref_ftr_->level], px_cur,
+  if(!warp::warpAffine(A_cur_ref_.inverse(), cur_frame.img(ref_ftr_->level), px_cur,
                          ref_ftr_->level, ref_ftr_->level, halfpatch_size_+1, patch_with_border_cur_))return false;
   cv::Mat Patch_ref = cv::Mat(patch_size_+2, patch_size_+2, CV_8UC1, patch_with_border_);
   cv::Mat Patch_cur = cv::Mat(patch_size_+2, patch_size_+2, CV_8UC1, patch_with_border_cur_);
@@ -210,7 +210,7 @@ bool Matcher::findMatchDirect(
         success = true;
   else
         success = false;
-/*  debug(ref_ftr_->frame->img_pyr_[ref_ftr_->level],cur_frame.img_pyr_[ref_ftr_->level],ref_ftr_->px,
+/*  debug(ref_ftr_->frame->img(ref_ftr_->level),cur_frame.img(ref_ftr_->level),ref_ftr_->px,
         px_cur,px_scaled ,success,patch_,patch_with_border_,(ref_ftr_->frame->se3().inverse()*pt.pos_).z());*/
   //px_cur = px_scaled;
   return success;
@@ -223,22 +223,22 @@ bool Matcher::findEpipolarMatchDirect(
     const double d_estimate,
     const double d_min,
     const double d_max,
-    double& depth,FILE* log)
+    double& depth,AsyncLogger* log)
 {
   if(isnan(d_min) || isnan(d_max))return false;
-  SE2_5 T_cur_ref(SE2(cur_frame.T_f_w_.inverse() * ref_frame.T_f_w_.se2()));
+  const SE3 T_cur_ref = cur_frame.T_f_w_.inverse() * ref_frame.T_f_w_.se3();
   int zmssd_best = PatchScore::threshold();
   Vector2d uv_best;
 
   // Compute start and end of epipolar line in old_kf for match search, on unit plane!
-  Vector2d A = vk::project2d(T_cur_ref.se3() * (ref_ftr.f*d_min));
-  Vector2d B = vk::project2d(T_cur_ref.se3() * (ref_ftr.f*d_max));
+  Vector2d A = vk::project2d(T_cur_ref * (ref_ftr.f*d_min));
+  Vector2d B = vk::project2d(T_cur_ref * (ref_ftr.f*d_max));
   epi_dir_ = A - B;
 
   // Compute affine warp matrix
   warp::getWarpMatrixAffine(
       *ref_frame.cam_, *cur_frame.cam_, ref_ftr.px, ref_ftr.f,
-      d_estimate, T_cur_ref.se3(), ref_ftr.level, A_cur_ref_);
+      d_estimate, T_cur_ref, ref_ftr.level, A_cur_ref_);
 
   // feature pre-selection
   reject_ = false;
@@ -259,12 +259,12 @@ bool Matcher::findEpipolarMatchDirect(
   Vector2d px_B(cur_frame.cam_->world2cam(B));
   epi_length_ = (px_A-px_B).norm() / (1<<search_level_);
 #if VIO_DEBUG
-        fprintf(log,"[%s]  epi_dir x= %f, y=%f: A:%f,%f B:%f,%f epi_length_:%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+        log->write(" epi_dir x= %f, y=%f: A:%f,%f B:%f,%f epi_length_:%f\n",
                             epi_dir_.x(),epi_dir_.y(),A.x(),A.y(),B.x(),B.y(),epi_length_);
 #endif
 
   // Warp reference patch at ref_level
-  if(!warp::warpAffine(A_cur_ref_, ref_frame.img_pyr_[ref_ftr.level], ref_ftr.px,
+  if(!warp::warpAffine(A_cur_ref_, ref_frame.img(ref_ftr.level), ref_ftr.px,
                    ref_ftr.level, search_level_, halfpatch_size_+1, patch_with_border_))return false;
   createPatchFromPatchWithBorder();
   if(epi_length_ < 5.0)
@@ -274,16 +274,16 @@ bool Matcher::findEpipolarMatchDirect(
     bool res;
     if(options_.align_1d)
       res = feature_alignment::align1D(
-          cur_frame.img_pyr_[search_level_], (px_A-px_B).cast<float>().normalized(),
+          cur_frame.img(search_level_), (px_A-px_B).cast<float>().normalized(),
           patch_with_border_, patch_, options_.align_max_iter, px_scaled, h_inv_);
     else
       res = feature_alignment::align2D(
-          cur_frame.img_pyr_[search_level_], patch_with_border_, patch_,
+          cur_frame.img(search_level_), patch_with_border_, patch_,
           options_.align_max_iter, px_scaled);
     if(res)
     {
       px_cur_ = px_scaled*(1<<search_level_);
-      if(depthFromTriangulation(T_cur_ref.se3(), ref_ftr.f, cur_frame.cam_->cam2world(px_cur_), depth))
+      if(depthFromTriangulation(T_cur_ref, ref_ftr.f, cur_frame.cam_->cam2world(px_cur_), depth))
         return true;
     }
     return false;
@@ -323,10 +323,10 @@ bool Matcher::findEpipolarMatchDirect(
       continue;
 
     // TODO interpolation would probably be a good idea
-    uint8_t* cur_patch_ptr = cur_frame.img_pyr_[search_level_].data
-                             + (pxi[1]-halfpatch_size_)*cur_frame.img_pyr_[search_level_].cols
+    uint8_t* cur_patch_ptr = cur_frame.img(search_level_).data
+                             + (pxi[1]-halfpatch_size_)*cur_frame.img(search_level_).cols
                              + (pxi[0]-halfpatch_size_);
-    int zmssd = patch_score.computeScore(cur_patch_ptr, cur_frame.img_pyr_[search_level_].cols);
+    int zmssd = patch_score.computeScore(cur_patch_ptr, cur_frame.img(search_level_).cols);
 
     if(zmssd < zmssd_best) {
       zmssd_best = zmssd;
@@ -343,22 +343,22 @@ bool Matcher::findEpipolarMatchDirect(
       bool res;
       if(options_.align_1d)
         res = feature_alignment::align1D(
-            cur_frame.img_pyr_[search_level_], (px_A-px_B).cast<float>().normalized(),
+            cur_frame.img(search_level_), (px_A-px_B).cast<float>().normalized(),
             patch_with_border_, patch_, options_.align_max_iter, px_scaled, h_inv_);
       else
         res = feature_alignment::align2D(
-            cur_frame.img_pyr_[search_level_], patch_with_border_, patch_,
+            cur_frame.img(search_level_), patch_with_border_, patch_,
             options_.align_max_iter, px_scaled);
       if(res)
       {
         px_cur_ = px_scaled*(1<<search_level_);
-        if(depthFromTriangulation(T_cur_ref.se3(), ref_ftr.f, cur_frame.cam_->cam2world(px_cur_), depth))
+        if(depthFromTriangulation(T_cur_ref, ref_ftr.f, cur_frame.cam_->cam2world(px_cur_), depth))
           return true;
       }
       return false;
     }
     px_cur_ = cur_frame.cam_->world2cam(uv_best);
-    if(depthFromTriangulation(T_cur_ref.se3(), ref_ftr.f, vk::unproject2d(uv_best).normalized(), depth))
+    if(depthFromTriangulation(T_cur_ref, ref_ftr.f, vk::unproject2d(uv_best).normalized(), depth))
       return true;
   }
   return false;
@@ -0,0 +1,489 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/compute_backend.h>
+#include <vio/vision.h>
+#include <vio/fast_atan.h>
+#include <opencv2/core/utility.hpp>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+namespace vio {
+
+namespace {
+
+/// read_imageui with CLK_ADDRESS_CLAMP at the address of the kernels, (addr % w, addr / w).
+inline float pixel(const cv::Mat& img, int addr)
+{
+  const int x = addr % img.cols;
+  const int y = addr / img.cols;
+  if(x < 0 || y < 0 || x >= img.cols || y >= img.rows)
+    return 0.0f;
+  return img.ptr<uchar>(y)[x];
+}
+
+/// xyz_cur of compute-residual.cl
+Eigen::Vector3f xyzCur(const Eigen::Vector3f& cur, Eigen::Vector3f ref, const Eigen::Vector3f& ref_feature)
+{
+  ref.x() *= -1.0f;
+  ref.y() *= -1.0f;
+  ref.z() = static_cast<float>(M_PI) + ref.z();
+  const Eigen::Vector3f error = ref + cur;
+  const float yaw = 0.0f;
+  const float pitch = error.z();
+  const float roll = 0.122173f;
+  const float R00 = std::cos(yaw)*std::cos(pitch);
+  const float R01 = std::cos(yaw)*std::sin(pitch)*std::sin(roll)-std::sin(yaw)*std::cos(roll);
+  const float R02 = std::cos(yaw)*std::sin(pitch)*std::cos(roll)+std::sin(yaw)*std::sin(roll);
+  const float R10 = std::sin(yaw)*std::cos(pitch);
+  const float R11 = std::sin(yaw)*std::sin(pitch)*std::sin(roll)+std::cos(yaw)*std::cos(roll);
+  const float R12 = std::sin(yaw)*std::sin(pitch)*std::cos(roll)-std::cos(yaw)*std::sin(roll);
+  const float R20 = -std::sin(pitch);
+  const float R21 = std::cos(pitch)*std::sin(roll);
+  const float R22 = std::cos(pitch)*std::cos(roll);
+  return Eigen::Vector3f(R00*ref_feature.x()+R01*ref_feature.y()+R02*ref_feature.z()+error.x(),
+                         R10*ref_feature.x()+R11*ref_feature.y()+R12*ref_feature.z(),
+                         R20*ref_feature.x()+R21*ref_feature.y()+R22*ref_feature.z()+error.y());
+}
+
+const int kPatchSize = NativeBackend::kPatchSize;
+const int kPatchHalfsize = NativeBackend::kPatchHalfsize;
+
+// Same arithmetic as reference_patch of compute-residual.cl, keep the two in sync.
+void referencePatch(const cv::Mat& ref_img, int level, const Eigen::Vector2f& px_ref,
+                    Eigen::Vector3f* patch, char& visible)
+{
+  const float scale = static_cast<float>(std::pow(2.0, -level));
+  const int ref_w = ref_img.cols;
+  // check if reference with patch size is within image
+  const Eigen::Vector2f uv_ref = px_ref*scale;
+  const Eigen::Vector2f uv_ref_i(std::floor(uv_ref.x()), std::floor(uv_ref.y()));
+  visible = !(uv_ref_i.x()-(kPatchHalfsize+1) < 0 || uv_ref_i.y()-(kPatchHalfsize+1) < 0
+              || uv_ref_i.x()+(kPatchHalfsize+1) >= ref_w || uv_ref_i.y()+(kPatchHalfsize+1) >= ref_img.rows);
+  if(!visible)
+    return;
+
+  // bilateral interpolation weights for the reference image
+  const Eigen::Vector2f subpix = uv_ref - uv_ref_i;
+  const float w_ref_tl = (1.0f-subpix.x()) * (1.0f-subpix.y());
+  const float w_ref_tr = subpix.x() * (1.0f-subpix.y());
+  const float w_ref_bl = (1.0f-subpix.x()) * subpix.y();
+  const float w_ref_br = subpix.x() * subpix.y();
+
+  for(int y=0; y<kPatchSize; ++y)
+  {
+    int ref_addr = static_cast<int>(static_cast<int>(uv_ref_i.y()+y-kPatchHalfsize)*ref_w + (uv_ref_i.x()-kPatchHalfsize));
+    for(int x=0; x<kPatchSize; ++x, ++ref_addr, ++patch)
+    {
+      const cv::Mat& R = ref_img;
+      const int a = ref_addr;
+      const float value = w_ref_tl*pixel(R,a) + w_ref_tr*pixel(R,a+1) + w_ref_bl*pixel(R,a+ref_w) + w_ref_br*pixel(R,a+ref_w+1);
+      const float dx = 0.5f*((w_ref_tl*pixel(R,a+1) + w_ref_tr*pixel(R,a+2) + w_ref_bl*pixel(R,a+ref_w+1) + w_ref_br*pixel(R,a+ref_w+2))
+                            -(w_ref_tl*pixel(R,a-1) + w_ref_tr*pixel(R,a) + w_ref_bl*pixel(R,a+ref_w-1) + w_ref_br*pixel(R,a+ref_w)));
+      const float dy = 0.5f*((w_ref_tl*pixel(R,a+ref_w) + w_ref_tr*pixel(R,a+ref_w+1) + w_ref_bl*pixel(R,a+2*ref_w) + w_ref_br*pixel(R,a+2*ref_w+1))
+                            -(w_ref_tl*pixel(R,a-ref_w) + w_ref_tr*pixel(R,a+1-ref_w) + w_ref_bl*pixel(R,a) + w_ref_br*pixel(R,a+1)));
+      *patch = Eigen::Vector3f(value, dx, dy);
+    }
+  }
+}
+
+} // namespace
+
+/// Points and patches of a reference frame on the host.
+struct NativeBackend::Reference : public AlignmentReference
+{
+  virtual size_t size() const { return xyz.size(); }
+
+  virtual void setPoints(const std::vector<Eigen::Vector3f>& xyz_ref, const Eigen::Vector3f& ref_pose)
+  {
+    assert(xyz_ref.size() == xyz.size());
+    xyz = xyz_ref;
+    pose = ref_pose;
+  }
+
+  std::vector<Eigen::Vector3f> xyz;
+  std::vector<Eigen::Vector2f> px;
+  Eigen::Vector3f pose;
+  std::vector<std::vector<Eigen::Vector3f>> patch;  //!< per pyramid level.
+  std::vector<std::vector<char>> visible;            //!< per pyramid level.
+};
+
+NativeBackend::NativeBackend(vk::AbstractCamera* cam) :
+  level_(0),
+  scale_(1.0f)
+{
+  const double* camera = cam->params();
+  fx_ = camera[0];
+  fy_ = camera[1];
+  cx_ = camera[2];
+  cy_ = camera[3];
+  s_ = camera[4];
+}
+
+std::shared_ptr<ImagePyramid> NativeBackend::createPyramid(const cv::Mat& img_level_0, int n_levels)
+{
+  return std::make_shared<ImagePyramid>(img_level_0, n_levels);
+}
+
+std::future<ComputeBackend::FastResult> NativeBackend::detectFastAsync(const cv::Mat& img, int level, const FastOptions& options, int max_corners)
+{
+  // runs in get(), a thread per level would compete with the cv::parallel_for_ inside
+  return std::async(std::launch::deferred, [this, img, level, options, max_corners]{ return detectFast(img, level, options, max_corners); });
+}
+
+std::future<ComputeBackend::FastResult> NativeBackend::detectFastAsync(const ImagePyramid& pyr, int level, const FastOptions& options, int max_corners)
+{
+  return detectFastAsync(pyr.level(level), level, options, max_corners);
+}
+
+std::future<void> NativeBackend::describeAsync(const ImagePyramid& pyr, const std::vector<cv::KeyPoint>& keypoints,
+                                              uint8_t* descriptors)
+{
+  // deferred: runs in get() while the caller still holds pyr and keypoints. Each call has its own
+  // integral image, so two futures taken in different threads do not share the buffer of freak_.
+  return std::async(std::launch::deferred, [this, &pyr, &keypoints, descriptors]
+  {
+    cv::Mat integral;
+    freak_.compute(pyr.level(0), keypoints, descriptors, integral);
+  });
+}
+
+// Same selection as fast_score and select_corners of fast-gray.cl, keep them in sync. The scores
+// are computed in double by vk::shiTomasiScore and can differ in the last bits.
+ComputeBackend::FastResult NativeBackend::detectFast(const cv::Mat& img, int level, const FastOptions& options, int max_corners) const
+{
+  FastResult result;
+  result.count = 0;
+  if(img.rows < 12 || img.cols < 12)
+    return result;
+  const int step = static_cast<int>(img.step);
+  // circle p01..p16 of fast-gray.cl
+  const int circle[16] = {
+      3*step, 3*step+1, 2*step+2, step+3, 3, -step+3, -2*step+2, -3*step+1,
+      -3*step, -3*step-1, -2*step-2, -step-3, -3, step-3, 2*step-2, 3*step-1};
+  const int thresh = options.threshold;
+  // fast_score: Shi-Tomasi score of the corners, 0 elsewhere
+  cv::Mat scores = cv::Mat::zeros(img.size(), CV_32F);
+  cv::parallel_for_(cv::Range(6, img.rows-5), [&](const cv::Range& range)
+  {
+    for(int y=range.start; y<range.end; ++y)
+    {
+      const uchar* row = img.ptr<uchar>(y);
+      for(int x=6; x<img.cols-5; ++x)
+      {
+        const uchar* p = row+x;
+        const int p00 = p[0];
+        const bool d01 = std::abs(p[circle[0]]-p00) > thresh;
+        const bool d05 = std::abs(p[circle[4]]-p00) > thresh;
+        const bool d09 = std::abs(p[circle[8]]-p00) > thresh;
+        const bool d13 = std::abs(p[circle[12]]-p00) > thresh;
+        if(!((d01 && d05) || (d05 && d09) || (d09 && d13) || (d13 && d01)))
+          continue;
+        // the kernel takes the maximum over p00..p15
+        int sco = p00;
+        for(int i=0; i<15; ++i)
+          sco = std::max(sco, static_cast<int>(p[circle[i]]));
+        if(p00 >= sco)
+          scores.ptr<float>(y)[x] = vk::shiTomasiScore(img, x, y);
+      }
+    }
+  });
+  // select_corners: one list per row of cells keeps the result independent of the thread count
+  const int cell_corners = std::min(options.cell_corners, static_cast<int>(kMaxCellCorners));
+  const int round = (1<<level)-1;
+  const int n_cols = ((img.cols<<level) + options.cell_size-1)/options.cell_size;
+  const int n_rows = ((img.rows<<level) + options.cell_size-1)/options.cell_size;
+  std::vector<std::vector<std::pair<float, cv::Point2i>>> cells(n_rows);
+  cv::parallel_for_(cv::Range(0, n_rows), [&](const cv::Range& range)
+  {
+    std::vector<std::pair<float, cv::Point2i>> best;
+    for(int cy=range.start; cy<range.end; ++cy)
+    {
+      const int y0 = (cy*options.cell_size + round) >> level;
+      const int y1 = std::min(((cy+1)*options.cell_size + round) >> level, img.rows);
+      for(int cx=0; cx<n_cols; ++cx)
+      {
+        const int x0 = (cx*options.cell_size + round) >> level;
+        const int x1 = std::min(((cx+1)*options.cell_size + round) >> level, img.cols);
+        best.clear();
+        for(int y=y0; y<y1; ++y)
+          for(int x=x0; x<x1; ++x)
+          {
+            const float v = scores.ptr<float>(y)[x];
+            if(v <= 0.0f)
+              continue;
+            // 3x3 non-maximum suppression, ties go to the first pixel in raster order
+            bool keep = true;
+            for(int dy=-1; dy<=1 && keep; ++dy)
+              for(int dx=-1; dx<=1; ++dx)
+              {
+                const int nx = x+dx;
+                const int ny = y+dy;
+                if((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= img.cols || ny >= img.rows)
+                  continue;
+                const float u = scores.ptr<float>(ny)[nx];
+                if(u > v || (u == v && (dy < 0 || (dy == 0 && dx < 0))))
+                {
+                  keep = false;
+                  break;
+                }
+              }
+            if(!keep)
+              continue;
+            // sorted by decreasing score, the first of equal scores stays in front
+            if(static_cast<int>(best.size()) == cell_corners)
+            {
+              if(v <= best.back().first)
+                continue;
+              best.pop_back();
+            }
+            auto it = best.begin();
+            while(it != best.end() && it->first >= v)
+              ++it;
+            best.insert(it, std::make_pair(v, cv::Point2i(x, y)));
+          }
+        cells[cy].insert(cells[cy].end(), best.begin(), best.end());
+      }
+    }
+  });
+  // compact_corners: the max_corners best by score, equal scores of the last taken in cell order
+  std::vector<float> all;
+  for(auto&& r:cells)
+    for(auto&& c:r)
+      all.push_back(c.first);
+  result.count = static_cast<int>(all.size());
+  if(max_corners <= 0)
+    return result;
+  float threshold = 0.0f;
+  int ties = 0;
+  if(result.count > max_corners && max_corners > 0)
+  {
+    std::nth_element(all.begin(), all.begin()+max_corners-1, all.end(), std::greater<float>());
+    threshold = all[max_corners-1];
+    ties = max_corners - static_cast<int>(std::count_if(all.begin(), all.end(),
+                                                        [threshold](float v){ return v > threshold; }));
+  }
+  const int stored = std::min(result.count, max_corners);
+  result.corners.reserve(stored);
+  result.scores.reserve(stored);
+  for(auto&& r:cells)
+    for(auto&& c:r)
+      if(c.first > threshold || (c.first == threshold && ties-- > 0))
+      {
+        result.corners.push_back(c.second);
+        result.scores.push_back(c.first);
+      }
+  return result;
+}
+
+std::shared_ptr<AlignmentReference> NativeBackend::createAlignmentReference(
+    const std::vector<Eigen::Vector3f>& xyz_ref,
+    const std::vector<Eigen::Vector2f>& px_ref,
+    const Eigen::Vector3f& ref_pose,
+    const ImagePyramid& ref_pyr)
+{
+  std::shared_ptr<Reference> ref = std::make_shared<Reference>();
+  ref->xyz = xyz_ref;
+  ref->px = px_ref;
+  ref->pose = ref_pose;
+  ref->patch.resize(ref_pyr.size());
+  ref->visible.resize(ref_pyr.size());
+  for(int level=0; level<ref_pyr.size(); ++level)
+  {
+    const cv::Mat& ref_img = ref_pyr.level(level);
+    std::vector<Eigen::Vector3f>& patch = ref->patch[level];
+    std::vector<char>& visible = ref->visible[level];
+    patch.resize(kPatchSize*kPatchSize*px_ref.size());
+    visible.assign(px_ref.size(), 0);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(px_ref.size())), [&](const cv::Range& range)
+    {
+      for(int f=range.start; f<range.end; ++f)
+        referencePatch(ref_img, level, px_ref[f], &patch[kPatchSize*kPatchSize*f], visible[f]);
+    });
+  }
+  return ref;
+}
+
+void NativeBackend::setAlignmentProblem(const std::vector<std::shared_ptr<const AlignmentReference>>& refs,
+                                        const Eigen::Vector3f& cur_pose)
+{
+  releaseAlignment();
+  for(auto&& ref:refs)
+  {
+    std::shared_ptr<const Reference> reference = std::dynamic_pointer_cast<const Reference>(ref);
+    assert(reference != NULL);
+    if(reference->size() == 0)
+      continue;
+    xyz_ref_.insert(xyz_ref_.end(), reference->xyz.begin(), reference->xyz.end());
+    ref_index_.insert(ref_index_.end(), reference->size(), static_cast<int>(refs_.size()));
+    ref_poses_.push_back(reference->pose);
+    refs_.push_back(reference);
+  }
+  cur_pose_ = cur_pose;
+  errors_.assign(xyz_ref_.size(), 0.0f);
+  chi2_.assign(xyz_ref_.size(), 0.0f);
+  H_.assign(9*xyz_ref_.size(), 0.0f);
+  J_.assign(3*xyz_ref_.size(), 0.0f);
+}
+
+void NativeBackend::setAlignmentLevel(const ImagePyramid& cur_pyr, int level)
+{
+  cur_img_ = cur_pyr.level(level);
+  level_ = level;
+  ref_patch_.clear();
+  ref_visible_.clear();
+  for(auto&& ref:refs_)
+  {
+    assert(level < static_cast<int>(ref->patch.size()));
+    ref_patch_.insert(ref_patch_.end(), ref->patch[level].begin(), ref->patch[level].end());
+    ref_visible_.insert(ref_visible_.end(), ref->visible[level].begin(), ref->visible[level].end());
+  }
+}
+
+void NativeBackend::computeResiduals(float scale, float& error, float& chi2)
+{
+  scale_ = scale;
+  std::fill(errors_.begin(), errors_.end(), 0.0f);
+  std::fill(chi2_.begin(), chi2_.end(), 0.0f);
+  std::fill(H_.begin(), H_.end(), 0.0f);
+  std::fill(J_.begin(), J_.end(), 0.0f);
+  cv::parallel_for_(cv::Range(0, static_cast<int>(xyz_ref_.size())), [&](const cv::Range& range)
+  {
+    for(int f=range.start; f<range.end; ++f)
+      residual(f);
+  });
+  // sums of reduce-system.cl
+  error = 0.0f;
+  chi2 = 0.0f;
+  H_sum_.setZero();
+  b_sum_.setZero();
+  for(size_t f=0; f<xyz_ref_.size(); ++f)
+  {
+    error += errors_[f];
+    chi2 += chi2_[f];
+    for(int k=0; k<9; ++k)
+      H_sum_(k/3,k%3) += (f == 0) ? H_[9*f+k] : (std::isnan(H_[9*f+k]) ? 0.0f : H_[9*f+k]);
+    for(int k=0; k<3; ++k)
+      b_sum_(k) += (f == 0) ? J_[3*f+k] : (std::isnan(J_[3*f+k]) ? 0.0f : -J_[3*f+k]);
+  }
+}
+
+void NativeBackend::linearSystem(Eigen::Matrix3f& H, Eigen::Vector3f& b)
+{
+  H = H_sum_;
+  b = b_sum_;
+}
+
+void NativeBackend::releaseAlignment()
+{
+  refs_.clear();
+  xyz_ref_.clear();
+  ref_index_.clear();
+  ref_poses_.clear();
+  cur_img_.release();
+  ref_patch_.clear();
+  ref_visible_.clear();
+  errors_.clear();
+  chi2_.clear();
+  H_.clear();
+  J_.clear();
+}
+
+// Same arithmetic as compute_residual of compute-residual.cl, keep the two in sync. The kernel adds
+// the terms of the pixels in a tree, the sums can differ in the last bits.
+void NativeBackend::residual(size_t f)
+{
+  const float scale = static_cast<float>(std::pow(2.0, -level_));
+  const int cur_w = cur_img_.cols;
+  if(!ref_visible_[f])
+    return;
+
+  // evaluate projection jacobian, jacobian_xyz2uv_ of the kernel
+  float frame_jac[6];
+  {
+    const Eigen::Vector3f& xyz = xyz_ref_[f];
+    const double x_n = xyz.x();
+    const double y_n = xyz.y();
+    const double z_n = xyz.z();
+    const double r = std::sqrt(std::pow(xyz.x()/xyz.z(), 2.0f) + std::pow(xyz.y()/xyz.z(), 2.0f));
+    const double x_c = cur_pose_.x();
+    const double z_c = cur_pose_.y();
+    const double theta = cur_pose_.z();
+    const double k = (1+3*s_*theta*theta)/((r*r)+1);
+    const double alpha = (fx_*(theta/r))-(fx_*((x_n*x_n)/(r*r))*theta)+k*((fx_*x_n*x_n)/(r*r));
+    const double beta  =                -(fx_*((x_n*y_n)/(r*r))*theta)+k*((fx_*x_n*y_n)/(r*r));
+    const double gamma =                -(fy_*((x_n*y_n)/(r*r))*theta)+k*((fy_*x_n*y_n)/(r*r));
+    const double lamda = (fy_*(theta/r))-(fy_*((y_n*y_n)/(r*r))*theta)+k*((fy_*y_n*y_n)/(r*r));
+    const double Xf_Xc = x_n - x_c;
+    const double Zf_Zc = z_n - z_c;
+    const double n1 = -1*std::sin(theta)*Xf_Xc + std::cos(theta)*Zf_Zc;
+    const double n2 = -1*std::cos(theta)*Xf_Xc - std::sin(theta)*Zf_Zc;
+    const double a_z = (x_n/(z_n*z_n))*alpha + (y_n/(z_n*z_n))*beta;
+    const double g_z = (x_n/(z_n*z_n))*gamma + (y_n/(z_n*z_n))*lamda;
+    frame_jac[0] = ((-1*std::cos(theta)/z_n)*alpha)-(a_z*std::sin(theta));
+    frame_jac[1] = ((-1*std::sin(theta)/z_n)*alpha)+(a_z*std::cos(theta));
+    frame_jac[2] = ((1/z_n)*alpha*n1)-(a_z*n2);
+    frame_jac[3] = ((-1*std::cos(theta)/z_n)*gamma)-(g_z*std::sin(theta));
+    frame_jac[4] = ((-1*std::sin(theta)/z_n)*gamma)+(g_z*std::cos(theta));
+    frame_jac[5] = ((1/z_n)*gamma*n1)-(g_z*n2);
+  }
+
+  // world2cam of the kernel
+  const Eigen::Vector3f xyz_cur = xyzCur(cur_pose_, ref_poses_[ref_index_[f]], xyz_ref_[f]);
+  const float r = std::sqrt(std::pow(xyz_cur.x()/xyz_cur.z(), 2.0f) + std::pow(xyz_cur.y()/xyz_cur.z(), 2.0f));
+  float factor = 1.0f;
+  if(static_cast<float>(s_) != 0 && r >= 0.001f)
+    factor = vk::fast_atan(r * 2.0f * std::tan(0.5f * static_cast<float>(s_))) / (r * static_cast<float>(s_));
+  const Eigen::Vector2f uv_cur_pyr(
+      (static_cast<float>(cx_) + static_cast<float>(fx_)*factor*xyz_cur.x()/xyz_cur.z()) * scale,
+      (static_cast<float>(cy_) + static_cast<float>(fy_)*factor*xyz_cur.y()/xyz_cur.z()) * scale);
+  // the device reads 0 for any garbage address, avoid the undefined float to int conversion here
+  if(!std::isfinite(uv_cur_pyr.x()) || !std::isfinite(uv_cur_pyr.y())
+     || std::fabs(uv_cur_pyr.x()) > 1e6f || std::fabs(uv_cur_pyr.y()) > 1e6f)
+    return;
+  const Eigen::Vector2f uv_cur_i(std::floor(uv_cur_pyr.x()), std::floor(uv_cur_pyr.y()));
+  const Eigen::Vector2f subpix_cur = uv_cur_pyr - uv_cur_i;
+  const float w_cur_tl = (1.0f-subpix_cur.x()) * (1.0f-subpix_cur.y());
+  const float w_cur_tr = subpix_cur.x() * (1.0f-subpix_cur.y());
+  const float w_cur_bl = (1.0f-subpix_cur.x()) * subpix_cur.y();
+  const float w_cur_br = subpix_cur.x() * subpix_cur.y();
+
+  float* H = &H_[9*f];
+  float* J = &J_[3*f];
+  const float jac_scale = static_cast<float>(fx_) / scale;
+  float e = 0.0f;
+  float chi = 0.0f;
+  const Eigen::Vector3f* patch = &ref_patch_[kPatchSize*kPatchSize*f];
+  for(int y=0; y<kPatchSize; ++y)
+  {
+    int cur_addr = static_cast<int>(static_cast<int>(uv_cur_i.y()+y-kPatchHalfsize)*cur_w + (uv_cur_i.x()-kPatchHalfsize));
+    for(int x=0; x<kPatchSize; ++x, ++cur_addr, ++patch)
+    {
+      const float value = patch->x();
+      const float dx = patch->y();
+      const float dy = patch->z();
+      const cv::Mat& C = cur_img_;
+      const int c = cur_addr;
+      // the kernel only subtracts the top left sample, kept for identical results
+      const float res = value - w_cur_tl*pixel(C,c) + w_cur_tr*pixel(C,c+1) + w_cur_bl*pixel(C,c+cur_w) + w_cur_br*pixel(C,c+cur_w+1);
+      e += std::fabs(res);
+      const float weight = res/scale_;
+      chi += res*res*weight;
+      const float j0 = (dx*frame_jac[0] + dy*frame_jac[3]) * jac_scale;
+      const float j1 = (dx*frame_jac[1] + dy*frame_jac[4]) * jac_scale;
+      const float j2 = (dx*frame_jac[2] + dy*frame_jac[5]) * jac_scale;
+      H[0] += j0*j0*weight; H[1] += j0*j1*weight; H[2] += j0*j2*weight;
+      H[3] += j1*j0*weight; H[4] += j1*j1*weight; H[5] += j1*j2*weight;
+      H[6] += j2*j0*weight; H[7] += j2*j1*weight; H[8] += j2*j2*weight;
+      J[0] -= j0*res*weight;
+      J[1] -= j1*res*weight;
+      J[2] -= j2*res*weight;
+    }
+  }
+  errors_[f] = e / (kPatchSize*kPatchSize);
+  chi2_[f] = chi;
+}
+
+} // namespace vio
@@ -0,0 +1,247 @@
+/*
+ * performance_monitor.cpp
+ *
+ *  Scoped spans of the pipeline stages. Every thread records into its own
+ *  log-linear histograms and ring buffer, so the hot path takes no lock and
+ *  snapshots can be read at runtime without stalling the tracking thread.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vio/performance_monitor.h>
+
+namespace vk
+{
+
+namespace {
+
+boost::mutex& stageMutex()
+{
+  static boost::mutex mut;
+  return mut;
+}
+
+std::vector<std::string>& stageNames()
+{
+  static std::vector<std::string> names;
+  return names;
+}
+
+std::atomic<uint64_t> next_instance(1);
+
+struct ThreadCache
+{
+  uint64_t instance;
+  void* data;
+};
+thread_local ThreadCache thread_cache = {0, NULL};
+
+} // namespace
+
+void LatencyHistogram::addTo(std::vector<uint64_t>& counts, uint64_t& n, uint64_t& sum, uint64_t& max) const
+{
+  n += count_.load(std::memory_order_acquire);
+  for(int i=0; i<kBuckets; ++i)
+    counts[i] += counts_[i].load(std::memory_order_relaxed);
+  sum += sum_.load(std::memory_order_relaxed);
+  max = std::max(max, max_.load(std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset()
+{
+  for(int i=0; i<kBuckets; ++i)
+    counts_[i].store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_release);
+}
+
+void SpanRing::read(std::vector<SpanRecord>& spans) const
+{
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  const uint64_t begin = head > kSize ? head-kSize : 0;
+  const size_t offset = spans.size();
+  for(uint64_t j=begin; j<head; ++j)
+  {
+    const size_t i = j & (kSize-1);
+    SpanRecord r;
+    r.stage = stage_[i].load(std::memory_order_relaxed);
+    r.start_ns = start_[i].load(std::memory_order_relaxed);
+    r.duration_ns = duration_[i].load(std::memory_order_relaxed);
+    spans.push_back(r);
+  }
+  // drop the slots the writer reused while we were copying
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t head_after = head_.load(std::memory_order_relaxed);
+  const uint64_t n_overwritten = head_after > begin+kSize ? head_after-(begin+kSize) : 0;
+  const size_t n_drop = static_cast<size_t>(std::min<uint64_t>(n_overwritten, head-begin));
+  spans.erase(spans.begin()+offset, spans.begin()+offset+n_drop);
+}
+
+PerformanceMonitor::PerformanceMonitor() :
+  instance_(next_instance.fetch_add(1))
+{}
+
+PerformanceMonitor::~PerformanceMonitor()
+{
+  for(auto&& t:threads_)
+    delete t;
+}
+
+int PerformanceMonitor::stageId(const std::string& name)
+{
+  boost::unique_lock<boost::mutex> lock(stageMutex());
+  std::vector<std::string>& names = stageNames();
+  auto it = std::find(names.begin(), names.end(), name);
+  if(it != names.end())
+    return static_cast<int>(it-names.begin());
+  if(names.size() >= static_cast<size_t>(kMaxStages))
+    return -1;
+  names.push_back(name);
+  return static_cast<int>(names.size())-1;
+}
+
+void PerformanceMonitor::addTimer(const std::string& name)
+{
+  if(stageId(name) < 0)
+    return;
+  boost::unique_lock<boost::mutex> lock(mut_);
+  if(std::find(order_.begin(), order_.end(), name) == order_.end())
+    order_.push_back(name);
+}
+
+PerformanceMonitor::ThreadData* PerformanceMonitor::threadData()
+{
+  if(thread_cache.instance == instance_)
+    return static_cast<ThreadData*>(thread_cache.data);
+  // first span of this thread, the only time the hot path locks
+  ThreadData* data = new ThreadData();
+  {
+    boost::unique_lock<boost::mutex> lock(mut_);
+    threads_.push_back(data);
+  }
+  thread_cache.instance = instance_;
+  thread_cache.data = data;
+  return data;
+}
+
+void PerformanceMonitor::record(int stage, uint64_t start_ns, uint64_t duration_ns)
+{
+  if(stage < 0 || stage >= kMaxStages)
+    return;
+  ThreadData* data = threadData();
+  data->hist[stage].record(duration_ns);
+  data->ring.push(stage, start_ns, duration_ns);
+}
+
+void PerformanceMonitor::log(int stage, double value)
+{
+  const uint64_t ns = static_cast<uint64_t>(std::max(0.0, value)*1e9);
+  record(stage, now()-ns, ns);
+}
+
+void PerformanceMonitor::merge(
+    int stage, std::vector<uint64_t>& counts, uint64_t& n, uint64_t& sum, uint64_t& max) const
+{
+  counts.assign(LatencyHistogram::kBuckets, 0);
+  n = sum = max = 0;
+  if(stage < 0)
+    return;
+  boost::unique_lock<boost::mutex> lock(mut_);
+  for(auto&& t:threads_)
+    t->hist[stage].addTo(counts, n, sum, max);
+}
+
+namespace {
+
+double percentileOf(const std::vector<uint64_t>& counts, double p)
+{
+  uint64_t n = 0;
+  for(auto&& c:counts)
+    n += c;
+  if(n == 0)
+    return 0.0;
+  // nearest-rank percentile
+  uint64_t rank = static_cast<uint64_t>(std::ceil(std::max(0.0, std::min(1.0, p)) * n));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t acc = 0;
+  for(size_t i=0; i<counts.size(); ++i)
+  {
+    acc += counts[i];
+    if(acc >= rank)
+      return LatencyHistogram::bucketValue(static_cast<int>(i))*1e-9;
+  }
+  return LatencyHistogram::bucketValue(static_cast<int>(counts.size())-1)*1e-9;
+}
+
+} // namespace
+
+std::vector<PerformanceMonitor::StageStats> PerformanceMonitor::snapshot() const
+{
+  std::vector<std::string> order;
+  {
+    boost::unique_lock<boost::mutex> lock(mut_);
+    order = order_;
+  }
+  std::vector<StageStats> stats;
+  std::vector<uint64_t> counts;
+  for(auto&& name:order)
+  {
+    uint64_t n, sum, max;
+    merge(stageId(name), counts, n, sum, max);
+    StageStats s;
+    s.name = name;
+    s.count = n;
+    s.mean = n ? sum*1e-9/n : 0.0;
+    s.p50 = percentileOf(counts, 0.50);
+    s.p95 = percentileOf(counts, 0.95);
+    s.p99 = percentileOf(counts, 0.99);
+    s.max = max*1e-9;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+std::vector<SpanRecord> PerformanceMonitor::recentSpans() const
+{
+  std::vector<SpanRecord> spans;
+  boost::unique_lock<boost::mutex> lock(mut_);
+  for(auto&& t:threads_)
+    t->ring.read(spans);
+  return spans;
+}
+
+size_t PerformanceMonitor::count(const std::string& name) const
+{
+  std::vector<uint64_t> counts;
+  uint64_t n, sum, max;
+  merge(stageId(name), counts, n, sum, max);
+  return n;
+}
+
+double PerformanceMonitor::percentile(const std::string& name, double p) const
+{
+  std::vector<uint64_t> counts;
+  uint64_t n, sum, max;
+  merge(stageId(name), counts, n, sum, max);
+  return percentileOf(counts, p);
+}
+
+void PerformanceMonitor::writeSummary(FILE* out) const
+{
+  fprintf(out, "%-20s %8s %10s %10s %10s %10s %10s\n",
+          "stage", "count", "mean[ms]", "p50[ms]", "p95[ms]", "p99[ms]", "max[ms]");
+  for(auto&& s:snapshot())
+    fprintf(out, "%-20s %8llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", s.name.c_str(),
+            static_cast<unsigned long long>(s.count), s.mean*1e3, s.p50*1e3, s.p95*1e3, s.p99*1e3, s.max*1e3);
+}
+
+void PerformanceMonitor::reset()
+{
+  boost::unique_lock<boost::mutex> lock(mut_);
+  for(auto&& t:threads_)
+    for(int i=0; i<kMaxStages; ++i)
+      t->hist[i].reset();
+}
+
+} // namespace vk
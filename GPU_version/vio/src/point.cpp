@@ -52,37 +52,34 @@ Point::Point(const Vector3d& pos, std::shared_ptr<Feature> ftr) :
 Point::~Point()
 {}
 
-void Point::addFrameRef(std::shared_ptr<Feature> ftr)
+void Point::addFrameRef(const std::shared_ptr<Feature>& ftr)
 {
   obs_.push_front(ftr);
   ++n_obs_;
 }
 
-std::shared_ptr<Feature> Point::findFrameRef(FramePtr frame)
+std::shared_ptr<Feature> Point::findFrameRef(const Frame* frame)
 {
     boost::unique_lock<boost::mutex> lock(point_mut_);
-  for(auto it=obs_.begin(), ite=obs_.end(); it!=ite; ++it)
-    if((*it)->frame == frame)
-      return *it;
+  for(auto&& ftr:obs_)
+    if(ftr->frame == frame)
+      return ftr;
   return NULL;    // no keyframe found
 }
 
-bool Point::deleteFrameRef(FramePtr frame)
+void Point::alignmentPointsMoved() const
+{
+  for(auto&& ftr:obs_)
+    if(ftr->frame != nullptr && ftr->frame->is_keyframe_)
+      ftr->frame->alignmentPointsMoved();
+}
+
+bool Point::deleteFrameRef(const Frame* frame)
 {
     boost::unique_lock<boost::mutex> lock(point_mut_);
-  for(auto it=obs_.begin(), ite=obs_.end(); it!=ite; ++it)
-  {
-    if(!(*it)->frame){
-        obs_.erase(it);
-        continue;
-    }
-    if((*it)->frame->id_ == frame->id_)
-    {
-      obs_.erase(it);
-      return true;
-    }
-  }
-  return false;
+  const size_t n = obs_.size();
+  obs_.remove_if([&](const std::shared_ptr<Feature>& ftr) { return ftr->frame == frame; });
+  return obs_.size() != n;
 }
 
 bool Point::getCloseViewObs(const Vector2d& framepos, std::shared_ptr<Feature>& ftr,int id) const
@@ -122,6 +119,7 @@ bool Point::getCloseViewObs(const Vector2d& framepos, std::shared_ptr<Feature>&
 void Point::optimize(const size_t n_iter)
 {
   boost::unique_lock<boost::mutex> lock(point_mut_);
+  const Vector3d start_point = pos_;
   Vector3d old_point = pos_;
   double chi2 = 0.0;
   Matrix3d A;
@@ -137,7 +135,7 @@ void Point::optimize(const size_t n_iter)
     {
       Matrix23d J;
       const Vector3d p_in_f((*it)->frame->w2f(pos_));
-      jacobian_xyz2uv_(p_in_f, (*it)->frame->se3().rotation_matrix(), J, (*it)->frame->cam_->params(), (*it)->frame->T_f_w_);
+      jacobian_xyz2uv_(p_in_f, (*it)->frame->T_f_w_.rotationMatrix(), J, (*it)->frame->cam_->params(), (*it)->frame->T_f_w_);
       //jacobian_xyz2uv(p_in_f,(*it)->frame->se3().rotation_matrix(),J);
       const Vector2d e=vk::project2d((*it)->f) - vk::project2d(p_in_f)/(1<<(*it)->level);
       new_chi2 += e.norm();
@@ -165,6 +163,8 @@ void Point::optimize(const size_t n_iter)
     if(vk::norm_max(dp) <= EPS)
       break;
   }
+  if(pos_ != start_point)
+    alignmentPointsMoved();
   n_failed_reproj_=0;
   for(auto it=obs_.begin(); it!=obs_.end(); ++it) {
             Vector2d e = vk::project2d((*it)->f) - vk::project2d((*it)->frame->w2f(pos_));
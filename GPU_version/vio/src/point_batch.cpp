@@ -0,0 +1,101 @@
+//
+// Created by root on 10/17/26.
+//
+
+#include <vio/point_batch.h>
+
+#if __AVX__
+# include <immintrin.h>
+#elif __SSE2__
+# include <emmintrin.h>
+#elif (__ARM_NEON__ || __ARM_NEON) && __aarch64__
+# include <arm_neon.h>
+#endif
+
+namespace vio {
+
+void PointBatch::clear()
+{
+  x_w.clear();
+  y_w.clear();
+  z_w.clear();
+}
+
+void PointBatch::reserve(size_t n)
+{
+  x_w.reserve(n);
+  y_w.reserve(n);
+  z_w.reserve(n);
+}
+
+void PointBatch::push_back(const Eigen::Vector3d& xyz_w)
+{
+  x_w.push_back(xyz_w.x());
+  y_w.push_back(xyz_w.y());
+  z_w.push_back(xyz_w.z());
+}
+
+void transformPoints(
+    const Eigen::Matrix3d& R, const Eigen::Vector3d& t, size_t n,
+    const double* x, const double* y, const double* z,
+    double* x_out, double* y_out, double* z_out)
+{
+  size_t i = 0;
+#if __AVX__
+  const __m256d r00 = _mm256_set1_pd(R(0,0)), r01 = _mm256_set1_pd(R(0,1)), r02 = _mm256_set1_pd(R(0,2));
+  const __m256d r10 = _mm256_set1_pd(R(1,0)), r11 = _mm256_set1_pd(R(1,1)), r12 = _mm256_set1_pd(R(1,2));
+  const __m256d r20 = _mm256_set1_pd(R(2,0)), r21 = _mm256_set1_pd(R(2,1)), r22 = _mm256_set1_pd(R(2,2));
+  const __m256d t0 = _mm256_set1_pd(t[0]), t1 = _mm256_set1_pd(t[1]), t2 = _mm256_set1_pd(t[2]);
+  for(; i+4<=n; i+=4)
+  {
+    const __m256d px = _mm256_loadu_pd(x+i);
+    const __m256d py = _mm256_loadu_pd(y+i);
+    const __m256d pz = _mm256_loadu_pd(z+i);
+    _mm256_storeu_pd(x_out+i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r00, px), _mm256_mul_pd(r01, py)),
+                                            _mm256_add_pd(_mm256_mul_pd(r02, pz), t0)));
+    _mm256_storeu_pd(y_out+i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r10, px), _mm256_mul_pd(r11, py)),
+                                            _mm256_add_pd(_mm256_mul_pd(r12, pz), t1)));
+    _mm256_storeu_pd(z_out+i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r20, px), _mm256_mul_pd(r21, py)),
+                                            _mm256_add_pd(_mm256_mul_pd(r22, pz), t2)));
+  }
+#elif __SSE2__
+  const __m128d r00 = _mm_set1_pd(R(0,0)), r01 = _mm_set1_pd(R(0,1)), r02 = _mm_set1_pd(R(0,2));
+  const __m128d r10 = _mm_set1_pd(R(1,0)), r11 = _mm_set1_pd(R(1,1)), r12 = _mm_set1_pd(R(1,2));
+  const __m128d r20 = _mm_set1_pd(R(2,0)), r21 = _mm_set1_pd(R(2,1)), r22 = _mm_set1_pd(R(2,2));
+  const __m128d t0 = _mm_set1_pd(t[0]), t1 = _mm_set1_pd(t[1]), t2 = _mm_set1_pd(t[2]);
+  for(; i+2<=n; i+=2)
+  {
+    const __m128d px = _mm_loadu_pd(x+i);
+    const __m128d py = _mm_loadu_pd(y+i);
+    const __m128d pz = _mm_loadu_pd(z+i);
+    _mm_storeu_pd(x_out+i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r00, px), _mm_mul_pd(r01, py)),
+                                      _mm_add_pd(_mm_mul_pd(r02, pz), t0)));
+    _mm_storeu_pd(y_out+i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r10, px), _mm_mul_pd(r11, py)),
+                                      _mm_add_pd(_mm_mul_pd(r12, pz), t1)));
+    _mm_storeu_pd(z_out+i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(r20, px), _mm_mul_pd(r21, py)),
+                                      _mm_add_pd(_mm_mul_pd(r22, pz), t2)));
+  }
+#elif (__ARM_NEON__ || __ARM_NEON) && __aarch64__
+  for(; i+2<=n; i+=2)
+  {
+    const float64x2_t px = vld1q_f64(x+i);
+    const float64x2_t py = vld1q_f64(y+i);
+    const float64x2_t pz = vld1q_f64(z+i);
+    vst1q_f64(x_out+i, vaddq_f64(vaddq_f64(vmulq_n_f64(px, R(0,0)), vmulq_n_f64(py, R(0,1))),
+                                 vaddq_f64(vmulq_n_f64(pz, R(0,2)), vdupq_n_f64(t[0]))));
+    vst1q_f64(y_out+i, vaddq_f64(vaddq_f64(vmulq_n_f64(px, R(1,0)), vmulq_n_f64(py, R(1,1))),
+                                 vaddq_f64(vmulq_n_f64(pz, R(1,2)), vdupq_n_f64(t[1]))));
+    vst1q_f64(z_out+i, vaddq_f64(vaddq_f64(vmulq_n_f64(px, R(2,0)), vmulq_n_f64(py, R(2,1))),
+                                 vaddq_f64(vmulq_n_f64(pz, R(2,2)), vdupq_n_f64(t[2]))));
+  }
+#endif
+  for(; i<n; ++i)
+  {
+    const double px = x[i], py = y[i], pz = z[i];
+    x_out[i] = R(0,0)*px + R(0,1)*py + (R(0,2)*pz + t[0]);
+    y_out[i] = R(1,0)*px + R(1,1)*py + (R(1,2)*pz + t[1]);
+    z_out[i] = R(2,0)*px + R(2,1)*py + (R(2,2)*pz + t[2]);
+  }
+}
+
+} // namespace vio
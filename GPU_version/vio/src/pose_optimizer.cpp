@@ -35,13 +35,13 @@ void optimizeGaussNewton(
     double& error_final,
     size_t& num_obs,
     vio::Map& map,
-    FILE* log)
+    AsyncLogger* log)
 {
   // init
   double chi2(0.0);
   vector<double> chi2_vec_init, chi2_vec_final;
   vk::robust_cost::HuberWeightFunction weight_function;
-  SE2_5 T_old(frame->T_f_w_.se2());
+  SE2_5 T_old(frame->T_f_w_);
   Matrix3d A;
   Vector3d b;
 
@@ -56,7 +56,7 @@ void optimizeGaussNewton(
       double z=frame->w2f((*it)->point->pos_).z();
       if((*it)->point->pos_.hasNaN() || (*it)->point->pos_.norm()==0. || z<0.05 || z > 20.0){
           map.safeDeletePoint((*it)->point);
-          it = frame->fts_.erase(it);
+          it = frame->eraseFeature(it);
           continue;
       }
       if((*it)->point->type_==vio::Point::TYPE_UNKNOWN){
@@ -68,7 +68,7 @@ void optimizeGaussNewton(
                - vk::project2d(Vector3d(frame->se3()*(*it)->point->pos_));
     if(std::isnan(e.norm())){
         map.safeDeletePoint((*it)->point);
-        it = frame->fts_.erase(it);
+        it = frame->eraseFeature(it);
         continue;
     }
     e *= 1.0 / (1<<(*it)->level);
@@ -82,6 +82,19 @@ void optimizeGaussNewton(
   vk::robust_cost::MADScaleEstimator scale_estimator;
   estimated_scale = scale_estimator.compute(errors);
 
+  // the observations of the iterations, their points are projected in one batch per iteration
+  vector<Feature*> obs;
+  PointBatch batch;
+  obs.reserve(frame->fts_.size());
+  batch.reserve(frame->fts_.size());
+  for(auto&& ftr : frame->fts_)
+  {
+    if(ftr->point==NULL)continue;
+    if(ftr->point->type_==vio::Point::TYPE_UNKNOWN)continue;
+    obs.push_back(ftr.get());
+    batch.push_back(ftr->point->pos_);
+  }
+
   double scale = estimated_scale;
   for(size_t iter=0; iter<n_iter; iter++)
   {
@@ -93,14 +106,14 @@ void optimizeGaussNewton(
     if(iter == 5)
         scale = 0.85/frame->cam_->errorMultiplier2();
     // compute residual
-    for(auto it=frame->fts_.begin(); it!=frame->fts_.end(); ++it)
+    frame->w2f(batch);
+    for(size_t i=0; i<obs.size(); ++i)
     {
-      if((*it)->point==NULL)continue;
-      if((*it)->point->type_==vio::Point::TYPE_UNKNOWN)continue;
+      const Feature* ftr = obs[i];
       Matrix23d J;
-      frame->jacobian_xyz2uv_((*it)->f,(*it)->point->pos_,J);
-      Vector2d e = vk::project2d((*it)->f) - vk::project2d(frame->w2f((*it)->point->pos_));
-      double sqrt_inv_cov = 1.0 / (1<<(*it)->level);
+      frame->jacobian_xyz2uv_(ftr->f,ftr->point->pos_,J);
+      Vector2d e = vk::project2d(ftr->f) - vk::project2d(batch.xyz_f(i));
+      double sqrt_inv_cov = 1.0 / (1<<ftr->level);
       e *= sqrt_inv_cov;
       J *= sqrt_inv_cov;
       double weight = weight_function.value(e.norm()/scale);
@@ -122,7 +135,7 @@ void optimizeGaussNewton(
     dT *=new_chi2;
     // update the model
     T_old = frame->T_f_w_;
-    frame->T_f_w_=SE2_5(T_old.se2().translation().x()+dT.x(),T_old.se2().translation().y()+dT.y(),T_old.pitch()+dT.z());
+    frame->T_f_w_.set(T_old.x()+dT.x(),T_old.z()+dT.y(),T_old.pitch()+dT.z());
     chi2 = new_chi2;
 
     // stop when converged
@@ -130,7 +143,12 @@ void optimizeGaussNewton(
       break;
   }
   num_obs=0;
-  for(auto it=frame->fts_.begin(); it!=frame->fts_.end(); /*++it*/)
+  batch.clear();
+  for(auto&& ftr : frame->fts_)
+    batch.push_back(ftr->point != NULL ? ftr->point->pos_ : Vector3d::Zero());
+  frame->w2f(batch);
+  size_t i = 0;
+  for(auto it=frame->fts_.begin(); it!=frame->fts_.end(); ++i /*++it*/)
   {
     if((*it)->point == NULL) {
         it++;// = frame->fts_.erase(it);
@@ -138,16 +156,16 @@ void optimizeGaussNewton(
     }
     if((*it)->point->pos_.hasNaN() || (*it)->point->pos_.norm()==0.){
           map.safeDeletePoint((*it)->point);
-          it = frame->fts_.erase(it);
+          it = frame->eraseFeature(it);
           continue;
     }
-    Vector2d e = vk::project2d((*it)->f) - vk::project2d(frame->w2f((*it)->point->pos_));
+    Vector2d e = vk::project2d((*it)->f) - vk::project2d(batch.xyz_f(i));
     e /= (1<<(*it)->level);
     chi2_vec_final.push_back(e.norm());
     if(e.norm() >  vio::Config::poseOptimThresh() / frame->cam_->errorMultiplier2())
     {
       map.safeDeletePoint((*it)->point);
-      it = frame->fts_.erase(it);
+      it = frame->eraseFeature(it);
     }else{
         (*it)->point->type_=vio::Point::TYPE_CANDIDATE;
         ++num_obs;
@@ -162,8 +180,7 @@ void optimizeGaussNewton(
         error_init /=chi2_vec_init.size();
     if(!chi2_vec_final.empty())for(auto&& i:chi2_vec_final)error_final+=i;
         error_final /= chi2_vec_final.size();
-    fprintf(log,"[%s]  n obs with reprojection error less than 1.0 / frame->cam_->errorMultiplier2() =%d \t error init =%f \t error end=%f\n",
-            vio::time_in_HH_MM_SS_MMM().c_str(),num_obs,error_init,error_final);
+    log->write(" n obs with reprojection error less than 1.0 / frame->cam_->errorMultiplier2() =%d \t error init =%f \t error end=%f\n",num_obs,error_init,error_final);
 #endif
 }
 
@@ -15,6 +15,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vio/reprojector.h>
 #include <vio/frame.h>
@@ -30,37 +31,67 @@
 #include <fstream>
 #include <vio/feature_detection.h>
 #include <vio/sparse_img_align_gpu.h>
-#include <opencv2/xfeatures2d.hpp>
-#include <opencv2/features2d.hpp>
 #include <vio/for_it.hpp>
 
 namespace vio {
 
     Reprojector::Reprojector(vk::AbstractCamera *cam, Map& map) :
-            map_(map) {
+            map_(map),
+            fast_threshold_(Config::nPyrLevels(), Config::fastThreshold(), Config::fastTargetCorners()) {
         initializeGrid(cam);
     }
 
-    Reprojector::~Reprojector() {
-        std::for_each(grid_.cells.begin(), grid_.cells.end(), [&](Cell *c) { delete c; });
-    }
-
     void Reprojector::initializeGrid(vk::AbstractCamera *cam) {
         grid_.cell_size = Config::gridSize();
         grid_.grid_n_cols = ceil(static_cast<double>(cam->width()) / grid_.cell_size);
         grid_.grid_n_rows = ceil(static_cast<double>(cam->height()) / grid_.cell_size);
-        grid_.cells.resize(grid_.grid_n_cols * grid_.grid_n_rows);
-        std::for_each(grid_.cells.begin(), grid_.cells.end(), [&](Cell *&c) { c = new Cell; });
-        grid_.cell_order.resize(grid_.cells.size());
-        for (size_t i = 0; i < grid_.cells.size(); ++i)
-            grid_.cell_order[i] = i;
-        random_shuffle(grid_.cell_order.begin(), grid_.cell_order.end()); // maybe we should do it at every iteration!
+        grid_.start.assign(grid_.grid_n_cols * grid_.grid_n_rows + 1, 0);
+        grid_.occupied.assign(grid_.grid_n_cols * grid_.grid_n_rows, 0);
     }
 
     void Reprojector::resetGrid() {
         n_matches_ = 0;
         n_trials_ = 0;
-        std::for_each(grid_.cells.begin(), grid_.cells.end(), [&](Cell *c) { c->clear(); });
+        std::fill(grid_.occupied.begin(), grid_.occupied.end(), 0);
+    }
+
+    void Reprojector::Grid::build(const FeatureTable& keypoints) {
+        // counting sort by cell, the keypoints of a cell stay in increasing order
+        std::fill(start.begin(), start.end(), 0);
+        std::fill(occupied.begin(), occupied.end(), 0);
+        for (auto&& p:keypoints.px())
+            ++start[cell(p) + 1];
+        for (size_t c = 1; c < start.size(); ++c)
+            start[c] += start[c - 1];
+        index.resize(keypoints.size());
+        vector<int> next(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < keypoints.size(); ++i)
+            index[next[cell(keypoints.px(i))]++] = i;
+    }
+
+    void Reprojector::Grid::query(const FeatureTable& keypoints, const Vector2d& px, double radius,
+                                  vector<int>& candidates) const {
+        const int c0 = std::max(0, static_cast<int>(std::floor((px.x() - radius) / cell_size)));
+        const int c1 = std::min(grid_n_cols - 1, static_cast<int>(std::floor((px.x() + radius) / cell_size)));
+        const int r0 = std::max(0, static_cast<int>(std::floor((px.y() - radius) / cell_size)));
+        const int r1 = std::min(grid_n_rows - 1, static_cast<int>(std::floor((px.y() + radius) / cell_size)));
+        const size_t first = candidates.size();
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                for (int i = start[r * grid_n_cols + c]; i < start[r * grid_n_cols + c + 1]; ++i) {
+                    const Vector2d& kp = keypoints.px(index[i]);
+                    if (std::fabs(kp.x() - px.x()) <= radius && std::fabs(kp.y() - px.y()) <= radius)
+                        candidates.push_back(index[i]);
+                }
+        std::sort(candidates.begin() + first, candidates.end());
+    }
+
+    double Reprojector::matchWindow(const Frame& frame, double depth) const {
+        const double f = frame.cam_->errorMultiplier2();
+        const double sigma_px = f * std::sqrt(frame.Cov_(2, 2) +
+                                              (frame.Cov_(0, 0) + frame.Cov_(1, 1)) / (depth * depth));
+        const double radius = Config::matchWindowMin() + Config::matchWindowSigma() * sigma_px;
+        return std::isfinite(radius) ? std::min(radius, Config::matchWindowMax()) : Config::matchWindowMax();
     }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -69,118 +100,133 @@ namespace vio {
             FramePtr frame,
             FramePtr last_frame,
             std::vector<std::pair<FramePtr, std::size_t> > &overlap_kfs,
-            opencl* gpu_fast_,
-            FILE* log_) {
+            ComputeBackend* backend,
+            AsyncLogger* log_) {
         if(frame->id_<1)return;
         resetGrid();
-        Features keypoints;
-        cv::Ptr<cv::BFMatcher> matcher = cv::BFMatcher::create(cv::NORM_HAMMING2,false);
+        FeatureTable keypoints;
         std::unique_ptr<feature_detection::FastDetector> detector=std::make_unique<feature_detection::FastDetector>(
-                frame->img().cols, frame->img().rows, Config::gridSize(), gpu_fast_,Config::nPyrLevels());
-        detector->detect(frame, frame->img_pyr_, Config::triangMinCornerScore(), keypoints);
-        std::vector<cv::KeyPoint> keypoints_cur;
-        list<std::shared_ptr<Feature>>::iterator it_cur=keypoints.begin();
-        cv::Mat cur_des=cv::Mat(keypoints.size(),64,CV_8UC1);
-        cv::Mat maskup = cv::Mat_<uchar>(1, keypoints.size());
-        cv::Mat maskdown = cv::Mat_<uchar>(1, keypoints.size());
-        for (int i=0;i<keypoints.size() && it_cur !=keypoints.end();++i) {
-            keypoints_cur.push_back(cv::KeyPoint((*it_cur)->px.x(), (*it_cur)->px.y(), 7.f, (*it_cur)->score));
-            memcpy(cur_des.data+(i*64),(*it_cur)->descriptor,sizeof(uint8_t)*64);
-            if ((*it_cur)->px.y() < frame->img().rows/2) {
-                maskup.at<uchar>(0, i) = 1;
-                maskdown.at<uchar>(0, i) = 0;
-            }
-            else{
-                maskup.at<uchar>(0, i) = 0;
-                maskdown.at<uchar>(0, i) = 1;
-            }
-            ++it_cur;
-        }
+                frame->img().cols, frame->img().rows, Config::gridSize(), backend,Config::nPyrLevels(),&fast_threshold_);
+        detector->detect(frame, *frame->img_pyr_, Config::triangMinCornerScore(), keypoints);
+        // the descriptors of the keypoints are in one block, the keypoints bucketed in the grid
+        grid_.build(keypoints);
+        const int rows = frame->img().rows;
+        const int cols = frame->img().cols;
+        // a feature without a point is matched against the keypoints of its image half
+        std::vector<int> upper_half, lower_half;
+        for (size_t i=0;i<keypoints.size();++i)
+            (keypoints.px(i).y() < rows/2 ? upper_half : lower_half).push_back((int)i);
         list<pair<FramePtr, double> > close_kfs;
         map_.getCloseKeyframes(frame, close_kfs);
         if (!last_frame->fts_.empty())
-            close_kfs.push_back(pair<FramePtr, double>(last_frame, (frame->T_f_w_.se2().translation() -
-                                                                    last_frame->T_f_w_.se2().translation()).norm()));
+            close_kfs.push_back(pair<FramePtr, double>(last_frame, (frame->pos() - last_frame->pos()).norm()));
         close_kfs.sort(boost::bind(&std::pair<FramePtr, double>::second, _1) <
                        boost::bind(&std::pair<FramePtr, double>::second, _2));
         overlap_kfs.reserve(options_.max_n_kfs);
-        std::unique_ptr<SparseImgAlignGpu> img_align=std::make_unique<SparseImgAlignGpu>(Config::kltMaxLevel(), Config::kltMinLevel(),30, SparseImgAlignGpu::GaussNewton, false,gpu_fast_);
+        std::unique_ptr<SparseImgAlignGpu> img_align=std::make_unique<SparseImgAlignGpu>(Config::kltMaxLevel(), Config::kltMinLevel(),30, SparseImgAlignGpu::GaussNewton, false,backend);
         std::vector<int> added_keypoints;
+        std::vector<FramePtr> align_kfs; // keyframes of the joint alignment
+        vk::Timer match_timer; // accumulates the matching time, without the image alignment
         for (auto &&it_frame:_for(close_kfs)) {
             int points_count=0;
             if (it_frame.index > options_.max_n_kfs)continue;
+            match_timer.resume();
             overlap_kfs.push_back(pair<FramePtr, size_t>(it_frame.item.first, 0));
-            list<std::shared_ptr<Feature>>::iterator it_ref=it_frame.item.first->fts_.begin();
-            for (int i=0;i<it_frame.item.first->fts_.size() && it_ref !=it_frame.item.first->fts_.end();++i) {
-                std::vector<cv::KeyPoint> keypoints_kfs;
-                std::vector<std::vector<cv::DMatch>>  matches;
-                keypoints_kfs.push_back(cv::KeyPoint((*it_ref)->px.x(), (*it_ref)->px.y(), 7.f,(*it_ref)->score));
-                cv::Mat ref_des=cv::Mat(1,64,CV_8UC1,(*it_ref)->descriptor);
-                if ((*it_ref)->px.y() < frame->img().rows/2) {
-                    matcher->knnMatch(ref_des, cur_des, matches, 1, cv::InputArray(maskup));
+            // all features of the keyframe are matched in one call, each against the keypoints in
+            // the window around its projection with the pose prior. A feature without a point
+            // has no depth and is matched against the keypoints of its image half. A row without
+            // candidates gets an empty range and no match.
+            const FeatureTable& ref_fts = it_frame.item.first->featureTable();
+            std::vector<int> offsets(ref_fts.size()+1, 0), candidates;
+            for (size_t i=0;i<ref_fts.size();++i) {
+                offsets[i+1] = offsets[i];
+                if (ref_fts.pointId(i) >= 0) {
+                    const Vector3d xyz_f = frame->w2f(ref_fts.feature(i)->point->pos_);
+                    if (xyz_f.z() < 0.01)continue;
+                    const double radius = matchWindow(*frame, xyz_f.z());
+                    const Vector2d px = frame->f2c(xyz_f);
+                    if (px.x() < -radius || px.y() < -radius || px.x() > cols+radius || px.y() > rows+radius)continue;
+                    grid_.query(keypoints, px, radius, candidates);
                 }
-                else{
-                    matcher->knnMatch(ref_des, cur_des, matches, 1, cv::InputArray(maskdown));
+                else {
+                    const std::vector<int>& half = ref_fts.px(i).y() < rows/2 ? upper_half : lower_half;
+                    candidates.insert(candidates.end(), half.begin(), half.end());
                 }
-                for(auto&& match:matches.back()){
-                    it_cur=keypoints.begin();
-                    std::advance(it_cur,match.trainIdx);
-                    if(!(*it_cur))continue;
-                    Vector2d px((int) (*it_cur)->px.x(),
-                                (int) (*it_cur)->px.y());
-                    const int k = static_cast<int>((*it_cur)->px.y() / grid_.cell_size) *
-                                  grid_.grid_n_cols
-                                  + static_cast<int>((*it_cur)->px.x() / grid_.cell_size);
-                    if(grid_.cells.at(k)->size()> Config::gridSize()-1)continue;
-                    if ((*it_ref)->point == NULL){
-                        SE3 T_ref_cur=it_frame.item.first->se3().inverse()*frame->se3();
-                        // pose with respect to reference frame
-                        Vector3d pos=vk::triangulateFeatureNonLin(T_ref_cur.rotation_matrix(),T_ref_cur.translation(),
-                                                                  (*it_ref)->f,frame->c2f(px));
-                        if(pos.norm()==0. || pos.hasNaN() || pos.z() < 0.01)continue;
-                        // point in world frame
-                        (*it_ref)->point=std::make_shared<Point>(it_frame.item.first->se3()*pos,(*it_ref));
-
-                        if(!matcher_.findMatchDirect(*(*it_ref)->point, *frame, px)){
-                            (*it_ref)->point.reset();
-                            continue;
-                        }
-                        frame->addFeature(std::make_shared<Feature>(frame,
-                                                                    (*it_ref)->point,
-                                                                    px,(*it_cur)->level,(*it_cur)->score,(*it_cur)->descriptor));
-                        (*it_ref)->point->addFrameRef(frame->fts_.back());
-                        added_keypoints.push_back(match.trainIdx);
-                        (*it_ref)->point->last_frame_overlap_id_=it_frame.item.first->id_;
-                        (*it_ref)->point->type_=vio::Point::TYPE_UNKNOWN;
-                        grid_.cells.at(k)->push_back(Candidate( px));
-                        overlap_kfs.back().second++;
-                        ++points_count;
-                    }else{
-                        if(!matcher_.findMatchDirect(*(*it_ref)->point, *frame, px))continue;
-                        (*it_ref)->point->last_frame_overlap_id_ = frame->id_;
-                        frame->addFeature(std::make_shared<Feature>(frame,
-                                                                    (*it_ref)->point,
-                                                                    px,(*it_cur)->level,(*it_cur)->score,(*it_cur)->descriptor));
+                offsets[i+1] = candidates.size();
+            }
+            std::vector<cv::DMatch> matches;
+            hamming_matcher_.match(ref_fts.descriptors(), ref_fts.size(), keypoints.descriptors(), offsets.data(),
+                                   candidates.data(), matches);
+            for(auto&& match:matches){
+                const std::shared_ptr<Feature>& ref = ref_fts.feature(match.queryIdx);
+                const int cur = match.trainIdx;
+                Vector2d px((int) keypoints.px(cur).x(),
+                            (int) keypoints.px(cur).y());
+                const int k = grid_.cell(keypoints.px(cur));
+                if(grid_.occupied.at(k)> Config::gridSize()-1)continue;
+                if (ref->point == NULL){
+                    SE3 T_ref_cur=it_frame.item.first->T_f_w_.inverse()*frame->se3();
+                    // pose with respect to reference frame
+                    Vector3d pos=vk::triangulateFeatureNonLin(T_ref_cur.rotation_matrix(),T_ref_cur.translation(),
+                                                              ref->f,frame->c2f(px));
+                    if(pos.norm()==0. || pos.hasNaN() || pos.z() < 0.01)continue;
+                    // point in world frame
+                    ref->point=map_.newPoint(it_frame.item.first->se3()*pos,ref);
 
-                        (*it_ref)->point->addFrameRef(frame->fts_.back());
-                        (*it_ref)->point->type_=vio::Point::TYPE_CANDIDATE;
-                        added_keypoints.push_back(match.trainIdx);
-                        grid_.cells.at(k)->push_back(Candidate( px));
-                        overlap_kfs.back().second++;
-                        ++points_count;
+                    if(!matcher_.findMatchDirect(*ref->point, *frame, px)){
+                        ref->point->obs_.clear();
+                        map_.deletePoint(ref->point);
+                        ref->point.reset();
+                        continue;
                     }
+                    frame->addFeature(std::make_shared<Feature>(frame,
+                                                                ref->point,
+                                                                px,keypoints.score(cur),keypoints.level(cur),
+                                                                keypoints.descriptor(cur)));
+                    ref->point->addFrameRef(frame->fts_.back());
+                    // the cached alignment reference of the keyframe lacks the new point
+                    it_frame.item.first->invalidateAlignmentReference();
+                    added_keypoints.push_back(cur);
+                    ref->point->last_frame_overlap_id_=it_frame.item.first->id_;
+                    ref->point->type_=vio::Point::TYPE_UNKNOWN;
+                    ++grid_.occupied.at(k);
+                    overlap_kfs.back().second++;
+                    ++points_count;
+                }else{
+                    if(!matcher_.findMatchDirect(*ref->point, *frame, px))continue;
+                    ref->point->last_frame_overlap_id_ = frame->id_;
+                    frame->addFeature(std::make_shared<Feature>(frame,
+                                                                ref->point,
+                                                                px,keypoints.score(cur),keypoints.level(cur),
+                                                                keypoints.descriptor(cur)));
+
+                    ref->point->addFrameRef(frame->fts_.back());
+                    ref->point->type_=vio::Point::TYPE_CANDIDATE;
+                    added_keypoints.push_back(cur);
+                    ++grid_.occupied.at(k);
+                    overlap_kfs.back().second++;
+                    ++points_count;
                 }
-                ++it_ref;
             }
-            if(points_count>10)img_align->run(it_frame.item.first, frame, log_);
+            match_timer.stop();
+            if(points_count>10 && Config::jointImgAlign()){
+                align_kfs.push_back(it_frame.item.first);
+            }else if(points_count>10){
+                VIO_SPAN("sparse_img_align");
+                img_align->run(it_frame.item.first, frame, log_);
+            }
+        }
+        if(!align_kfs.empty()){
+            VIO_SPAN("sparse_img_align");
+            img_align->run(align_kfs, frame, log_);
         }
-        for(auto&& p:keypoints){
-            int k = static_cast<int>(p->px.y() / grid_.cell_size) *
-                          grid_.grid_n_cols
-                          + static_cast<int>(p->px.x() / grid_.cell_size);
-            if(grid_.cells.at(k)->size()<0.5*Config::gridSize()) {
-                frame->addFeature(std::make_shared<Feature>(frame, p->px, p->level, p->score, p->descriptor));
-                grid_.cells.at(k)->push_back(Candidate( p->px));
+        VIO_LOG("reproject_match", match_timer.getTime());
+        for(size_t i=0;i<keypoints.size();++i){
+            const int k = grid_.cell(keypoints.px(i));
+            if(grid_.occupied.at(k)<0.5*Config::gridSize()) {
+                frame->addFeature(std::make_shared<Feature>(frame, PointHandle(), keypoints.px(i), keypoints.f(i),
+                                                            keypoints.score(i), keypoints.level(i), keypoints.descriptor(i)));
+                ++grid_.occupied.at(k);
             }
         }
 /*        std::cerr<<"here\n";
@@ -79,7 +79,7 @@ Matrix<double, 3, 3> SparseImgAlign::getFisherInformation()
 void SparseImgAlign::precomputeReferencePatches()
 {
   const int border = patch_halfsize_+1;
-  const cv::Mat& ref_img = ref_frame_->img_pyr_.at(level_);
+  const cv::Mat& ref_img = ref_frame_->img(level_);
   const int stride = ref_img.cols;
   const float scale = 1.0f/(1<<level_);
   const Vector3d ref_pos(ref_frame_->pos()(0),1e-19,ref_frame_->pos()(1));
@@ -144,7 +144,7 @@ double SparseImgAlign::computeResiduals(
     bool compute_weight_scale)
 {
   // Warp the (cur)rent image such that it aligns with the (ref)erence image
-  const cv::Mat& cur_img = cur_frame_->img_pyr_.at(level_);
+  const cv::Mat& cur_img = cur_frame_->img(level_);
 
   if(linearize_system && display_)
     resimg_ = cv::Mat(cur_img.size(), CV_32F, cv::Scalar(0));
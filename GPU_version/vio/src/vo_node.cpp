@@ -62,7 +62,7 @@ public:
             start_=false;
             vo_->depthFilter()->stopThread();
 #if VIO_DEBUG
-    fclose(vo_->log_);
+    vo_->log_->flush();
 #endif
             imu_the_->interrupt();
             if(imu_the_->get_id()==boost::this_thread::get_id())
@@ -70,6 +70,10 @@ public:
             else
                 imu_the_->join();
             imu_the_=NULL;
+#ifdef VIO_TRACE
+            if(vio::g_permon)
+                vio::g_permon->writeSummary(stdout);
+#endif
             res.ret=0;
         }else{
             res.ret=100;
@@ -143,6 +147,7 @@ void VioNode::imgCb(const sensor_msgs::ImageConstPtr& msg)
 }
 void VioNode::imuCb(const sensor_msgs::ImuPtr &imu) {
     if(!start_)return;
+    VIO_SPAN("imu_update");
     double imu_in[3];
     imu_in[0] = 0.2*imu_[0]+0.8*imu->linear_acceleration.x;
     imu_in[1] = 0.2*imu_[1]+0.8*imu->linear_acceleration.y;
@@ -156,11 +161,12 @@ void VioNode::imuCb(const sensor_msgs::ImuPtr &imu) {
 }
 void VioNode::cmdCb(const geometry_msgs::TwistPtr &cmd) {
     if(!start_)return;
+    VIO_SPAN("cmd_update");
     double _cmd[3]={cmd->linear.x,cmd->linear.y,cmd->angular.z};
     vo_->UpdateCmd(_cmd,imu_time_);
 #if VIO_DEBUG
     auto odom=vo_->ukfPtr_.get_location();
-    fprintf(vo_->log_,"[%s] Odometry x=%f, y=%f, theta=%f\n",vio::time_in_HH_MM_SS_MMM().c_str(),
+    vo_->log_->write("Odometry x=%f, y=%f, theta=%f\n",
             odom.second.se2().translation()(0),odom.second.se2().translation()(1),
             odom.second.pitch());
 #endif
@@ -0,0 +1,37 @@
+//
+// Turns the binary debug logs (frame_handler_log.bin, loop_closure_log.bin) back into text.
+//
+// usage: vio_log_decode <log.bin> [out.txt]
+//
+
+#include <stdio.h>
+#include <vio/async_logger.h>
+
+int main(int argc, char **argv)
+{
+  if(argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "usage: %s <log.bin> [out.txt]\n", argv[0]);
+    return 1;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if(in == NULL)
+  {
+    fprintf(stderr, "vio_log_decode: cannot open %s\n", argv[1]);
+    return 1;
+  }
+  FILE* out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if(out == NULL)
+  {
+    fprintf(stderr, "vio_log_decode: cannot open %s\n", argv[2]);
+    fclose(in);
+    return 1;
+  }
+  const bool ok = vio::decodeBinaryLog(in, out);
+  if(!ok)
+    fprintf(stderr, "vio_log_decode: %s is not a vio log or is truncated\n", argv[1]);
+  fclose(in);
+  if(out != stdout)
+    fclose(out);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+//
+// Offline dataset replay, feeds images, imu and cmd samples to the pipeline without a ROS master
+// and prints the latency percentiles of every stage.
+//
+// usage: vio_replay --params param/px30.yaml param/vo_fast.yaml --images <dir> [--imu imu.csv]
+//                   [--cmd cmd.csv] [--max-frames N] [--rate R]
+//
+//   <dir>/images.csv  "timestamp,filename" per line, when missing all images of the directory are
+//                     used and the file name (without extension) is the timestamp [s].
+//   imu.csv           "timestamp,acc_x,acc_y,gyro_z"
+//   cmd.csv           "timestamp,linear_x,linear_y,angular_z"
+//   --rate            0 replays as fast as possible (default), 1 keeps the recorded timing.
+//
+
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <dirent.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <vio/frame_handler_mono.h>
+#include <vio/params_helper.h>
+#include <vio/abstract_camera.h>
+#include <vio/camera_loader.h>
+#include <vio/global_optimizer.h>
+#include <vio/timer.h>
+
+namespace {
+
+struct Event
+{
+  enum Type {IMAGE, IMU, CMD} type;
+  double t;
+  std::string file;       //!< image path.
+  double value[3];        //!< imu or cmd sample.
+  bool operator<(const Event& other) const { return t < other.t; }
+};
+
+std::vector<std::string> splitCsv(const std::string& line)
+{
+  std::vector<std::string> fields;
+  std::stringstream ss(line);
+  std::string field;
+  while(std::getline(ss, field, ','))
+  {
+    field.erase(0, std::min(field.size(), field.find_first_not_of(" \t")));
+    field.erase(field.find_last_not_of(" \t\r")+1);
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+void loadImages(const std::string& dir, std::vector<Event>& events)
+{
+  std::ifstream list((dir+"/images.csv").c_str());
+  if(list.is_open())
+  {
+    std::string line;
+    while(std::getline(list, line))
+    {
+      std::vector<std::string> f = splitCsv(line);
+      if(f.size() < 2 || f[0].empty() || f[0][0] == '#')
+        continue;
+      Event e;
+      e.type = Event::IMAGE;
+      e.t = std::stod(f[0]);
+      e.file = dir+"/"+f[1];
+      events.push_back(e);
+    }
+    return;
+  }
+  DIR* d = opendir(dir.c_str());
+  if(d == NULL)
+    throw std::runtime_error("Cannot open image directory "+dir);
+  while(dirent* entry = readdir(d))
+  {
+    const std::string name(entry->d_name);
+    const size_t dot = name.find_last_of('.');
+    if(dot == std::string::npos || dot == 0)
+      continue;
+    const std::string ext = name.substr(dot+1);
+    if(ext != "png" && ext != "jpg" && ext != "pgm")
+      continue;
+    Event e;
+    e.type = Event::IMAGE;
+    e.t = std::stod(name.substr(0, dot));
+    e.file = dir+"/"+name;
+    events.push_back(e);
+  }
+  closedir(d);
+}
+
+void loadSamples(const std::string& path, Event::Type type, std::vector<Event>& events)
+{
+  std::ifstream file(path.c_str());
+  if(!file.is_open())
+    throw std::runtime_error("Cannot open "+path);
+  std::string line;
+  while(std::getline(file, line))
+  {
+    std::vector<std::string> f = splitCsv(line);
+    if(f.size() < 4 || f[0].empty() || f[0][0] == '#')
+      continue;
+    Event e;
+    e.type = type;
+    e.t = std::stod(f[0]);
+    for(int i=0; i<3; ++i)
+      e.value[i] = std::stod(f[i+1]);
+    events.push_back(e);
+  }
+}
+
+/// Same preprocessing as VioNode::imgCb, returns false for blurred or dark frames.
+bool preprocess(const cv::Mat& img, cv::Mat& frame)
+{
+  cv::Mat imgbul, float_img;
+  img.convertTo(float_img, CV_64F, 1.f/255);
+  float_img*=2.0;
+  float_img+=0.2;
+  float_img.convertTo(frame, CV_8UC1, 255);
+  cv::Laplacian(frame, imgbul, CV_64F);
+  cv::Scalar mean, stddev;
+  meanStdDev(imgbul, mean, stddev, cv::Mat());
+  return stddev.val[0] * stddev.val[0] >= 30.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> params;
+  std::string image_dir, imu_file, cmd_file;
+  size_t max_frames = 0;
+  double rate = 0.0;
+  for(int i=1; i<argc; ++i)
+  {
+    const std::string arg(argv[i]);
+    if(arg == "--params")
+      while(i+1 < argc && argv[i+1][0] != '-')
+        params.push_back(argv[++i]);
+    else if(arg == "--images" && i+1 < argc)
+      image_dir = argv[++i];
+    else if(arg == "--imu" && i+1 < argc)
+      imu_file = argv[++i];
+    else if(arg == "--cmd" && i+1 < argc)
+      cmd_file = argv[++i];
+    else if(arg == "--max-frames" && i+1 < argc)
+      max_frames = std::stoul(argv[++i]);
+    else if(arg == "--rate" && i+1 < argc)
+      rate = std::stod(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s --params <yaml>... --images <dir> [--imu <csv>] [--cmd <csv>]"
+                      " [--max-frames N] [--rate R]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(image_dir.empty() || params.empty())
+  {
+    fprintf(stderr, "vio_replay: --images and --params are required\n");
+    return 1;
+  }
+  for(auto&& file:params)
+    if(!vk::loadParamFile(file))
+    {
+      fprintf(stderr, "vio_replay: cannot read %s\n", file.c_str());
+      return 1;
+    }
+  ros::Time::init();
+
+  std::vector<Event> events;
+  loadImages(image_dir, events);
+  if(!imu_file.empty())
+    loadSamples(imu_file, Event::IMU, events);
+  if(!cmd_file.empty())
+    loadSamples(cmd_file, Event::CMD, events);
+  std::stable_sort(events.begin(), events.end());
+
+  vk::AbstractCamera* cam = NULL;
+  if(!vk::camera_loader::loadFromRosNs("vio", cam))
+    throw std::runtime_error("Camera model not correctly specified.");
+  Eigen::Matrix<double,3,1> init;
+  init<<1e-19,1e-19,1e-19;
+  vio::FrameHandlerMono* vo = new vio::FrameHandlerMono(cam, init);
+  vo->depthFilter()->startThread();
+  vo->start();
+
+  double imu[3] = {0.0, 0.0, 0.0};
+  size_t n_frames = 0, n_skipped = 0;
+  const double t_start = vk::Timer::getCurrentTime();
+  for(auto&& e:events)
+  {
+    if(rate > 0.0)
+    {
+      const double wait = (e.t-events.front().t)/rate - (vk::Timer::getCurrentTime()-t_start);
+      if(wait > 0.0)
+        usleep(static_cast<useconds_t>(wait*1e6));
+    }
+    if(e.type == Event::IMU)
+    {
+      // low-pass filter of VioNode::imuCb
+      for(int i=0; i<3; ++i)
+        imu[i] = 0.2*imu[i]+0.8*e.value[i];
+      double imu_in[3] = {imu[0], imu[1], imu[2]};
+      vo->UpdateIMU(imu_in, e.t);
+    }
+    else if(e.type == Event::CMD)
+    {
+      double cmd[3] = {e.value[0], e.value[1], e.value[2]};
+      vo->UpdateCmd(cmd, e.t);
+    }
+    else
+    {
+      cv::Mat img = cv::imread(e.file, cv::IMREAD_GRAYSCALE), frame;
+      if(img.empty() || !preprocess(img, frame))
+      {
+        ++n_skipped;
+        continue;
+      }
+      vo->addImage(frame, e.t);
+      if(++n_frames == max_frames)
+        break;
+    }
+  }
+  const double total = vk::Timer::getCurrentTime()-t_start;
+
+  printf("replayed %zu frames (%zu skipped) in %.3f s\n", n_frames, n_skipped, total);
+#ifdef VIO_TRACE
+  if(vio::g_permon)
+    vio::g_permon->writeSummary(stdout);
+#endif
+  vo->depthFilter()->stopThread();
+  delete vo;
+  delete cam;
+  return 0;
+}